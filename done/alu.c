@@ -94,7 +94,10 @@ void handle_flag_setting(alu_output_t *result, bit_t half_carry, bit_t carry, bo
         set_N(&result->flags);
 }
 
-int alu_add8(alu_output_t *result, uint8_t x, uint8_t y, bit_t c0)
+// ======================================================================
+// Bit-by-bit implementations: reference for the lookup tables (see below)
+
+static int alu_add8_bitwise(alu_output_t *result, uint8_t x, uint8_t y, bit_t c0)
 {
     M_REQUIRE_NON_NULL(result);
 
@@ -110,7 +113,7 @@ int alu_add8(alu_output_t *result, uint8_t x, uint8_t y, bit_t c0)
     return ERR_NONE;
 }
 
-int alu_sub8(alu_output_t *result, uint8_t x, uint8_t y, bit_t b0)
+static int alu_sub8_bitwise(alu_output_t *result, uint8_t x, uint8_t y, bit_t b0)
 {
     M_REQUIRE_NON_NULL(result);
 
@@ -180,7 +183,7 @@ int alu_add16_high(alu_output_t *result, uint16_t x, uint16_t y)
     return ERR_NONE;
 }
 
-int alu_shift(alu_output_t *result, uint8_t x, rot_dir_t dir)
+static int alu_shift_bitwise(alu_output_t *result, uint8_t x, rot_dir_t dir)
 {
     M_REQUIRE_NON_NULL(result);
     M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
@@ -202,7 +205,7 @@ int alu_shift(alu_output_t *result, uint8_t x, rot_dir_t dir)
     return ERR_NONE;
 }
 
-int alu_shiftR_A(alu_output_t *result, uint8_t x)
+static int alu_shiftR_A_bitwise(alu_output_t *result, uint8_t x)
 {
     M_REQUIRE_NON_NULL(result);
 
@@ -218,7 +221,7 @@ int alu_shiftR_A(alu_output_t *result, uint8_t x)
     return ERR_NONE;
 }
 
-int alu_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir)
+static int alu_rotate_bitwise(alu_output_t *result, uint8_t x, rot_dir_t dir)
 {
     M_REQUIRE_NON_NULL(result);
     M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
@@ -237,7 +240,7 @@ int alu_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir)
     return ERR_NONE;
 }
 
-int alu_carry_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir, flags_t flags)
+static int alu_carry_rotate_bitwise(alu_output_t *result, uint8_t x, rot_dir_t dir, flags_t flags)
 {
     M_REQUIRE_NON_NULL(result);
     M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
@@ -253,3 +256,230 @@ int alu_carry_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir, flags_t fla
 
     return ERR_NONE;
 }
+
+// ======================================================================
+// Lookup tables
+//
+// Les fanions des additions et soustractions 8 bits sont tabulés par
+// (retenue, x, y) : 128 Kio par opération, ce qui tient dans le cache L2 ;
+// le résultat, lui, n'est qu'une addition. Décalages, rotations, SWAP et
+// DAA n'ont qu'un octet (et une retenue ou des fanions) en entrée : chaque
+// case donne d'un coup le résultat (8 lsb) et les fanions (8 msb).
+// Les tables sont remplies une fois, au chargement du programme
+// (unit-test-alu-tables les compare aux fonctions bit à bit).
+
+/**
+ * @brief 8-bit arithmetic operations
+ */
+typedef enum
+{
+    ALU_ADD,
+    ALU_SUB,
+    ALU_NB_ARITH
+} alu_arith_t;
+
+/**
+ * @brief Shifts and rotations
+ */
+typedef enum
+{
+    ALU_SHIFT_L,
+    ALU_SHIFT_R,
+    ALU_SHIFT_R_A,
+    ALU_ROT_L,
+    ALU_ROT_R,
+    ALU_CROT_L,
+    ALU_CROT_R,
+    ALU_NB_ROT
+} alu_rot_t;
+
+static flags_t alu_arith_flags[ALU_NB_ARITH][2][256][256]; // [op][carry in][x][y]
+static uint16_t alu_rot_table[ALU_NB_ROT][2][256];         // [op][carry in][x]
+static uint16_t alu_swap_table[256];                       // [x]
+static uint16_t alu_daa_table[8][256];                     // [N H C][x]
+
+#define alu_entry(value, flags) ((uint16_t)((unsigned)(flags) << 8 | ((value) & 0xFFu)))
+#define alu_entry_value(e) ((uint8_t)(e))
+#define alu_entry_flags(e) ((flags_t)((e) >> 8))
+
+/**
+ * @brief DAA, as alu_bcd_adjust() of the external library does it
+ *        (N is kept, H cleared)
+ */
+static uint16_t alu_daa_entry(uint8_t x, flags_t flags)
+{
+    unsigned value = x;
+    flags_t res_f = flags & FLAG_N;
+
+    if (!(flags & FLAG_N))
+    {
+        if ((flags & FLAG_C) || value > 0x99u)
+        {
+            value += 0x60u;
+            res_f |= FLAG_C;
+        }
+        if ((flags & FLAG_H) || (value & 0xFu) > 0x9u)
+            value += 0x06u;
+    }
+    else
+    {
+        if (flags & FLAG_C)
+        {
+            value -= 0x60u;
+            res_f |= FLAG_C;
+        }
+        if (flags & FLAG_H)
+            value -= 0x06u;
+    }
+
+    if ((value & 0xFFu) == 0u)
+        res_f |= FLAG_Z;
+
+    return alu_entry(value, res_f);
+}
+
+/**
+ * @brief Fills the lookup tables (run before main())
+ */
+static void alu_tables_init(void) __attribute__((constructor));
+static void alu_tables_init(void)
+{
+    for (unsigned c = 0; c < 2; ++c)
+    {
+        for (unsigned x = 0; x < 256; ++x)
+        {
+            for (unsigned y = 0; y < 256; ++y)
+            {
+                // closed forms: 2 x 64 Ki calls to the bit-by-bit functions
+                // would cost some milliseconds to every program start
+                const unsigned sum = x + y + c;
+                alu_arith_flags[ALU_ADD][c][x][y] = (flags_t)(
+                    ((sum & 0xFFu) == 0u ? FLAG_Z : 0u)
+                    | ((x & 0xFu) + (y & 0xFu) + c > 0xFu ? FLAG_H : 0u)
+                    | (sum > 0xFFu ? FLAG_C : 0u));
+
+                const unsigned diff = x - y - c;
+                alu_arith_flags[ALU_SUB][c][x][y] = (flags_t)(
+                    ((diff & 0xFFu) == 0u ? FLAG_Z : 0u) | FLAG_N
+                    | ((x & 0xFu) < (y & 0xFu) + c ? FLAG_H : 0u)
+                    | (x < y + c ? FLAG_C : 0u));
+            }
+
+            alu_output_t rot[ALU_NB_ROT] = {{0, 0}};
+            alu_shift_bitwise(&rot[ALU_SHIFT_L], (uint8_t)x, LEFT);
+            alu_shift_bitwise(&rot[ALU_SHIFT_R], (uint8_t)x, RIGHT);
+            alu_shiftR_A_bitwise(&rot[ALU_SHIFT_R_A], (uint8_t)x);
+            alu_rotate_bitwise(&rot[ALU_ROT_L], (uint8_t)x, LEFT);
+            alu_rotate_bitwise(&rot[ALU_ROT_R], (uint8_t)x, RIGHT);
+            alu_carry_rotate_bitwise(&rot[ALU_CROT_L], (uint8_t)x, LEFT, c ? FLAG_C : 0);
+            alu_carry_rotate_bitwise(&rot[ALU_CROT_R], (uint8_t)x, RIGHT, c ? FLAG_C : 0);
+            for (int op = 0; op < ALU_NB_ROT; ++op)
+                alu_rot_table[op][c][x] = alu_entry(rot[op].value, rot[op].flags);
+        }
+    }
+
+    for (unsigned x = 0; x < 256; ++x)
+    {
+        const uint8_t swapped = (uint8_t)(x << 4 | x >> 4);
+        alu_swap_table[x] = alu_entry(swapped, swapped == 0 ? FLAG_Z : 0);
+
+        for (unsigned nhc = 0; nhc < 8; ++nhc)
+            alu_daa_table[nhc][x] = alu_daa_entry((uint8_t)x, (flags_t)(nhc << 4));
+    }
+}
+
+/**
+ * @brief Writes a shift/rotation table entry into result
+ */
+static inline void alu_rot_lookup(alu_output_t *result, alu_rot_t op, unsigned c, uint8_t x)
+{
+    const uint16_t e = alu_rot_table[op][c][x];
+    result->value = alu_entry_value(e);
+    result->flags |= alu_entry_flags(e);
+}
+
+// ======================================================================
+int alu_add8(alu_output_t *result, uint8_t x, uint8_t y, bit_t c0)
+{
+    M_REQUIRE_NON_NULL(result);
+    if (c0 > 1)
+        return alu_add8_bitwise(result, x, y, c0);
+
+    result->value = (uint8_t)(x + y + c0);
+    result->flags |= alu_arith_flags[ALU_ADD][c0][x][y];
+
+    return ERR_NONE;
+}
+
+int alu_sub8(alu_output_t *result, uint8_t x, uint8_t y, bit_t b0)
+{
+    M_REQUIRE_NON_NULL(result);
+    if (b0 > 1)
+        return alu_sub8_bitwise(result, x, y, b0);
+
+    result->value = (uint8_t)(x - y - b0);
+    result->flags |= alu_arith_flags[ALU_SUB][b0][x][y];
+
+    return ERR_NONE;
+}
+
+int alu_shift(alu_output_t *result, uint8_t x, rot_dir_t dir)
+{
+    M_REQUIRE_NON_NULL(result);
+    M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
+
+    alu_rot_lookup(result, dir == LEFT ? ALU_SHIFT_L : ALU_SHIFT_R, 0, x);
+
+    return ERR_NONE;
+}
+
+int alu_shiftR_A(alu_output_t *result, uint8_t x)
+{
+    M_REQUIRE_NON_NULL(result);
+
+    alu_rot_lookup(result, ALU_SHIFT_R_A, 0, x);
+
+    return ERR_NONE;
+}
+
+int alu_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir)
+{
+    M_REQUIRE_NON_NULL(result);
+    M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
+
+    alu_rot_lookup(result, dir == LEFT ? ALU_ROT_L : ALU_ROT_R, 0, x);
+
+    return ERR_NONE;
+}
+
+int alu_carry_rotate(alu_output_t *result, uint8_t x, rot_dir_t dir, flags_t flags)
+{
+    M_REQUIRE_NON_NULL(result);
+    M_REQUIRE((dir == LEFT) | (dir == RIGHT), ERR_BAD_PARAMETER, "input value dir (%u) is not LEFT or RIGHT", dir);
+
+    alu_rot_lookup(result, dir == LEFT ? ALU_CROT_L : ALU_CROT_R, (flags & FLAG_C) != 0, x);
+
+    return ERR_NONE;
+}
+
+int alu_swap4_fast(alu_output_t *result, uint8_t x)
+{
+    M_REQUIRE_NON_NULL(result);
+
+    const uint16_t e = alu_swap_table[x];
+    result->value = alu_entry_value(e);
+    result->flags = alu_entry_flags(e);
+
+    return ERR_NONE;
+}
+
+int alu_bcd_adjust_fast(alu_output_t *result)
+{
+    M_REQUIRE_NON_NULL(result);
+
+    const uint16_t e = alu_daa_table[(result->flags >> 4) & 0x7u][lsb8(result->value)];
+    result->value = alu_entry_value(e);
+    result->flags = alu_entry_flags(e);
+
+    return ERR_NONE;
+}
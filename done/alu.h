@@ -162,6 +162,27 @@ int alu_rotate(alu_output_t* result, uint8_t x, rot_dir_t dir);
  */
 int alu_carry_rotate(alu_output_t* result, uint8_t x, rot_dir_t dir, flags_t flags);
 
+
+/**
+ * @brief swaps 4lsb with 4msb, same as alu_swap4() (see alu_ext.h)
+ *        but table-driven
+ *
+ * @param result alu_output_t pointer to write into
+ * @param x value to swap the bits from
+ * @return error code
+ */
+int alu_swap4_fast(alu_output_t* result, uint8_t x);
+
+
+/**
+ * @brief adjusts a value to the bcd format, same as alu_bcd_adjust()
+ *        (see alu_ext.h) but table-driven
+ *
+ * @param result alu_output_t pointer use the value and flags from and to write into
+ * @return error code
+ */
+int alu_bcd_adjust_fast(alu_output_t* result);
+
 #ifdef __cplusplus
 }
 #endif
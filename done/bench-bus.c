@@ -0,0 +1,105 @@
+/**
+ * @file bench-bus.c
+ * @brief Benchmark of the 16-bit bus accesses against the former ones
+ *        (a cast of the address of the first byte to read, two bus_write()
+ *        to write)
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "bus.h"
+#include "component.h"
+#include "error.h"
+#include "util.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ROUNDS 2000
+
+// ======================================================================
+// former implementation, for reference: wrong across components and at 0xFFFF
+static int bench_old_read16(const bus_t bus, addr_t address, addr_t *data16)
+{
+    M_REQUIRE_NON_NULL(data16);
+    M_REQUIRE_NON_NULL(bus);
+    const data_t *p = bus_at(bus, address);
+    *data16 = (p == NULL || address == 0xFFFF) ? 0xFF : *((const addr_t *)(const void *)p);
+    return ERR_NONE;
+}
+
+static int bench_old_write16(bus_t bus, addr_t address, addr_t data16)
+{
+    M_REQUIRE_NON_NULL(bus);
+    M_EXIT_IF_ERR(bus_write(bus, address, (data_t) data16));
+    return bus_write(bus, (addr_t)(address + 1), (data_t)(data16 >> 8));
+}
+
+// ======================================================================
+typedef int (*bench_read16_t)(const bus_t, addr_t, addr_t *);
+typedef int (*bench_write16_t)(bus_t, addr_t, addr_t);
+
+/**
+ * @brief Times rounds of 16-bit reads and writes over [start, end[ (stack-like
+ *        use: every address, odd ones included)
+ * @return nanoseconds per access pair
+ */
+static double bench_run(bus_t bus, addr_t start, addr_t end, unsigned rounds,
+                        bench_read16_t read16, bench_write16_t write16, uint64_t *checksum)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    uint64_t sum = 0;
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        for (addr_t a = start; a < end; ++a)
+        {
+            addr_t v = 0;
+            write16(bus, a, (addr_t)(a ^ r));
+            read16(bus, a, &v);
+            sum += v;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *checksum = sum;
+
+    const double ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+    return ns / ((double) rounds * (double)(end - start));
+}
+
+// ======================================================================
+int main(int argc, char *argv[])
+{
+    const unsigned rounds = argc > 1 ? (unsigned) atoi(argv[1]) : BENCH_DEFAULT_ROUNDS;
+
+    bus_t bus;
+    zero_init_var(bus);
+    component_t work_ram;
+    zero_init_var(work_ram);
+    M_EXIT_IF_ERR(component_create(&work_ram, 0x2000));
+    M_EXIT_IF_ERR(bus_plug(bus, &work_ram, 0xC000, 0xDFFF));
+
+    uint64_t sum_old = 0;
+    uint64_t sum_new = 0;
+    // warm-up
+    bench_run(bus, 0xC000, 0xDFFF, 1, bus_read16, bus_write16, &sum_new);
+
+    const double t_old = bench_run(bus, 0xC000, 0xDFFF, rounds, bench_old_read16, bench_old_write16, &sum_old);
+    const double t_new = bench_run(bus, 0xC000, 0xDFFF, rounds, bus_read16, bus_write16, &sum_new);
+
+    printf("16-bit write + read over work RAM, %u rounds\n", rounds);
+    printf("  former   : %6.2f ns\n", t_old);
+    printf("  bus16    : %6.2f ns (%.2fx)\n", t_new, t_old / t_new);
+    if (sum_old != sum_new)
+        printf("  checksums differ: %" PRIu64 " / %" PRIu64 "\n", sum_old, sum_new);
+
+    M_EXIT_IF_ERR(bus_unplug(bus, &work_ram));
+    component_free(&work_ram);
+
+    return sum_old == sum_new ? ERR_NONE : ERR_BAD_PARAMETER;
+}
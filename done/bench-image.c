@@ -0,0 +1,176 @@
+/**
+ * @file bench-image.c
+ * @brief Benchmark of the pixel kernels of image.c against the former
+ *        bit vector implementation (palette applied with bit vector masks,
+ *        tile rows put into image lines one reversed byte at a time)
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "image.h"
+#include "bit_vector.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ROUNDS 200000
+#define BENCH_LINE_SIZE      256 // a whole background line
+#define BENCH_TILES          (BENCH_LINE_SIZE / 8)
+#define BENCH_PALETTE        0x1B
+
+// ======================================================================
+// former implementation, for reference
+static bit_vector_t *bench_old_mask(image_line_t iml, size_t color)
+{
+    switch (color)
+    {
+    case 0:
+    {
+        bit_vector_t *tmp = bit_vector_not(bit_vector_cpy(iml.lsb));
+        bit_vector_t *mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), tmp);
+        bit_vector_free(&tmp);
+        return mask;
+    }
+    case 1:
+        return bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), iml.lsb);
+    case 2:
+        return bit_vector_and(bit_vector_not(bit_vector_cpy(iml.lsb)), iml.msb);
+    default:
+        return bit_vector_and(bit_vector_cpy(iml.lsb), iml.msb);
+    }
+}
+
+static int bench_old_map_colors(image_line_t *output, image_line_t iml, palette_t map)
+{
+    output->lsb = bit_vector_create(iml.lsb->size, 0);
+    output->msb = bit_vector_create(iml.msb->size, 0);
+    output->opacity = bit_vector_cpy(iml.opacity);
+
+    for (size_t i = 0; i < PALETTE_COLOR_COUNT; ++i)
+    {
+        const bit_t color_bit_0 = (bit_t)(map & (1 << (i * 2)));
+        const bit_t color_bit_1 = (bit_t)(map & (1 << (i * 2 + 1)));
+        if (color_bit_0 || color_bit_1)
+        {
+            bit_vector_t *mask = bench_old_mask(iml, i);
+            if (color_bit_0)
+                output->lsb = bit_vector_or(output->lsb, mask);
+            if (color_bit_1)
+                output->msb = bit_vector_or(output->msb, mask);
+            bit_vector_free(&mask);
+        }
+    }
+
+    return output->lsb == NULL || output->msb == NULL || output->opacity == NULL ? ERR_MEM : ERR_NONE;
+}
+
+static uint8_t bench_reverse_bits(uint8_t b)
+{
+    uint8_t r = 0;
+    for (int i = 0; i < 8; ++i)
+        r = (uint8_t)((r << 1) | ((b >> i) & 1));
+    return r;
+}
+
+static int bench_old_tile_line(image_line_t *output, const uint8_t *rows, palette_t map)
+{
+    image_line_t line = {0};
+    M_EXIT_IF_ERR(image_line_create(&line, BENCH_LINE_SIZE));
+    for (size_t w = 0; w < BENCH_TILES / 4; ++w)
+    {
+        uint32_t msb = 0;
+        uint32_t lsb = 0;
+        for (size_t j = 0; j < 4; ++j)
+        {
+            lsb |= (uint32_t) bench_reverse_bits(rows[2 * (4 * w + j)]) << (8 * j);
+            msb |= (uint32_t) bench_reverse_bits(rows[2 * (4 * w + j) + 1]) << (8 * j);
+        }
+        M_EXIT_IF_ERR(image_line_set_word(&line, w, msb, lsb));
+    }
+    const int err = bench_old_map_colors(output, line, map);
+    image_line_free(&line);
+    return err;
+}
+
+// ======================================================================
+static double bench_elapsed(const struct timespec *t0, unsigned rounds)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    const double ns = (double)(t1.tv_sec - t0->tv_sec) * 1e9 + (double)(t1.tv_nsec - t0->tv_nsec);
+    return ns / (double) rounds;
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned rounds = argc > 1 ? (unsigned) atoi(argv[1]) : BENCH_DEFAULT_ROUNDS;
+
+    uint8_t rows[2 * BENCH_TILES];
+    for (size_t i = 0; i < sizeof(rows); ++i)
+        rows[i] = (uint8_t)(i * 0x9D + 0x35);
+
+    image_line_t line = {0};
+    M_EXIT_IF_ERR(image_line_create(&line, BENCH_LINE_SIZE));
+    for (size_t w = 0; w < BENCH_LINE_SIZE / IMAGE_LINE_WORD_BITS; ++w)
+        M_EXIT_IF_ERR(image_line_set_word(&line, w, (uint32_t) w * 0x9E3779B9u, (uint32_t) w * 0x7F4A7C15u));
+
+    struct timespec t0;
+    uint64_t sum_old = 0;
+    uint64_t sum_new = 0;
+
+    // palette of a line
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        image_line_t mapped = {0};
+        bench_old_map_colors(&mapped, line, BENCH_PALETTE);
+        sum_old += mapped.msb->content[r % 8] ^ mapped.lsb->content[r % 8];
+        image_line_free(&mapped);
+    }
+    const double t_old_map = bench_elapsed(&t0, rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        image_line_t mapped = {0};
+        image_line_map_colors(&mapped, line, BENCH_PALETTE);
+        sum_new += mapped.msb->content[r % 8] ^ mapped.lsb->content[r % 8];
+        image_line_free(&mapped);
+    }
+    const double t_new_map = bench_elapsed(&t0, rounds);
+
+    // a line of tiles, with its palette
+    uint8_t pixels[BENCH_LINE_SIZE];
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        image_line_t mapped = {0};
+        bench_old_tile_line(&mapped, rows, BENCH_PALETTE);
+        sum_old += mapped.msb->content[r % 8];
+        image_line_free(&mapped);
+    }
+    const double t_old_tiles = bench_elapsed(&t0, rounds);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        image_pixels_from_tile_rows(pixels, rows, BENCH_TILES, BENCH_PALETTE);
+        uint32_t msb, lsb;
+        image_pixels_to_word(pixels + IMAGE_LINE_WORD_BITS * (r % 8), &msb, &lsb);
+        sum_new += msb;
+    }
+    const double t_new_tiles = bench_elapsed(&t0, rounds);
+
+    printf("%d-pixel lines, %u rounds\n", BENCH_LINE_SIZE, rounds);
+    printf("  palette      former %8.1f ns, kernels %8.1f ns (%.1fx)\n", t_old_map, t_new_map, t_old_map / t_new_map);
+    printf("  tile rows    former %8.1f ns, kernels %8.1f ns (%.1fx)\n", t_old_tiles, t_new_tiles, t_old_tiles / t_new_tiles);
+    if (sum_old != sum_new)
+        printf("  checksums differ: %llu / %llu\n", (unsigned long long) sum_old, (unsigned long long) sum_new);
+
+    image_line_free(&line);
+
+    return sum_old == sum_new ? ERR_NONE : ERR_BAD_PARAMETER;
+}
@@ -10,19 +10,146 @@
 #include "error.h"
 #include "component.h"
 #include "gameboy.h"
+#include "cpu-registers.h"
+
+// shared by every Game Boy: the bus never writes to it (it is plugged read-only)
+static data_t bootrom_content[MEM_SIZE(BOOT_ROM)] = GAMEBOY_BOOT_ROM_CONTENT;
+static memory_t bootrom_memory = { MEM_SIZE(BOOT_ROM), bootrom_content, true };
 
 int bootrom_init(component_t *c)
 {
 	M_REQUIRE_NON_NULL(c);
 
-	M_EXIT_IF_ERR(component_create(c, MEM_SIZE(BOOT_ROM)));
+	c->mem = &bootrom_memory;
+	c->start = 0;
+	c->end = 0;
+
+	return ERR_NONE;
+}
+
+void bootrom_free(component_t *c)
+{
+	if (c != NULL)
+	{
+		c->mem = NULL;
+		c->start = 0;
+		c->end = 0;
+	}
+}
+
+int bootrom_plug(component_t *c, bus_t bus)
+{
+	// read-only memory: plugged with read access only
+	return bus_forced_plug(bus, c, BOOT_ROM_START, BOOT_ROM_END, 0);
+}
+
+// ======================================================================
+// state left by the boot ROM (DMG)
+
+#define BOOT_END_PC  0x0100
+#define BOOT_END_SP  0xFFFE
+#define BOOT_END_AF  0x01B0
+#define BOOT_END_BC  0x0013
+#define BOOT_END_DE  0x00D8
+#define BOOT_END_HL  0x014D
+// internal counter of the timer (DIV = 0xAB)
+#define BOOT_END_COUNTER 0xABCC
+
+// where the boot ROM draws the logo: tiles 1 to 24 (logo) then 25 (®)
+#define BOOT_LOGO_TILES    0x8010
+#define BOOT_LOGO_MAP_TOP  0x9904
+#define BOOT_LOGO_MAP_LOW  0x9924
+#define BOOT_LOGO_MAP_R    0x9910
+#define BOOT_LOGO_R_SRC    0xB1   // ® tile, in the boot ROM itself
+#define BOOT_LOGO_WIDTH    12     // tiles per row
 
-	data_t content[MEM_SIZE(BOOT_ROM)] = GAMEBOY_BOOT_ROM_CONTENT;
-	for (size_t i = 0; i < MEM_SIZE(BOOT_ROM); ++i)
+static const struct {
+	addr_t addr;
+	data_t value;
+} bootrom_end_registers[] = {
+	{ 0xFF02, 0x7E }, // SC
+	{ 0xFF07, 0xF8 }, // TAC
+	{ 0xFF0F, 0xE1 }, // IF
+	{ 0xFF10, 0x80 }, { 0xFF11, 0xBF }, { 0xFF12, 0xF3 }, { 0xFF14, 0xBF }, // sound
+	{ 0xFF16, 0x3F }, { 0xFF19, 0xBF }, { 0xFF1A, 0x7F }, { 0xFF1B, 0xFF },
+	{ 0xFF1C, 0x9F }, { 0xFF1E, 0xBF }, { 0xFF20, 0xFF }, { 0xFF23, 0xBF },
+	{ 0xFF24, 0x77 }, { 0xFF25, 0xF3 }, { 0xFF26, 0xF1 },
+	{ 0xFF40, 0x91 }, // LCDC: screen and background on
+	{ 0xFF41, 0x85 }, // STAT
+	{ 0xFF46, 0xFF }, // DMA
+	{ 0xFF47, 0xFC }, // BGP
+	{ 0xFF48, 0xFF }, // OBP0
+	{ 0xFF49, 0xFF }, // OBP1
+	{ REG_BOOT_ROM_DISABLE, 0x01 },
+};
+
+#define BOOT_NB_REGISTERS (sizeof(bootrom_end_registers) / sizeof(bootrom_end_registers[0]))
+
+/**
+ * @brief Draws 4 bits of the logo as the boot ROM does: each bit twice
+ *        as wide, each row twice (on the first bit plane only)
+ */
+static int bootrom_logo_nibble(bus_t bus, addr_t *tile, data_t nibble)
+{
+	data_t row = 0;
+	for (int b = 3; b >= 0; --b)
 	{
-		c->mem->memory[i] = content[i];
+		row = (data_t)(row << 2);
+		if (nibble & (1 << b))
+			row |= 0x3;
 	}
 
+	M_EXIT_IF_ERR(bus_write(bus, *tile, row));
+	M_EXIT_IF_ERR(bus_write(bus, (addr_t)(*tile + 2), row));
+	*tile = (addr_t)(*tile + 4);
+
+	return ERR_NONE;
+}
+
+int bootrom_skip(gameboy_t *gameboy)
+{
+	M_REQUIRE_NON_NULL(gameboy);
+
+	cpu_t *cpu = &gameboy->cpu;
+	cpu_AF_set(cpu, BOOT_END_AF);
+	cpu_BC_set(cpu, BOOT_END_BC);
+	cpu_DE_set(cpu, BOOT_END_DE);
+	cpu_HL_set(cpu, BOOT_END_HL);
+	cpu->SP = BOOT_END_SP;
+	cpu->PC = BOOT_END_PC;
+
+	// straight to memory: these are not CPU writes
+	for (size_t i = 0; i < BOOT_NB_REGISTERS; ++i)
+		M_EXIT_IF_ERR(bus_write(gameboy->bus, bootrom_end_registers[i].addr, bootrom_end_registers[i].value));
+
+	M_EXIT_IF_ERR(timer_bus_listener(&gameboy->timer, REG_TAC));
+	gameboy->timer.counter = BOOT_END_COUNTER;
+	M_EXIT_IF_ERR(timer_bus_update(&gameboy->timer));
+
+	// the logo of the cartridge and the ® of the boot ROM
+	addr_t tile = BOOT_LOGO_TILES;
+	for (addr_t a = CARTRIDGE_LOGO_START; a <= CARTRIDGE_LOGO_END; ++a)
+	{
+		data_t byte = 0;
+		M_EXIT_IF_ERR(bus_read(gameboy->bus, a, &byte));
+		M_EXIT_IF_ERR(bootrom_logo_nibble(gameboy->bus, &tile, (data_t)(byte >> 4)));
+		M_EXIT_IF_ERR(bootrom_logo_nibble(gameboy->bus, &tile, (data_t)(byte & 0xF)));
+	}
+	for (size_t i = 0; i < 8; ++i)
+	{
+		M_EXIT_IF_ERR(bus_write(gameboy->bus, tile, bootrom_content[BOOT_LOGO_R_SRC + i]));
+		tile = (addr_t)(tile + 2);
+	}
+
+	for (data_t t = 1; t <= BOOT_LOGO_WIDTH; ++t)
+	{
+		M_EXIT_IF_ERR(bus_write(gameboy->bus, (addr_t)(BOOT_LOGO_MAP_TOP + t - 1), t));
+		M_EXIT_IF_ERR(bus_write(gameboy->bus, (addr_t)(BOOT_LOGO_MAP_LOW + t - 1), (data_t)(t + BOOT_LOGO_WIDTH)));
+	}
+	M_EXIT_IF_ERR(bus_write(gameboy->bus, BOOT_LOGO_MAP_R, 2 * BOOT_LOGO_WIDTH + 1));
+
+	gameboy->boot = 0;
+
 	return ERR_NONE;
 }
 
@@ -57,18 +57,42 @@ extern "C" {
 
 
 /**
- * @brief Writes bootrom content to a component
+ * @brief Gives a component the bootrom content
+ *        (one read-only copy shared by all the Game Boys of the process)
  *
- * @param c component to write the bootrom content to
+ * @param c component to give the bootrom content to
  * @return error code
  */
 int bootrom_init(component_t* c);
 
 
 /**
- * @brief Macro to plug bootrom onto the bus
+ * @brief Forgets the bootrom content of a component (which must be unplugged)
+ *
+ * @param c component to free
+ */
+void bootrom_free(component_t* c);
+
+
+/**
+ * @brief Plugs bootrom onto the bus, read-only
+ *
+ * @param c bootrom component
+ * @param bus bus to plug it onto
+ * @return error code
+ */
+int bootrom_plug(component_t* c, bus_t bus);
+
+
+/**
+ * @brief Puts a Game Boy in the state the boot ROM leaves it in, without
+ *        running it: CPU registers, I/O registers, logo in video RAM,
+ *        screen on. The cartridge must be plugged; the bootrom is not.
+ *
+ * @param gameboy gameboy, the components of which are plugged
+ * @return error code
  */
-#define bootrom_plug(c, bus) bus_forced_plug(bus, c, BOOT_ROM_START, BOOT_ROM_END, 0)
+int bootrom_skip(gameboy_t* gameboy);
 
 
 /**
@@ -11,6 +11,101 @@
 #include "component.h"
 #include "bit.h"
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define page_of(addr)     ((addr) >> BUS_PAGE_BITS)
+#define page_start(p)     ((size_t)(p) << BUS_PAGE_BITS)
+#define page_offset(addr) ((addr) & (BUS_PAGE_SIZE - 1))
+#define page_end(p)       (page_start(p) + BUS_PAGE_SIZE - 1)
+
+/**
+ * @brief Turns a page into a split one (one pointer per address)
+ */
+static int bus_page_split(bus_page_t *page)
+{
+    if (page->slots != NULL)
+        return ERR_NONE;
+
+    page->slots = calloc(BUS_PAGE_SIZE, sizeof(data_t *));
+    M_EXIT_IF_NULL(page->slots, BUS_PAGE_SIZE * sizeof(data_t *));
+
+    if (page->base != NULL)
+    {
+        for (size_t i = 0; i < BUS_PAGE_SIZE; ++i)
+            page->slots[i] = page->base + i;
+        page->base = NULL;
+    }
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Gives back the fast path (or frees the page) when a split page
+ *        turns out to be contiguous (or empty)
+ */
+static void bus_page_merge(bus_page_t *page)
+{
+    if (page->slots == NULL)
+        return;
+
+    data_t *const first = page->slots[0];
+    bool empty = (first == NULL);
+    bool contiguous = (first != NULL);
+    for (size_t i = 1; i < BUS_PAGE_SIZE && (empty || contiguous); ++i)
+    {
+        empty = empty && page->slots[i] == NULL;
+        contiguous = contiguous && page->slots[i] == first + i;
+    }
+
+    if (empty || contiguous)
+    {
+        free(page->slots);
+        page->slots = NULL;
+        page->base = first;
+        if (empty)
+            page->flags = 0;
+    }
+}
+
+/**
+ * @brief Maps [start, end] onto mem (or unmaps it if mem is NULL), page by page,
+ *        with the given access
+ */
+static int bus_map(bus_t bus, size_t start, size_t end, data_t *mem, uint8_t flags)
+{
+    for (size_t p = page_of(start); p <= page_of(end); ++p)
+    {
+        bus_page_t *page = &bus[p];
+        const size_t lo = start > page_start(p) ? start : page_start(p);
+        const size_t hi = end < page_end(p) ? end : page_end(p);
+
+        if (lo == page_start(p) && hi == page_end(p))
+        {
+            // whole page: a single pointer does it
+            free(page->slots);
+            page->slots = NULL;
+            page->base = (mem == NULL) ? NULL : mem + (lo - start);
+            page->flags = (mem == NULL) ? 0 : flags;
+        }
+        else
+        {
+            if (mem == NULL && page->base == NULL && page->slots == NULL)
+                continue;
+
+            M_EXIT_IF_ERR(bus_page_split(page));
+            for (size_t a = lo; a <= hi; ++a)
+            {
+                page->slots[page_offset(a)] = (mem == NULL) ? NULL : mem + (a - start);
+            }
+            if (mem != NULL)
+                page->flags = flags;
+            bus_page_merge(page);
+        }
+    }
+
+    return ERR_NONE;
+}
 
 int bus_remap(bus_t bus, component_t *c, addr_t offset)
 {
@@ -21,13 +116,8 @@ int bus_remap(bus_t bus, component_t *c, addr_t offset)
     M_REQUIRE(c->end >= c->start, ERR_ADDRESS, "input component has a start adress 0x%" PRIX16 " biger than end address 0x%" PRIX16, c->start, c->end);
     M_REQUIRE((size_t)(c->end - c->start + offset) <= c->mem->size, ERR_ADDRESS, "input offset 0x%" PRIX16 " is incorrect", offset);
 
-    size_t s = (size_t)(c->end - c->start + 1);
-    for (size_t i = 0; i < s; ++i)
-    {
-        bus[c->start + i] = &c->mem->memory[offset + i];
-    }
-
-    return ERR_NONE;
+    // read-only memory (a ROM mapping) never gets writable pages: writes are lost
+    return bus_map(bus, c->start, c->end, &c->mem->memory[offset], c->mem->read_only ? BUS_PAGE_READ : BUS_PAGE_RW);
 }
 
 int bus_forced_plug(bus_t bus, component_t *c, addr_t start, addr_t end, addr_t offset)
@@ -54,10 +144,19 @@ int bus_plug(bus_t bus, component_t *c, addr_t start, addr_t end)
     M_REQUIRE_NON_NULL(bus);
     M_REQUIRE_NON_NULL(c);
 
-    for (size_t i = start; i <= end; ++i)
+    for (size_t p = page_of(start); p <= page_of(end); ++p)
     {
-        if (bus[i] != NULL)
+        if (bus[p].base != NULL)
             return ERR_ADDRESS;
+
+        // only split pages need a closer look
+        const size_t lo = start > page_start(p) ? start : page_start(p);
+        const size_t hi = end < page_end(p) ? end : page_end(p);
+        for (size_t a = lo; bus[p].slots != NULL && a <= hi; ++a)
+        {
+            if (bus[p].slots[page_offset(a)] != NULL)
+                return ERR_ADDRESS;
+        }
     }
     return bus_forced_plug(bus, c, start, end, 0);
 }
@@ -67,22 +166,167 @@ int bus_unplug(bus_t bus, component_t *c)
     M_REQUIRE_NON_NULL(bus);
     M_REQUIRE_NON_NULL(c);
 
-    for (size_t i = c->start; i <= c->end; ++i)
-    {
-        bus[i] = NULL;
-    }
+    M_EXIT_IF_ERR(bus_map(bus, c->start, c->end, NULL, 0));
     c->start = 0;
     c->end = 0;
 
     return ERR_NONE;
 }
 
+int bus_plug_register(bus_t bus, addr_t address, data_t *reg)
+{
+    M_REQUIRE_NON_NULL(bus);
+
+    return bus_map(bus, address, address, reg, BUS_PAGE_RW);
+}
+
+/**
+ * @brief Gives each address of a page its own I/O handlers
+ */
+static int bus_mmio_split(bus_page_t *page)
+{
+    if (page->mmio_split)
+        return ERR_NONE;
+
+    bus_mmio_t *table = calloc(BUS_PAGE_SIZE, sizeof(bus_mmio_t));
+    M_EXIT_IF_NULL(table, BUS_PAGE_SIZE * sizeof(bus_mmio_t));
+
+    if (page->mmio != NULL)
+    {
+        for (size_t i = 0; i < BUS_PAGE_SIZE; ++i)
+            table[i] = *page->mmio;
+        free(page->mmio);
+    }
+    page->mmio = table;
+    page->mmio_split = true;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Frees the I/O handlers of a page if none is left
+ */
+static void bus_mmio_merge(bus_page_t *page)
+{
+    for (size_t i = 0; page->mmio != NULL && i < (page->mmio_split ? BUS_PAGE_SIZE : 1); ++i)
+    {
+        if (page->mmio[i].on_read != NULL || page->mmio[i].on_write != NULL)
+            return;
+    }
+
+    free(page->mmio);
+    page->mmio = NULL;
+    page->mmio_split = false;
+}
+
+int bus_set_mmio(bus_t bus, addr_t start, addr_t end, bus_handler_t on_read, bus_handler_t on_write, void *obj)
+{
+    M_REQUIRE_NON_NULL(bus);
+    M_REQUIRE(end >= start, ERR_BAD_PARAMETER, "inputs start(%x) is greater than end(%x)", start, end);
+
+    const bus_mmio_t mmio = {on_read, on_write, obj};
+
+    for (size_t p = page_of(start); p <= page_of(end); ++p)
+    {
+        bus_page_t *page = &bus[p];
+        const size_t lo = start > page_start(p) ? start : page_start(p);
+        const size_t hi = end < page_end(p) ? end : page_end(p);
+
+        if (lo == page_start(p) && hi == page_end(p))
+        {
+            // whole page: one set of handlers does it
+            free(page->mmio);
+            page->mmio = NULL;
+            page->mmio_split = false;
+            if (on_read != NULL || on_write != NULL)
+            {
+                page->mmio = malloc(sizeof(bus_mmio_t));
+                M_EXIT_IF_NULL(page->mmio, sizeof(bus_mmio_t));
+                *page->mmio = mmio;
+            }
+        }
+        else
+        {
+            if (on_read == NULL && on_write == NULL && page->mmio == NULL)
+                continue;
+
+            M_EXIT_IF_ERR(bus_mmio_split(page));
+            for (size_t a = lo; a <= hi; ++a)
+            {
+                page->mmio[page_offset(a)] = mmio;
+            }
+            bus_mmio_merge(page);
+        }
+    }
+
+    return ERR_NONE;
+}
+
+int bus_set_access(bus_t bus, addr_t start, addr_t end, uint8_t flags)
+{
+    M_REQUIRE_NON_NULL(bus);
+    M_REQUIRE(end >= start, ERR_BAD_PARAMETER, "inputs start(%x) is greater than end(%x)", start, end);
+    M_REQUIRE(page_offset(start) == 0 && page_offset(end) == BUS_PAGE_SIZE - 1, ERR_ADDRESS,
+              "area [%x, %x] is not made of whole pages", start, end);
+
+    for (size_t p = page_of(start); p <= page_of(end); ++p)
+    {
+        bus[p].flags = flags & BUS_PAGE_RW;
+    }
+
+    return ERR_NONE;
+}
+
+int bus_map_pages(bus_t bus, addr_t start, addr_t end, data_t *mem)
+{
+    M_REQUIRE_NON_NULL(bus);
+    M_REQUIRE_NON_NULL(mem);
+    M_REQUIRE(end >= start, ERR_BAD_PARAMETER, "inputs start(%x) is greater than end(%x)", start, end);
+    M_REQUIRE(page_offset(start) == 0 && page_offset(end) == BUS_PAGE_SIZE - 1, ERR_ADDRESS,
+              "area [%x, %x] is not made of whole pages", start, end);
+
+    for (size_t p = page_of(start); p <= page_of(end); ++p)
+    {
+        free(bus[p].slots);
+        bus[p].slots = NULL;
+        bus[p].base = mem + (page_start(p) - start);
+    }
+
+    return ERR_NONE;
+}
+
+int bus_copy(bus_t bus, addr_t dst, addr_t src, size_t n)
+{
+    M_REQUIRE_NON_NULL(bus);
+    M_REQUIRE(n <= BUS_PAGE_SIZE, ERR_BAD_PARAMETER, "cannot copy %zu bytes at once", n);
+
+    const bus_page_t *from = &bus[page_of(src)];
+    const bus_page_t *to = &bus[page_of(dst)];
+    if (from->base != NULL && (from->flags & BUS_PAGE_READ) && page_offset(src) + n <= BUS_PAGE_SIZE
+        && to->base != NULL && (to->flags & BUS_PAGE_WRITE) && page_offset(dst) + n <= BUS_PAGE_SIZE)
+    {
+        memmove(to->base + page_offset(dst), from->base + page_offset(src), n);
+        return ERR_NONE;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        data_t data = 0;
+        M_EXIT_IF_ERR(bus_read(bus, (addr_t)(src + i), &data));
+        if (bus_at(bus, (addr_t)(dst + i)) != NULL)
+            M_EXIT_IF_ERR(bus_write(bus, (addr_t)(dst + i), data));
+    }
+
+    return ERR_NONE;
+}
+
 int bus_read(const bus_t bus, addr_t address, data_t *data)
 {
     M_REQUIRE_NON_NULL(data);
     M_REQUIRE_NON_NULL(bus);
 
-    *data = (bus[address] == NULL) ? 0xFF : *bus[address];
+    const data_t *p = bus_at(bus, address);
+    *data = (p == NULL || !(bus[page_of(address)].flags & BUS_PAGE_READ)) ? 0xFF : *p;
 
     return ERR_NONE;
 }
@@ -90,21 +334,50 @@ int bus_read(const bus_t bus, addr_t address, data_t *data)
 int bus_write(bus_t bus, addr_t address, data_t data)
 {
     M_REQUIRE_NON_NULL(bus);
-    M_REQUIRE_NON_NULL(bus[address]);
+    data_t *p = bus_at(bus, address);
+    M_REQUIRE_NON_NULL(p);
 
-    *bus[address] = data;
+    // writes to read-only memory (ROM) are lost
+    if (bus[page_of(address)].flags & BUS_PAGE_WRITE)
+        *p = data;
 
     return ERR_NONE;
 }
 
+/**
+ * @brief Gives the memory of both bytes at address and address + 1 when they
+ *        are contiguous host memory with the given access, NULL otherwise
+ */
+static inline data_t *bus_at16(const bus_t bus, addr_t address, uint8_t access)
+{
+    const bus_page_t *page = &bus[page_of(address)];
+
+    // the last byte of a page is followed by another page (0xFFFF by 0x0000)
+    if (page->base == NULL || (page->flags & access) != access || page_offset(address) == BUS_PAGE_SIZE - 1)
+        return NULL;
+
+    return page->base + page_offset(address);
+}
+
 int bus_read16(const bus_t bus, addr_t address, addr_t *data16)
 {
     M_REQUIRE_NON_NULL(data16);
     M_REQUIRE_NON_NULL(bus);
-    // on récupère les deux octets d'un coup en castant la valeur pointée par address
-    // 0xFFFF étant la dernière addresse du bus il n'est pas possible d'y lire 2 octets
-    // sans causer de segmentation fault
-    *data16 = (bus[address] == NULL || address == 0xFFFF) ? 0xFF : *((addr_t *)bus[address]);
+
+    const data_t *p = bus_at16(bus, address, BUS_PAGE_READ);
+    if (p != NULL)
+    {
+        // little-endian whatever the host, compiled to a single (unaligned) load
+        *data16 = (addr_t)(p[0] | (p[1] << 8));
+        return ERR_NONE;
+    }
+
+    // each byte on its own: they may belong to different components
+    data_t lsb = 0;
+    data_t msb = 0;
+    M_EXIT_IF_ERR(bus_read(bus, address, &lsb));
+    M_EXIT_IF_ERR(bus_read(bus, (addr_t)(address + 1), &msb));
+    *data16 = merge8(lsb, msb);
 
     return ERR_NONE;
 }
@@ -112,7 +385,17 @@ int bus_read16(const bus_t bus, addr_t address, addr_t *data16)
 int bus_write16(bus_t bus, addr_t address, addr_t data16)
 {
     M_REQUIRE_NON_NULL(bus);
-    *((addr_t *)bus[address]) = data16;
 
-    return ERR_NONE;
+    data_t *p = bus_at16(bus, address, BUS_PAGE_WRITE);
+    if (p != NULL)
+    {
+        // compiled to a single (unaligned) store
+        p[0] = (data_t) data16;
+        p[1] = (data_t)(data16 >> 8);
+        return ERR_NONE;
+    }
+
+    // byte by byte: the two bytes may not have the same access (ROM is mapped read-only)
+    M_EXIT_IF_ERR(bus_write(bus, address, lsb8(data16)));
+    return bus_write(bus, (addr_t)(address + 1), msb8(data16));
 }
@@ -13,6 +13,7 @@
 
 #include "memory.h"     // addr_t and data_t
 #include "component.h"
+#include "error.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,11 +21,116 @@ extern "C" {
 
 #define BUS_SIZE 65536
 
+#define BUS_PAGE_BITS 8
+#define BUS_PAGE_SIZE (1 << BUS_PAGE_BITS)
+#define BUS_NB_PAGES  (BUS_SIZE / BUS_PAGE_SIZE)
+
+// Page access flags
+#define BUS_PAGE_READ  0x1
+#define BUS_PAGE_WRITE 0x2
+#define BUS_PAGE_RW    (BUS_PAGE_READ | BUS_PAGE_WRITE)
+
+/**
+ * @brief Memory-mapped I/O side effect handler
+ *
+ * @param obj component which registered the handler
+ * @param address accessed address
+ * @param data value written (0 for reads): it may not be on the bus,
+ *        writes to read-only pages being lost
+ * @return error code
+ */
+typedef int (*bus_handler_t)(void* obj, addr_t address, data_t data);
+
+/**
+ * @brief Side effects of a CPU access at some address:
+ *        on_read runs before the data is read, on_write after it has been written
+ */
+typedef struct {
+    bus_handler_t on_read;
+    bus_handler_t on_write;
+    void* obj;
+} bus_mmio_t;
+
+/**
+ * @brief Bus page descriptor.
+ *        A page entirely plugged onto one contiguous memory only has a base pointer;
+ *        a page shared by several components (or registers) has one pointer per address.
+ *        Likewise, I/O handlers are either shared by the whole page or given per address.
+ */
+typedef struct {
+    data_t* base;      // memory of the whole page, NULL if the page is split (or empty)
+    data_t** slots;    // BUS_PAGE_SIZE pointers, only for split pages
+    bus_mmio_t* mmio;  // I/O handlers: one for the whole page, or BUS_PAGE_SIZE if mmio_split
+    bool mmio_split;
+    uint8_t flags;     // BUS_PAGE_READ | BUS_PAGE_WRITE
+} bus_page_t;
+
+/**
+ * @ brief Bus Type, a table of page descriptors pointing to the various component memories
+ */
+typedef bus_page_t bus_t[BUS_NB_PAGES];
+
+/**
+ * @brief Gets the memory plugged at a given address (no access check)
+ *
+ * @param bus bus to look into
+ * @param address address to look at
+ * @return pointer to the data, NULL if nothing is plugged there
+ */
+static inline data_t* bus_at(const bus_t bus, addr_t address)
+{
+    const bus_page_t* page = &bus[address >> BUS_PAGE_BITS];
+    const addr_t offset = address & (BUS_PAGE_SIZE - 1);
+
+    if (page->base != NULL)
+        return page->base + offset;
+
+    return page->slots != NULL ? page->slots[offset] : NULL;
+}
+
+/**
+ * @brief Gets the I/O handlers registered at a given address
+ *
+ * @param bus bus to look into
+ * @param address address to look at
+ * @return handlers, NULL if none
+ */
+static inline const bus_mmio_t* bus_mmio_at(const bus_t bus, addr_t address)
+{
+    const bus_page_t* page = &bus[address >> BUS_PAGE_BITS];
+
+    if (page->mmio == NULL)
+        return NULL;
+
+    return page->mmio_split ? &page->mmio[address & (BUS_PAGE_SIZE - 1)] : page->mmio;
+}
+
+/**
+ * @brief Runs the read side effect (if any) of a CPU access
+ *
+ * @param bus bus accessed
+ * @param address address read
+ * @return error code
+ */
+static inline int bus_notify_read(const bus_t bus, addr_t address)
+{
+    const bus_mmio_t* mmio = bus_mmio_at(bus, address);
+    return (mmio != NULL && mmio->on_read != NULL) ? mmio->on_read(mmio->obj, address, 0) : ERR_NONE;
+}
 
 /**
- * @ brief Bus Type, a table of memory pointer pointing to the various component memories
+ * @brief Runs the write side effect (if any) of a CPU access
+ *
+ * @param bus bus accessed
+ * @param address address written
+ * @param data value written
+ * @return error code
  */
-typedef data_t* bus_t[BUS_SIZE];
+static inline int bus_notify_write(const bus_t bus, addr_t address, data_t data)
+{
+    const bus_mmio_t* mmio = bus_mmio_at(bus, address);
+    return (mmio != NULL && mmio->on_write != NULL) ? mmio->on_write(mmio->obj, address, data) : ERR_NONE;
+}
 
 /**
  * @brief Plug a component into the bus
@@ -54,6 +160,7 @@ int bus_forced_plug(bus_t bus, component_t* c, addr_t start, addr_t end, addr_t
 
 /**
  * @brief Remap the memory of a component to the bus
+ *        (read-only if its memory is, see memory_t: writes there are lost)
  *
  * @param bus bus to remap to
  * @param c component to remap
@@ -73,6 +180,59 @@ int bus_remap(bus_t bus, component_t* c, addr_t offset);
 int bus_unplug(bus_t bus, component_t* c);
 
 
+/**
+ * @brief Plug a single byte (e.g. a register) into the bus, replacing whatever was there
+ *
+ * @param bus bus to plug into
+ * @param address address to plug at
+ * @param reg byte to plug (NULL to unplug)
+ * @return error code
+ */
+int bus_plug_register(bus_t bus, addr_t address, data_t* reg);
+
+
+/**
+ * @brief Registers the I/O side effects of an area: they run on CPU accesses only
+ *        (see bus_notify_read() and bus_notify_write()), not on the raw bus ones
+ *
+ * @param bus bus to register onto
+ * @param start address from where to register (included)
+ * @param end address until where to register (included)
+ * @param on_read handler to call before a read (may be NULL)
+ * @param on_write handler to call after a write (may be NULL)
+ * @param obj first argument of the handlers
+ * @return error code
+ */
+int bus_set_mmio(bus_t bus, addr_t start, addr_t end, bus_handler_t on_read, bus_handler_t on_write, void* obj);
+
+
+/**
+ * @brief Sets the access flags of the pages of an area
+ *        (e.g. to disable cartridge RAM: accesses there are then ignored)
+ *
+ * @param bus bus to modify
+ * @param start first address of the area, must start a page
+ * @param end last address of the area (included), must end a page
+ * @param flags combination of BUS_PAGE_READ and BUS_PAGE_WRITE
+ * @return error code
+ */
+int bus_set_access(bus_t bus, addr_t start, addr_t end, uint8_t flags);
+
+
+/**
+ * @brief Points whole pages to another memory, keeping their access flags
+ *        and I/O handlers (e.g. to switch memory banks): only one pointer
+ *        per page is changed
+ *
+ * @param bus bus to modify
+ * @param start first address of the area, must start a page
+ * @param end last address of the area (included), must end a page
+ * @param mem memory to map at start, at least end - start + 1 bytes
+ * @return error code
+ */
+int bus_map_pages(bus_t bus, addr_t start, addr_t end, data_t* mem);
+
+
 /**
  * @brief Read the bus at a given address
  *
@@ -95,7 +255,23 @@ int bus_read(const bus_t bus, addr_t address, data_t* data);
 int bus_write(bus_t bus, addr_t address, data_t data);
 
 /**
- * @brief Read the bus at a given address (reads 16 bits)
+ * @brief Copies n bytes from src to dst on the bus, as a DMA does (no I/O
+ *        handler is triggered, each byte is read and written as bus_read()
+ *        and bus_write() do): a single memcpy() when both areas are
+ *        contiguous memory within a page, byte by byte otherwise
+ *
+ * @param bus bus to copy on
+ * @param dst first address to write to
+ * @param src first address to read from
+ * @param n number of bytes (up to BUS_PAGE_SIZE)
+ * @return error code
+ */
+int bus_copy(bus_t bus, addr_t dst, addr_t src, size_t n);
+
+/**
+ * @brief Read the bus at a given address (reads 16 bits, little-endian:
+ *        address then address + 1, which wraps around to 0x0000).
+ *        Each byte reads as bus_read() would read it.
  *
  * @param bus bus to read from
  * @param address address to read at
@@ -105,7 +281,8 @@ int bus_write(bus_t bus, addr_t address, data_t data);
 int bus_read16(const bus_t bus, addr_t address, addr_t* data16);
 
 /**
- * @brief Write to the bus at a given address (writes 16 bits)
+ * @brief Write to the bus at a given address (writes 16 bits, little-endian:
+ *        address then address + 1). Each byte is written as bus_write() would.
  *
  * @param bus bus to write to
  * @param address address to write at
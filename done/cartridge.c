@@ -1,44 +1,204 @@
 /**
- * @file bootrom.c
- * @brief Game Boy Boortom simulation 
+ * @file cartridge.c
+ * @brief Game Boy Cartridge simulation
  *
  * @author C la vie
  * @date 2020
  */
 
 #include "cartridge.h"
+#include "rom-cache.h"
 #include "error.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-int cartridge_init_from_file(component_t *c, const char *filename)
+#define MBC_NO_CONTROLLER -1
+
+// header RAM size code -> number of BANK_RAM_SIZE banks (2 KiB carts get a whole bank)
+static const uint8_t ram_banks_of_code[] = {0, 1, 1, 4, 16, 8};
+#define NB_RAM_SIZE_CODES (sizeof(ram_banks_of_code) / sizeof(ram_banks_of_code[0]))
+#define MAX_ROM_SIZE_CODE 8 // 8 MiB
+
+// bank controller register areas (writes to the ROM)
+#define MBC_RAM_ENABLE_END    0x1FFF
+#define MBC_ROM_BANK_END      0x3FFF
+#define MBC5_ROM_BANK_LOW_END 0x2FFF
+#define MBC_RAM_BANK_END      0x5FFF
+#define MBC_RAM_ENABLE_VALUE  0x0A
+
+/**
+ * @brief Bank controller of a cartridge type, MBC_NO_CONTROLLER if not supported
+ */
+static int cartridge_mbc_of(data_t type)
 {
-	M_REQUIRE_NON_NULL(c);
-	M_REQUIRE_NON_NULL(c->mem);
+	switch (type) {
+	case 0x00:
+		return MBC_NONE;
+	case 0x01: case 0x02: case 0x03:
+		return MBC1;
+	case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+		return MBC3;
+	case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+		return MBC5;
+	default:
+		return MBC_NO_CONTROLLER;
+	}
+}
 
-	FILE *fp = fopen(filename, "rb");
-	if (fp == NULL)
+/**
+ * @brief Whether the RAM of a cartridge type is kept by a battery
+ */
+static bool cartridge_has_battery(data_t type)
+{
+	switch (type) {
+	case 0x03: case 0x0F: case 0x10: case 0x13: case 0x1B: case 0x1E:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Maps the save file of a ROM (same name, CARTRIDGE_SAVE_EXT extension)
+ *        as the cartridge RAM, creating it if needed. The file stays locked
+ *        while mapped: the other cartridges of the same game get a private
+ *        copy of it, which is not saved.
+ */
+static int cartridge_save_open(cartridge_t *ct, const char *filename, size_t size)
+{
+	const char *slash = strrchr(filename, '/');
+	const char *dot = strrchr(slash == NULL ? filename : slash, '.');
+	const size_t len = dot == NULL ? strlen(filename) : (size_t)(dot - filename);
+
+	char *path = malloc(len + sizeof(CARTRIDGE_SAVE_EXT));
+	M_EXIT_IF_NULL(path, len + sizeof(CARTRIDGE_SAVE_EXT));
+	memcpy(path, filename, len);
+	strcpy(path + len, CARTRIDGE_SAVE_EXT);
+
+	const int fd = open(path, O_RDWR | O_CREAT, 0644);
+	free(path);
+	if (fd < 0)
 		return ERR_IO;
 
-	size_t size_read = fread(c->mem->memory, sizeof(data_t), BANK_ROM_SIZE, fp);
-	if (size_read != BANK_ROM_SIZE)
-	{
-		fclose(fp);
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+		// already played: a shared mapping would share the RAM of both
+		const int err = component_create(&ct->ram, size);
+		if (err == ERR_NONE && pread(fd, ct->ram.mem->memory, size, 0) < 0)
+			memset(ct->ram.mem->memory, 0, size);
+		close(fd);
+		return err;
+	}
+
+	struct stat st;
+	data_t *data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (st.st_size >= (off_t)size || ftruncate(fd, (off_t)size) == 0))
+		data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
 		return ERR_IO;
 	}
-	else
-	{
-		for (size_t i = 0; i < BANK_ROM_SIZE; ++i)
-		{
-		}
-		if (c->mem->memory[CARTRIDGE_TYPE_ADDR] != 0u)
-		{
-			fclose(fp);
-			return ERR_NOT_IMPLEMENTED;
-		}
+
+	ct->ram.mem = calloc(1, sizeof(memory_t));
+	if (ct->ram.mem == NULL) {
+		munmap(data, size);
+		close(fd);
+		return ERR_MEM;
 	}
+	ct->ram.mem->memory = data;
+	ct->ram.mem->size = size;
+	ct->save_fd = fd;
+	ct->battery = 1;
 
+	return ERR_NONE;
+}
+
+/**
+ * @brief Reads a ROM file into a caller-allocated memory
+ */
+static int cartridge_read_file(memory_t *mem, const char *filename)
+{
+	M_REQUIRE(mem->size >= BANK_ROM_SIZE, ERR_BAD_PARAMETER, "memory of the component is too small (%zu bytes)", mem->size);
+
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return ERR_IO;
+
+	const size_t size_read = fread(mem->memory, sizeof(data_t), mem->size, fp);
 	fclose(fp);
 
+	return size_read < BANK_ROM_SIZE ? ERR_IO : ERR_NONE;
+}
+
+int cartridge_init_from_file(component_t *c, const char *filename)
+{
+	M_REQUIRE_NON_NULL(c);
+	M_REQUIRE_NON_NULL(c->mem);
+	M_REQUIRE_NON_NULL(filename);
+
+	if (c->mem->memory != NULL) {
+		M_EXIT_IF_ERR(cartridge_read_file(c->mem, filename));
+	} else {
+		// read-only: the bus maps it without write access
+		M_EXIT_IF_ERR(rom_cache_acquire(filename, c->mem));
+		if (c->mem->size < BANK_ROM_SIZE) {
+			rom_cache_release(c->mem);
+			return ERR_IO;
+		}
+	}
+
+	if (cartridge_mbc_of(c->mem->memory[CARTRIDGE_TYPE_ADDR]) == MBC_NO_CONTROLLER)
+		return ERR_NOT_IMPLEMENTED;
+
+	return ERR_NONE;
+}
+
+/**
+ * @brief Maps the ROM, sizes the cartridge from its header and creates its RAM
+ */
+static int cartridge_load(cartridge_t *ct, const char *filename)
+{
+	ct->c.mem = calloc(1, sizeof(memory_t));
+	M_EXIT_IF_NULL(ct->c.mem, sizeof(memory_t));
+	M_EXIT_IF_ERR(cartridge_init_from_file(&ct->c, filename));
+
+	const data_t *header = ct->c.mem->memory;
+	const data_t rom_code = header[CARTRIDGE_ROM_SIZE_ADDR];
+	const data_t ram_code = header[CARTRIDGE_RAM_SIZE_ADDR];
+	ct->mbc = (uint8_t)cartridge_mbc_of(header[CARTRIDGE_TYPE_ADDR]);
+
+	// the bus only sees the banks the header declares
+	size_t rom_size = BANK_ROM_SIZE;
+	if (ct->mbc != MBC_NONE) {
+		M_REQUIRE(rom_code <= MAX_ROM_SIZE_CODE, ERR_NOT_IMPLEMENTED, "unknown ROM size code %" PRIX8, rom_code);
+		M_REQUIRE(ram_code < NB_RAM_SIZE_CODES, ERR_NOT_IMPLEMENTED, "unknown RAM size code %" PRIX8, ram_code);
+		rom_size = (size_t)BANK_ROM_SIZE << rom_code;
+
+		// battery-backed RAM lives in the save file (plain memory if it cannot be opened)
+		ct->nb_ram_banks = ram_banks_of_code[ram_code];
+		const size_t ram_size = (size_t)ct->nb_ram_banks * BANK_RAM_SIZE;
+		if (ram_size > 0 && cartridge_has_battery(header[CARTRIDGE_TYPE_ADDR]))
+			cartridge_save_open(ct, filename, ram_size);
+		if (ram_size > 0 && ct->ram.mem == NULL)
+			M_EXIT_IF_ERR(component_create(&ct->ram, ram_size));
+	}
+	M_REQUIRE(rom_size <= ct->c.mem->size, ERR_IO, "ROM file is smaller than its %zu bytes header size", rom_size);
+
+	ct->nb_rom_banks = (uint16_t)(rom_size / BANK_ROM1_SIZE);
+	ct->ram_enabled = 0;
+	ct->ram_dirty = 0;
+	ct->mode = 0;
+	ct->rom_bank = 1;
+	ct->ram_bank = 0;
+	ct->rom0_bank = 0;
+	ct->bus = NULL;
+
 	return ERR_NONE;
 }
 
@@ -47,26 +207,182 @@ int cartridge_init(cartridge_t *ct, const char *filename)
 	M_REQUIRE_NON_NULL(ct);
 	M_REQUIRE_NON_NULL(filename);
 
-	M_EXIT_IF_ERR(component_create(&ct->c, BANK_ROM_SIZE));
-	if (cartridge_init_from_file(&ct->c, filename) != ERR_NONE) {
-		component_free(&ct->c);
-		return ERR_IO;
+	memset(ct, 0, sizeof(*ct));
+	const int err = cartridge_load(ct, filename);
+	if (err != ERR_NONE)
+		cartridge_free(ct);
+
+	return err;
+}
+
+/**
+ * @brief Points the ROM and RAM pages of the bus to the selected banks
+ *
+ *        Switching a bank only rewrites the page table entries of the
+ *        area: its cost does not depend on the size of the bank.
+ */
+static int cartridge_map_banks(cartridge_t *ct)
+{
+	uint16_t rom0 = 0;
+	uint16_t rom1 = ct->rom_bank;
+	uint8_t ram = ct->ram_bank;
+	bit_t ram_on = ct->ram_enabled;
+
+	switch (ct->mbc) {
+	case MBC1:
+		// the RAM bank register holds the upper ROM bits, in mode 1 it also
+		// selects the RAM bank and the bank seen at BANK_ROM0_START
+		rom1 = (uint16_t)(rom1 | (ct->ram_bank << 5));
+		if (ct->mode)
+			rom0 = (uint16_t)(ct->ram_bank << 5);
+		else
+			ram = 0;
+		break;
+
+	case MBC3:
+		// 0x08-0x0C select the real time clock, which is not emulated
+		if (ram > 3)
+			ram_on = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	rom0 = (uint16_t)(rom0 % ct->nb_rom_banks);
+	rom1 = (uint16_t)(rom1 % ct->nb_rom_banks);
+	data_t *const rom = ct->c.mem->memory;
+
+	// only remapped when it moves, not to hide the boot ROM
+	if (rom0 != ct->rom0_bank) {
+		M_EXIT_IF_ERR(bus_map_pages(ct->bus, BANK_ROM0_START, BANK_ROM0_END, rom + (size_t)rom0 * BANK_ROM0_SIZE));
+		ct->rom0_bank = rom0;
+	}
+	M_EXIT_IF_ERR(bus_map_pages(ct->bus, BANK_ROM1_START, BANK_ROM1_END, rom + (size_t)rom1 * BANK_ROM1_SIZE));
+
+	if (ct->ram.mem != NULL) {
+		data_t *const bank = ct->ram.mem->memory + (size_t)(ram % ct->nb_ram_banks) * BANK_RAM_SIZE;
+		M_EXIT_IF_ERR(bus_map_pages(ct->bus, BANK_RAM_START, BANK_RAM_END, bank));
+		M_EXIT_IF_ERR(bus_set_access(ct->bus, BANK_RAM_START, BANK_RAM_END, ram_on ? BUS_PAGE_RW : 0));
+	}
+
+	return ERR_NONE;
+}
+
+/**
+ * @brief Bank controller: CPU writes to the ROM set its registers
+ */
+static int cartridge_bank_write(void *obj, addr_t addr, data_t data)
+{
+	M_REQUIRE_NON_NULL(obj);
+	cartridge_t *const ct = obj;
+
+	if (addr <= MBC_RAM_ENABLE_END) {
+		ct->ram_enabled = (data & 0x0F) == MBC_RAM_ENABLE_VALUE;
+		// games enable the RAM to write to it: no need to watch the writes
+		ct->ram_dirty |= ct->ram_enabled;
+	} else if (addr <= MBC_ROM_BANK_END) {
+		switch (ct->mbc) {
+		case MBC1:
+			ct->rom_bank = data & 0x1F;
+			if (ct->rom_bank == 0)
+				ct->rom_bank = 1;
+			break;
+
+		case MBC3:
+			ct->rom_bank = data & 0x7F;
+			if (ct->rom_bank == 0)
+				ct->rom_bank = 1;
+			break;
+
+		case MBC5:
+			// 9 bits, bank 0 can be selected
+			if (addr <= MBC5_ROM_BANK_LOW_END)
+				ct->rom_bank = (uint16_t)((ct->rom_bank & 0x100) | data);
+			else
+				ct->rom_bank = (uint16_t)((ct->rom_bank & 0xFF) | ((data & 0x01) << 8));
+			break;
+
+		default:
+			break;
+		}
+	} else if (addr <= MBC_RAM_BANK_END) {
+		ct->ram_bank = ct->mbc == MBC1 ? (data & 0x03) : ct->mbc == MBC5 ? (data & 0x0F) : data;
+	} else if (ct->mbc == MBC1) {
+		ct->mode = data & 0x01;
 	} else {
+		// MBC3 clock latch
 		return ERR_NONE;
 	}
+
+	return cartridge_map_banks(ct);
 }
 
 int cartridge_plug(cartridge_t *ct, bus_t bus)
 {
 	M_REQUIRE_NON_NULL(ct);
 	M_REQUIRE_NON_NULL(ct->c.mem);
+	M_REQUIRE_NON_NULL(bus);
+
+	M_EXIT_IF_ERR(bus_forced_plug(bus, &ct->c, BANK_ROM0_START, BANK_ROM1_END, 0));
+	M_EXIT_IF_ERR(bus_set_access(bus, BANK_ROM0_START, BANK_ROM1_END, BUS_PAGE_READ));
+	ct->bus = bus;
+	ct->rom0_bank = 0;
 
-	return bus_forced_plug(bus, &ct->c, BANK_ROM0_START, BANK_ROM1_END, 0);
+	if (ct->mbc == MBC_NONE)
+		return ERR_NONE;
+
+	if (ct->ram.mem != NULL)
+		M_EXIT_IF_ERR(bus_forced_plug(bus, &ct->ram, BANK_RAM_START, BANK_RAM_END, 0));
+	M_EXIT_IF_ERR(bus_set_mmio(bus, BANK_ROM0_START, BANK_ROM1_END, NULL, cartridge_bank_write, ct));
+
+	return cartridge_map_banks(ct);
+}
+
+int cartridge_save_sync(cartridge_t *ct)
+{
+	M_REQUIRE_NON_NULL(ct);
+
+	if (!ct->battery || !ct->ram_dirty)
+		return ERR_NONE;
+
+	if (msync(ct->ram.mem->memory, ct->ram.mem->size, MS_ASYNC) != 0)
+		return ERR_IO;
+	// still enabled: it may still be written
+	ct->ram_dirty = ct->ram_enabled;
+
+	return ERR_NONE;
+}
+
+int cartridge_unplug(cartridge_t *ct, bus_t bus)
+{
+	M_REQUIRE_NON_NULL(ct);
+	M_REQUIRE_NON_NULL(bus);
+
+	if (ct->mbc != MBC_NONE)
+		M_EXIT_IF_ERR(bus_set_mmio(bus, BANK_ROM0_START, BANK_ROM1_END, NULL, NULL, NULL));
+	if (ct->ram.mem != NULL)
+		M_EXIT_IF_ERR(bus_unplug(bus, &ct->ram));
+	M_EXIT_IF_ERR(bus_unplug(bus, &ct->c));
+	ct->bus = NULL;
+
+	return ERR_NONE;
 }
 
 void cartridge_free(cartridge_t *ct)
 {
 	if (ct != NULL) {
+		// mapped by cartridge_init_from_file()
+		rom_cache_release(ct->c.mem);
 		component_free(&ct->c);
+		if (ct->battery) {
+			// the kernel writes the shared mapping back to the file
+			munmap(ct->ram.mem->memory, ct->ram.mem->size);
+			free(ct->ram.mem);
+			ct->ram.mem = NULL;
+			close(ct->save_fd);
+			ct->battery = 0;
+		}
+		component_free(&ct->ram);
 	}
 }
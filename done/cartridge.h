@@ -12,6 +12,7 @@
 
 #include "component.h"
 #include "bus.h"
+#include "bit.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,23 +28,63 @@ extern "C" {
 
 #define BANK_ROM_SIZE    (BANK_ROM0_SIZE + BANK_ROM1_SIZE)
 
+#define BANK_RAM_START   0xA000
+#define BANK_RAM_END     0xBFFF
+#define BANK_RAM_SIZE    ((BANK_RAM_END - BANK_RAM_START) + 1)
+
+#define CARTRIDGE_LOGO_START       0x0104
+#define CARTRIDGE_LOGO_END         0x0133
 #define CARTRIDGE_GAME_TITLE_START 0x0134
 #define CARTRIDGE_GAME_TITLE_END   0x0143
 #define CARTRIDGE_TYPE_ADDR        0x0147
+#define CARTRIDGE_ROM_SIZE_ADDR    0x0148
+#define CARTRIDGE_RAM_SIZE_ADDR    0x0149
+
+// battery-backed RAM is kept in this file, next to the ROM
+#define CARTRIDGE_SAVE_EXT ".sav"
+
+/**
+ * @brief Memory bank controllers
+ */
+typedef enum {
+    MBC_NONE, // 32 KiB ROM only
+    MBC1,
+    MBC3,     // without its real time clock
+    MBC5
+} cartridge_mbc_t;
 
 /**
  * @brief Cartridge type
  */
 typedef struct {
-    component_t c;
+    component_t c;          // ROM, all banks (read-only mapping of the file)
+    component_t ram;        // external RAM, all banks (ram.mem is NULL if there is none)
+    bit_t battery;          // ram is a shared mapping of the save file
+    int save_fd;            // save file, locked while battery
+    bit_t ram_dirty;        // ram may have been written since the last save sync
+    uint8_t mbc;            // cartridge_mbc_t
+    uint16_t nb_rom_banks;  // of BANK_ROM1_SIZE bytes
+    uint8_t nb_ram_banks;   // of BANK_RAM_SIZE bytes
+    // bank controller registers
+    bit_t ram_enabled;
+    bit_t mode;             // MBC1 banking mode
+    uint16_t rom_bank;      // ROM bank number (MBC1: its 5 lower bits)
+    uint8_t ram_bank;       // RAM bank number (MBC1: also the upper ROM bits)
+    uint16_t rom0_bank;     // ROM bank currently mapped at BANK_ROM0_START
+    bus_page_t* bus;        // bus the banks are switched on, NULL if not plugged
 } cartridge_t;
 
 /**
- * @brief Reads a file into the memory of a component
+ * @brief Reads a ROM file into the memory of a component if it is allocated
+ *        (at least BANK_ROM_SIZE bytes). Otherwise (memory NULL), maps it
+ *        read-only, shared with the other cartridges of the same game
+ *        (see rom-cache.h): the memory is then marked read_only and is
+ *        given back by cartridge_free().
  *
- * @param c component to write to
- * @param filename file to read from
- * @return error code
+ * @param c component whose memory to fill or set
+ * @param filename file to read
+ * @return error code: ERR_IO if the file cannot be read or is smaller than
+ *         BANK_ROM_SIZE, ERR_NOT_IMPLEMENTED if its bank controller is not supported
  */
 int cartridge_init_from_file(component_t* c, const char* filename);
 
@@ -59,7 +100,8 @@ int cartridge_init(cartridge_t* ct, const char* filename);
 
 
 /**
- * @brief Plugs a cartridge to the bus
+ * @brief Plugs a cartridge to the bus: its ROM, its RAM if any, and its
+ *        bank controller, which then switches banks on CPU writes to the ROM
  *
  * @param ct cartridge to plug
  * @param bus bus to plug into
@@ -68,6 +110,26 @@ int cartridge_init(cartridge_t* ct, const char* filename);
 int cartridge_plug(cartridge_t* ct, bus_t bus);
 
 
+/**
+ * @brief Schedules the write back of the battery-backed RAM to the save
+ *        file, if it was enabled since the last call (does not wait for it)
+ *
+ * @param ct cartridge to save
+ * @return error code
+ */
+int cartridge_save_sync(cartridge_t* ct);
+
+
+/**
+ * @brief Unplugs a cartridge from the bus
+ *
+ * @param ct cartridge to unplug
+ * @param bus bus to unplug from
+ * @return error code
+ */
+int cartridge_unplug(cartridge_t* ct, bus_t bus);
+
+
 /**
  * @brief Frees a cartridge
  *
@@ -11,9 +11,7 @@
 #include "cpu-alu.h"
 #include "cpu-storage.h"   // cpu_read_at_HL
 #include "cpu-registers.h" // cpu_HL_get
-
-// external library provided later to lower workload
-extern int cpu_dispatch_alu_ext(const instruction_t *lu, cpu_t *cpu);
+#include "cpu-exec.h"      // cpu_exec_alu
 
 #include <assert.h>
 #include <stdbool.h>
@@ -89,157 +87,10 @@ int cpu_combine_alu_flags(cpu_t *cpu,
     return ERR_NONE;
 }
 
-// ======================================================================
-/**
-* @brief Tool function usefull for CHG_U3_R8:
-*        Do a SET or a RESET(=unset) of data bit,
-*          according to SR and N3 bits of instruction's opcode
-*/
-static void do_set_or_res(const instruction_t *lu, data_t *data)
-{
-    assert(lu != NULL);
-    assert(data != NULL);
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wconversion"
-
-    if (extract_sr_bit(lu->opcode))
-    {
-        *data |= (data_t)(1 << extract_n3(lu->opcode));
-    }
-    else
-    {
-        *data &= ~((data_t)(1 << extract_n3(lu->opcode)));
-    }
-
-#pragma GCC diagnostic pop
-}
-
 // ==== see cpu-alu.h ========================================
 int cpu_dispatch_alu(const instruction_t *lu, cpu_t *cpu)
 {
     M_REQUIRE_NON_NULL(cpu);
 
-    switch (lu->family)
-    {
-
-    // ADD
-    case ADD_A_HLR:
-        do_cpu_arithm(cpu, alu_add8, cpu_read_at_HL(cpu), ADD_FLAGS_SRC);
-        break;
-
-    case ADD_A_N8:
-        do_cpu_arithm(cpu, alu_add8, cpu_read_data_after_opcode(cpu), ADD_FLAGS_SRC);
-        break;
-
-    case ADD_A_R8:
-        do_cpu_arithm(cpu, alu_add8, cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), ADD_FLAGS_SRC);
-        break;
-
-    case INC_HLR:
-    {
-        M_EXIT_IF_ERR(alu_add8(&cpu->alu, cpu_read_at_HL(cpu), 1u, 0u));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, INC_FLAGS_SRC));
-        M_EXIT_IF_ERR(cpu_write_at_HL(cpu, lsb8(cpu->alu.value)));
-    }
-    break;
-
-    case INC_R8:
-    {
-        uint8_t reg = extract_reg(lu->opcode, 3);
-        M_EXIT_IF_ERR(alu_add8(&cpu->alu, cpu_reg_get(cpu, reg), 1u, 0u));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, INC_FLAGS_SRC));
-        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
-    }
-    break;
-
-    case DEC_R8:
-    {
-        uint8_t reg = extract_reg(lu->opcode, 3);
-        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, reg), 1u, 0u));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, DEC_FLAGS_SRC));
-        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
-    }
-    break;
-
-    case ADD_HL_R16SP:
-    {
-        uint16_t reg_pair_value = extract_reg_pair(lu->opcode);
-        M_EXIT_IF_ERR(alu_add16_high(&cpu->alu, cpu_HL_get(cpu), cpu_reg_pair_SP_get(cpu, reg_pair_value)));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, CPU, CLEAR, ALU, ALU));
-        cpu_HL_set(cpu, cpu->alu.value);
-    }
-    break;
-
-    case INC_R16SP:
-    {
-        uint16_t reg_pair_value = extract_reg_pair(lu->opcode);
-        M_EXIT_IF_ERR(alu_add16_high(&cpu->alu, cpu_reg_pair_SP_get(cpu, reg_pair_value), 1u));
-        cpu_reg_pair_SP_set(cpu, reg_pair_value, cpu->alu.value);
-    }
-    break;
-
-    // COMPARISONS
-    case CP_A_R8:
-    {
-        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, REG_A_CODE), cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), 0));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SUB_FLAGS_SRC));
-    }
-    break;
-
-    case CP_A_N8:
-    {
-        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, REG_A_CODE), cpu_read_data_after_opcode(cpu), 0));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SUB_FLAGS_SRC));
-    }
-    break;
-
-    // BIT MOVE (rotate, shift)
-    case SLA_R8:
-    {
-        uint8_t reg = extract_reg(lu->opcode, 0);
-        M_EXIT_IF_ERR(alu_shift(&cpu->alu, cpu_reg_get(cpu, reg), LEFT));
-        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SHIFT_FLAGS_SRC));
-    }
-    break;
-
-    case ROT_R8:
-    {
-        rot_dir_t dir = extract_rot_dir(lu->opcode);
-        uint8_t reg = extract_reg(lu->opcode, 0);
-        M_EXIT_IF_ERR(alu_carry_rotate(&cpu->alu, cpu_reg_get(cpu, reg), dir, cpu->F));
-        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SHIFT_FLAGS_SRC));
-    }
-    break;
-
-    // BIT TESTS (and set)
-    case BIT_U3_R8:
-    {
-        bit_t bit = bit_get(cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), extract_n3(lu->opcode));
-        if (bit == 0u)
-            set_flag(&cpu->alu.flags, FLAG_Z);
-        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, ALU, CLEAR, SET, CPU));
-    }
-    break;
-
-    case CHG_U3_R8:
-    {
-        uint8_t reg = extract_reg(lu->opcode, 0);
-        data_t data = cpu_reg_get(cpu, reg);
-        do_set_or_res(lu, &data);
-        cpu_reg_set(cpu, reg, data);
-    }
-    break;
-
-    // ---------------------------------------------------------
-    // All the others are handled elsewhere by provided library
-    default:
-        // uncomment this line if you have the cs212gbcpuext library
-        M_EXIT_IF_ERR(cpu_dispatch_alu_ext(lu, cpu));
-        break;
-    } // switch
-
-    return ERR_NONE;
+    return cpu_exec_alu(lu, cpu);
 }
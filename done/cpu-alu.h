@@ -68,7 +68,7 @@ typedef enum {
 
 #define OPCODE_CARRY_IDX 3
 #define extract_carry(cpu, op) \
-    (bit_get(op, OPCODE_CARRY_IDX) && get_C((cpu)->F))
+    (bit_get(op, OPCODE_CARRY_IDX) && get_C(cpu_F_get(cpu)))
 
 #define do_cpu_arithm(cpu, op, arg, flags_src)  \
     do { \
@@ -100,6 +100,94 @@ int cpu_dispatch_alu(const instruction_t* lu, cpu_t* cpu);
 int cpu_combine_alu_flags(cpu_t* cpu,
                           flag_src_t Z, flag_src_t N, flag_src_t H, flag_src_t C);
 
+
+// ======================================================================
+// Lazy flags (built with -DCPU_LAZY_FLAGS, see Makefile)
+//
+// Les instructions les plus fréquentes (ADD/ADC A, INC, DEC, CP) ne
+// calculent pas F : elles notent l'opération et ses opérandes dans
+// cpu->lazy. F n'est calculé que lorsqu'on le lit (saut conditionnel,
+// PUSH AF, ADC/SBC, DAA et toute instruction de la bibliothèque externe).
+
+/**
+ * @brief Kinds of pending operations
+ */
+typedef enum {
+    LAZY_NONE, // F is up to date
+    LAZY_ADD8, // x + y + c, flags as ADD_FLAGS_SRC
+    LAZY_SUB8, // x - y - c, flags as SUB_FLAGS_SRC
+    LAZY_INC8, // x + 1, flags as INC_FLAGS_SRC (c is the kept carry)
+    LAZY_DEC8  // x - 1, flags as DEC_FLAGS_SRC (c is the kept carry)
+} cpu_lazy_op_t;
+
+/**
+ * @brief Computes the flags left by a pending operation
+ *
+ * @param lazy pending operation
+ * @param f flags to return if nothing is pending
+ *
+ * @return resulting flags
+ */
+static inline flags_t cpu_lazy_eval(const cpu_lazy_flags_t* lazy, flags_t f)
+{
+    unsigned x = lazy->x, y = lazy->y, c = lazy->c, r = 0, h = 0, carry = 0;
+
+    switch (lazy->kind) {
+    case LAZY_ADD8:
+        r = x + y + c;
+        h = (x & 0xFu) + (y & 0xFu) + c > 0xFu;
+        carry = r > 0xFFu;
+        break;
+
+    case LAZY_SUB8:
+        r = x - y - c;
+        h = (x & 0xFu) < (y & 0xFu) + c;
+        carry = x < y + c;
+        break;
+
+    case LAZY_INC8:
+        r = x + 1u;
+        h = (x & 0xFu) == 0xFu;
+        carry = c;
+        break;
+
+    case LAZY_DEC8:
+        r = x - 1u;
+        h = (x & 0xFu) == 0u;
+        carry = c;
+        break;
+
+    default:
+        return f;
+    }
+
+    return (flags_t)(((r & 0xFFu) == 0u ? FLAG_Z : 0u)
+                     | (lazy->kind == LAZY_SUB8 || lazy->kind == LAZY_DEC8 ? FLAG_N : 0u)
+                     | (h ? FLAG_H : 0u)
+                     | (carry ? FLAG_C : 0u));
+}
+
+/**
+ * @brief Writes the flags of the pending operation (if any) to F
+ */
+static inline void cpu_flags_sync(cpu_t* cpu)
+{
+    cpu->F = cpu_lazy_eval(&cpu->lazy, cpu->F);
+    cpu->lazy.kind = LAZY_NONE;
+}
+
+/**
+ * @brief Gets F, computing it first if needed
+ */
+static inline flags_t cpu_F_get(cpu_t* cpu)
+{
+#ifdef CPU_LAZY_FLAGS
+    if (cpu->lazy.kind != LAZY_NONE)
+        cpu_flags_sync(cpu);
+#endif
+    return cpu->F;
+}
+
 #ifdef __cplusplus
 }
 #endif
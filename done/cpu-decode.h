@@ -0,0 +1,49 @@
+#pragma once
+
+/**
+ * @file cpu-decode.h
+ * @brief Pre-decoded instructions, shared by the decoding cache (cpu.c)
+ *        and the block translator (cpu-jit.c)
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cpu.h"
+
+typedef struct cpu_decoded cpu_decoded_t;
+
+/**
+ * @brief Runs one family of pre-decoded instructions
+ */
+typedef int (*cpu_handler_t)(const cpu_decoded_t *d, cpu_t *cpu);
+
+struct cpu_decoded
+{
+    cpu_handler_t run;
+    instruction_t lu;
+    addr_t imm;  // immediate following the opcode (control flow only)
+    uint8_t arg; // condition code, RST vector or IME value
+};
+
+// longest instruction, in bytes
+#define CPU_INSTR_MAX_BYTES 3
+
+/**
+ * @brief Decodes an instruction
+ *        (d->run does not advance PC nor counts the instruction cycles,
+ *        it only adds the extra cycles of a taken branch to idle_time)
+ * @param lu instruction
+ * @param bytes, the lu->bytes bytes of the instruction
+ * @param d (output), the decoded instruction
+ * @return error code
+ */
+int cpu_decode(const instruction_t *lu, const data_t *bytes, cpu_decoded_t *d);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,522 @@
+#pragma once
+
+/**
+ * @file cpu-exec.h
+ * @brief Game Boy CPU simulation, ALU and storage instructions semantics
+ *
+ * Shared by the family dispatchers (cpu_dispatch_alu(), cpu_dispatch_storage())
+ * and by the threaded interpreter, which calls them with a constant
+ * instruction so that the compiler specializes them for each opcode.
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <assert.h>
+#include <inttypes.h> // PRIX8
+#include <stdio.h>    // fprintf
+
+#include "error.h"
+#include "bit.h"
+#include "alu.h"
+#include "opcode.h"
+#include "cpu-alu.h"
+#include "cpu-storage.h"   // cpu_read_at_HL
+#include "cpu-registers.h" // cpu_HL_get
+#include "gameboy.h"       // REGISTERS_START
+
+// external library provided later to lower workload
+extern int cpu_dispatch_alu_ext(const instruction_t *lu, cpu_t *cpu);
+
+#define CPU_EXEC_INLINE static inline __attribute__((always_inline))
+
+// ======================================================================
+/**
+ * @brief Condition codes of conditional jumps, calls and returns
+ */
+typedef enum
+{
+    CC_NZ,
+    CC_Z,
+    CC_NC,
+    CC_C
+} cc_t;
+
+/**
+ * @brief Tells whether a condition code holds
+ * @param flags, flags of the cpu you want to compare to
+ * @param cc, the condition code (CC_NZ, CC_Z, CC_NC or CC_C)
+ * @return 1 if it holds, 0 otherwise
+ */
+CPU_EXEC_INLINE int cpu_cc_holds(flags_t flags, uint8_t cc)
+{
+    switch (cc)
+    {
+    case CC_NZ:
+        return !get_Z(flags);
+    case CC_Z:
+        return get_Z(flags);
+    case CC_NC:
+        return !get_C(flags);
+    case CC_C:
+        return get_C(flags);
+    default:
+        return ERR_BAD_PARAMETER;
+    }
+}
+
+// ======================================================================
+/**
+ * @brief Case labels of the instruction families run by cpu_exec_alu()
+ */
+#define CPU_CASE_ALU_FAMILIES \
+    case ADD_A_HLR: \
+    case ADD_A_N8: \
+    case ADD_A_R8: \
+    case INC_HLR: \
+    case INC_R8: \
+    case ADD_HL_R16SP: \
+    case INC_R16SP: \
+    case SUB_A_HLR: \
+    case SUB_A_N8: \
+    case SUB_A_R8: \
+    case DEC_HLR: \
+    case DEC_R8: \
+    case DEC_R16SP: \
+    case AND_A_HLR: \
+    case AND_A_N8: \
+    case AND_A_R8: \
+    case OR_A_HLR: \
+    case OR_A_N8: \
+    case OR_A_R8: \
+    case XOR_A_HLR: \
+    case XOR_A_N8: \
+    case XOR_A_R8: \
+    case CPL: \
+    case CP_A_HLR: \
+    case CP_A_N8: \
+    case CP_A_R8: \
+    case SLA_HLR: \
+    case SLA_R8: \
+    case SRA_HLR: \
+    case SRA_R8: \
+    case SRL_HLR: \
+    case SRL_R8: \
+    case ROTCA: \
+    case ROTA: \
+    case ROTC_HLR: \
+    case ROT_HLR: \
+    case ROTC_R8: \
+    case ROT_R8: \
+    case SWAP_HLR: \
+    case SWAP_R8: \
+    case BIT_U3_HLR: \
+    case BIT_U3_R8: \
+    case CHG_U3_HLR: \
+    case CHG_U3_R8: \
+    case LD_HLSP_S8: \
+    case DAA: \
+    case SCCF
+
+/**
+ * @brief Case labels of the instruction families run by cpu_exec_storage()
+ */
+#define CPU_CASE_STORAGE_FAMILIES \
+    case LD_A_BCR: \
+    case LD_A_CR: \
+    case LD_A_DER: \
+    case LD_A_HLRU: \
+    case LD_A_N16R: \
+    case LD_A_N8R: \
+    case LD_BCR_A: \
+    case LD_CR_A: \
+    case LD_DER_A: \
+    case LD_HLRU_A: \
+    case LD_HLR_N8: \
+    case LD_HLR_R8: \
+    case LD_N16R_A: \
+    case LD_N16R_SP: \
+    case LD_N8R_A: \
+    case LD_R16SP_N16: \
+    case LD_R8_HLR: \
+    case LD_R8_N8: \
+    case LD_R8_R8: \
+    case LD_SP_HL: \
+    case POP_R16: \
+    case PUSH_R16
+
+// ======================================================================
+/**
+* @brief Tool function usefull for CHG_U3_R8:
+*        Do a SET or a RESET(=unset) of data bit,
+*          according to SR and N3 bits of instruction's opcode
+*/
+static inline void do_set_or_res(const instruction_t *lu, data_t *data)
+{
+    assert(lu != NULL);
+    assert(data != NULL);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+
+    if (extract_sr_bit(lu->opcode))
+    {
+        *data |= (data_t)(1 << extract_n3(lu->opcode));
+    }
+    else
+    {
+        *data &= ~((data_t)(1 << extract_n3(lu->opcode)));
+    }
+
+#pragma GCC diagnostic pop
+}
+
+// ======================================================================
+/**
+ * @brief Records a pending 8-bit operation (lazy flags mode)
+ */
+CPU_EXEC_INLINE void cpu_lazy_record(cpu_t *cpu, cpu_lazy_op_t kind, uint8_t x, uint8_t y, bit_t c)
+{
+    cpu->lazy.kind = (uint8_t)kind;
+    cpu->lazy.x = x;
+    cpu->lazy.y = y;
+    cpu->lazy.c = c;
+}
+
+/**
+ * @brief Current value of the C flag, without writing F
+ */
+CPU_EXEC_INLINE bit_t cpu_lazy_carry(const cpu_t *cpu)
+{
+    return (cpu_lazy_eval(&cpu->lazy, cpu->F) & FLAG_C) ? 1u : 0u;
+}
+
+/**
+ * @brief Executes the ALU instructions whose flags are left pending
+ * @return 1 if lu was executed, 0 if it is left to cpu_exec_alu()
+ *         (in which case F is brought up to date first)
+ */
+CPU_EXEC_INLINE int cpu_exec_alu_lazy(const instruction_t *lu, cpu_t *cpu)
+{
+    data_t x = 0;
+    bit_t c = 0;
+
+    switch (lu->family)
+    {
+
+    case ADD_A_HLR:
+    case ADD_A_N8:
+    case ADD_A_R8:
+        x = lu->family == ADD_A_HLR ? cpu_read_at_HL(cpu)
+            : lu->family == ADD_A_N8 ? cpu_read_data_after_opcode(cpu)
+            : cpu_reg_get(cpu, extract_reg(lu->opcode, 0));
+        c = extract_carry(cpu, lu->opcode); // ADC: brings F up to date
+        cpu_lazy_record(cpu, LAZY_ADD8, cpu->A, x, c);
+        cpu->A = (data_t)(cpu->A + x + c);
+        return 1;
+
+    case INC_HLR:
+        x = cpu_read_at_HL(cpu);
+        cpu_lazy_record(cpu, LAZY_INC8, x, 1u, cpu_lazy_carry(cpu));
+        cpu_write_at_HL(cpu, (data_t)(x + 1u));
+        return 1;
+
+    case INC_R8:
+        x = cpu_reg_get(cpu, extract_reg(lu->opcode, 3));
+        cpu_lazy_record(cpu, LAZY_INC8, x, 1u, cpu_lazy_carry(cpu));
+        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), (data_t)(x + 1u));
+        return 1;
+
+    case DEC_R8:
+        x = cpu_reg_get(cpu, extract_reg(lu->opcode, 3));
+        cpu_lazy_record(cpu, LAZY_DEC8, x, 1u, cpu_lazy_carry(cpu));
+        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), (data_t)(x - 1u));
+        return 1;
+
+    case CP_A_R8:
+    case CP_A_N8:
+        x = lu->family == CP_A_N8 ? cpu_read_data_after_opcode(cpu)
+            : cpu_reg_get(cpu, extract_reg(lu->opcode, 0));
+        cpu_lazy_record(cpu, LAZY_SUB8, cpu->A, x, 0u);
+        return 1;
+
+    default:
+        // every other instruction may read F, the library ones included
+        cpu_flags_sync(cpu);
+        return 0;
+    } // switch
+}
+
+// ======================================================================
+/**
+ * @brief Executes an ALU instruction (see cpu_dispatch_alu())
+ */
+CPU_EXEC_INLINE int cpu_exec_alu(const instruction_t *lu, cpu_t *cpu)
+{
+#ifdef CPU_LAZY_FLAGS
+    if (cpu_exec_alu_lazy(lu, cpu))
+        return ERR_NONE;
+#endif
+
+    switch (lu->family)
+    {
+
+    // ADD
+    case ADD_A_HLR:
+        do_cpu_arithm(cpu, alu_add8, cpu_read_at_HL(cpu), ADD_FLAGS_SRC);
+        break;
+
+    case ADD_A_N8:
+        do_cpu_arithm(cpu, alu_add8, cpu_read_data_after_opcode(cpu), ADD_FLAGS_SRC);
+        break;
+
+    case ADD_A_R8:
+        do_cpu_arithm(cpu, alu_add8, cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), ADD_FLAGS_SRC);
+        break;
+
+    case INC_HLR:
+    {
+        M_EXIT_IF_ERR(alu_add8(&cpu->alu, cpu_read_at_HL(cpu), 1u, 0u));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, INC_FLAGS_SRC));
+        M_EXIT_IF_ERR(cpu_write_at_HL(cpu, lsb8(cpu->alu.value)));
+    }
+    break;
+
+    case INC_R8:
+    {
+        uint8_t reg = extract_reg(lu->opcode, 3);
+        M_EXIT_IF_ERR(alu_add8(&cpu->alu, cpu_reg_get(cpu, reg), 1u, 0u));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, INC_FLAGS_SRC));
+        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
+    }
+    break;
+
+    case DEC_R8:
+    {
+        uint8_t reg = extract_reg(lu->opcode, 3);
+        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, reg), 1u, 0u));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, DEC_FLAGS_SRC));
+        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
+    }
+    break;
+
+    case ADD_HL_R16SP:
+    {
+        uint16_t reg_pair_value = extract_reg_pair(lu->opcode);
+        M_EXIT_IF_ERR(alu_add16_high(&cpu->alu, cpu_HL_get(cpu), cpu_reg_pair_SP_get(cpu, reg_pair_value)));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, CPU, CLEAR, ALU, ALU));
+        cpu_HL_set(cpu, cpu->alu.value);
+    }
+    break;
+
+    case INC_R16SP:
+    {
+        uint16_t reg_pair_value = extract_reg_pair(lu->opcode);
+        M_EXIT_IF_ERR(alu_add16_high(&cpu->alu, cpu_reg_pair_SP_get(cpu, reg_pair_value), 1u));
+        cpu_reg_pair_SP_set(cpu, reg_pair_value, cpu->alu.value);
+    }
+    break;
+
+    // COMPARISONS
+    case CP_A_R8:
+    {
+        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, REG_A_CODE), cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), 0));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SUB_FLAGS_SRC));
+    }
+    break;
+
+    case CP_A_N8:
+    {
+        M_EXIT_IF_ERR(alu_sub8(&cpu->alu, cpu_reg_get(cpu, REG_A_CODE), cpu_read_data_after_opcode(cpu), 0));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SUB_FLAGS_SRC));
+    }
+    break;
+
+    // BIT MOVE (rotate, shift)
+    case SLA_R8:
+    {
+        uint8_t reg = extract_reg(lu->opcode, 0);
+        M_EXIT_IF_ERR(alu_shift(&cpu->alu, cpu_reg_get(cpu, reg), LEFT));
+        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SHIFT_FLAGS_SRC));
+    }
+    break;
+
+    case ROT_R8:
+    {
+        rot_dir_t dir = extract_rot_dir(lu->opcode);
+        uint8_t reg = extract_reg(lu->opcode, 0);
+        M_EXIT_IF_ERR(alu_carry_rotate(&cpu->alu, cpu_reg_get(cpu, reg), dir, cpu->F));
+        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, SHIFT_FLAGS_SRC));
+    }
+    break;
+
+    // SWAP, DAA (table-driven versions of the library ones)
+    case SWAP_HLR:
+    {
+        M_EXIT_IF_ERR(alu_swap4_fast(&cpu->alu, cpu_read_at_HL(cpu)));
+        M_EXIT_IF_ERR(cpu_write_at_HL(cpu, lsb8(cpu->alu.value)));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, ALL_ALU_FLAGS_SRC));
+    }
+    break;
+
+    case SWAP_R8:
+    {
+        uint8_t reg = extract_reg(lu->opcode, 0);
+        M_EXIT_IF_ERR(alu_swap4_fast(&cpu->alu, cpu_reg_get(cpu, reg)));
+        cpu_reg_set(cpu, reg, lsb8(cpu->alu.value));
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, ALL_ALU_FLAGS_SRC));
+    }
+    break;
+
+    case DAA:
+    {
+        cpu->alu.value = cpu->A;
+        cpu->alu.flags = cpu->F;
+        M_EXIT_IF_ERR(alu_bcd_adjust_fast(&cpu->alu));
+        combine_flags_set_A(cpu, DAA_FLAGS_SRC);
+    }
+    break;
+
+    // BIT TESTS (and set)
+    case BIT_U3_R8:
+    {
+        bit_t bit = bit_get(cpu_reg_get(cpu, extract_reg(lu->opcode, 0)), extract_n3(lu->opcode));
+        if (bit == 0u)
+            set_flag(&cpu->alu.flags, FLAG_Z);
+        M_EXIT_IF_ERR(cpu_combine_alu_flags(cpu, ALU, CLEAR, SET, CPU));
+    }
+    break;
+
+    case CHG_U3_R8:
+    {
+        uint8_t reg = extract_reg(lu->opcode, 0);
+        data_t data = cpu_reg_get(cpu, reg);
+        do_set_or_res(lu, &data);
+        cpu_reg_set(cpu, reg, data);
+    }
+    break;
+
+    // ---------------------------------------------------------
+    // All the others are handled elsewhere by provided library
+    default:
+        // uncomment this line if you have the cs212gbcpuext library
+        M_EXIT_IF_ERR(cpu_dispatch_alu_ext(lu, cpu));
+        break;
+    } // switch
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Executes a storage instruction (see cpu_dispatch_storage())
+ */
+CPU_EXEC_INLINE int cpu_exec_storage(const instruction_t *lu, cpu_t *cpu)
+{
+    switch (lu->family)
+    {
+
+    case LD_A_BCR:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_BC_get(cpu)));
+        break;
+
+    case LD_A_CR:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, REGISTERS_START + cpu_reg_get(cpu, REG_C_CODE)));
+        break;
+
+    case LD_A_DER:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_DE_get(cpu)));
+        break;
+
+    case LD_A_HLRU:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_HL(cpu));
+        cpu_HL_set(cpu, (addr_t)(cpu_HL_get(cpu) + extract_HL_increment(lu->opcode)));
+        break;
+
+    case LD_A_N16R:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_read_addr_after_opcode(cpu)));
+        break;
+
+    case LD_A_N8R:
+        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, REGISTERS_START + cpu_read_data_after_opcode(cpu)));
+        break;
+
+    case LD_BCR_A:
+        cpu_write_at_idx(cpu, cpu_BC_get(cpu), cpu_reg_get(cpu, REG_A_CODE));
+        break;
+
+    case LD_CR_A:
+        cpu_write_at_idx(cpu, REGISTERS_START + cpu_reg_get(cpu, REG_C_CODE), cpu_reg_get(cpu, REG_A_CODE));
+        break;
+
+    case LD_DER_A:
+        cpu_write_at_idx(cpu, cpu_DE_get(cpu), cpu_reg_get(cpu, REG_A_CODE));
+        break;
+
+    case LD_HLRU_A:
+        cpu_write_at_HL(cpu, cpu_reg_get(cpu, REG_A_CODE));
+        cpu_HL_set(cpu, (addr_t)(cpu_HL_get(cpu) + extract_HL_increment(lu->opcode)));
+        break;
+
+    case LD_HLR_N8:
+        cpu_write_at_HL(cpu, cpu_read_data_after_opcode(cpu));
+        break;
+
+    case LD_HLR_R8:
+        cpu_write_at_HL(cpu, cpu_reg_get(cpu, extract_reg(lu->opcode, 0)));
+        break;
+
+    case LD_N16R_A:
+        cpu_write_at_idx(cpu, cpu_read_addr_after_opcode(cpu), cpu_reg_get(cpu, REG_A_CODE));
+        break;
+
+    case LD_N16R_SP:
+        cpu_write16_at_idx(cpu, cpu_read_addr_after_opcode(cpu), cpu->SP);
+        break;
+
+    case LD_N8R_A:
+        cpu_write_at_idx(cpu, REGISTERS_START + cpu_read_data_after_opcode(cpu), cpu_reg_get(cpu, REG_A_CODE));
+        break;
+
+    case LD_R16SP_N16:
+        cpu_reg_pair_SP_set(cpu, extract_reg_pair(lu->opcode), cpu_read_addr_after_opcode(cpu));
+        break;
+
+    case LD_R8_HLR:
+        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), cpu_read_at_HL(cpu));
+        break;
+
+    case LD_R8_N8:
+        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), cpu_read_data_after_opcode(cpu));
+        break;
+
+    case LD_R8_R8:
+    {
+        reg_kind s = extract_reg(lu->opcode, 0);
+        reg_kind r = extract_reg(lu->opcode, 3);
+        cpu_reg_set(cpu, r, cpu_reg_get(cpu, s));
+    }
+    break;
+
+    case LD_SP_HL:
+        cpu->SP = cpu_HL_get(cpu);
+        break;
+
+    case POP_R16:
+        cpu_reg_pair_set(cpu, extract_reg_pair(lu->opcode), cpu_SP_pop(cpu));
+        break;
+
+    case PUSH_R16:
+        cpu_SP_push(cpu, cpu_reg_pair_get(cpu, extract_reg_pair(lu->opcode)));
+        break;
+
+    default:
+        fprintf(stderr, "Unknown STORAGE instruction, Code: 0x%" PRIX8 "\n", cpu_read_at_idx(cpu, cpu->PC));
+        return ERR_INSTR;
+        break;
+    } // switch
+
+    return ERR_NONE;
+}
@@ -0,0 +1,1585 @@
+/**
+ * @file cpu-jit.c
+ * @brief Translation of hot blocks of SM83 code to x86-64 machine code
+ *
+ * Every address reached by the CPU is counted; once it has been reached
+ * CPU_JIT_HOT times, the block starting there is translated: up to
+ * CPU_JIT_MAX_INSTR instructions of the same bus page, up to the first
+ * unconditional jump, call or return (conditional branches leave the
+ * block when taken). The translated code is kept per bus page and per
+ * memory plugged there, so that remapping the page (boot ROM, ROM banks)
+ * does not run stale code, and dropped when the CPU writes over it.
+ *
+ * Inside the translated code:
+ *   rbx = cpu, rbp = jit, r15 = jit->flags (x86 to SM83 flags),
+ *   r12 = cycle at which the block started, r13 = stop,
+ *   r14 = cycle at which the last instruction run started.
+ * The cycles of the instructions are constants from the start of the
+ * block, only added to r12 when leaving it (or jumping to another one).
+ * Each instruction first checks that it starts before stop.
+ *
+ * Loads, jumps and most ALU operations on registers are translated to
+ * native code; the others call the handler of the pre-decoded instruction
+ * (see cpu-decode.h), after bringing the rest of the machine up to their
+ * cycle (see cpu_jit_set_sync()). After such a call, the block is left if
+ * it dropped translated code, remapped the page, set *brk or made an
+ * interrupt pending.
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "cpu-jit.h"
+
+#ifdef CPU_JIT
+
+#if !defined(__x86_64__) || !defined(__GNUC__)
+#error "CPU_JIT needs an x86-64 target and GCC (or a compatible compiler)"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h> // offsetof
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "error.h"
+#include "opcode.h"
+#include "cpu-alu.h"    // OPCODE_CARRY_IDX
+#include "cpu-decode.h"
+#include "cpu-exec.h"   // CC_NZ...
+#include "cpu-registers.h"
+#include "gameboy.h"    // ECHO_RAM_START
+
+#define CPU_JIT_CODE_SIZE   (1u << 22) // executable memory, in bytes
+#define CPU_JIT_POOL_SIZE   (1u << 15) // decoded instructions called from the translated code
+#define CPU_JIT_HOT         8          // times an address is reached before being translated
+#define CPU_JIT_MAX_INSTR   32         // instructions per block
+#define CPU_JIT_INSTR_BYTES 512        // upper bound of the code of one instruction
+#define CPU_JIT_BLOCK_BYTES (CPU_JIT_MAX_INSTR * CPU_JIT_INSTR_BYTES)
+
+#define CPU_JIT_NONE UINT64_MAX    // no instruction run (r14)
+#define CPU_JIT_KEEP UINT32_MAX    // r14 already holds the last instruction
+#define CPU_JIT_NO_PC UINT32_MAX   // PC already stored
+
+// how the translated code gives back control
+enum { CPU_JIT_CONTINUE, CPU_JIT_STOP };
+
+typedef int (*cpu_jit_enter_t)(cpu_t *cpu, struct cpu_jit *jit, const uint8_t *code,
+                               uint64_t cycle, uint64_t stop);
+
+/**
+ * @brief Jump to a block not translated yet, to be patched once it is
+ */
+struct cpu_jit_link
+{
+    uint8_t *site; // rel32 of the jump
+    addr_t target;
+};
+
+/**
+ * @brief Translated code of a bus page, for one memory plugged there
+ */
+struct cpu_jit_page
+{
+    const data_t *base;        // memory the page was translated from
+    struct cpu_jit_page *next; // other memories seen at the same page
+    const uint8_t *entry[BUS_PAGE_SIZE];      // block starting at each address
+    uint8_t hits[BUS_PAGE_SIZE];              // times reached, until translated
+    uint64_t covered[BUS_PAGE_SIZE / 64];     // bytes read by translated blocks
+    struct cpu_jit_link *links;
+    size_t nb_links;
+    size_t max_links;
+};
+
+struct cpu_jit
+{
+    // used by the translated code
+    uint8_t flags[256];     // SM83 Z, H and C flags, by x86 flags (as loaded by LAHF)
+    const bit_t *brk;
+    cpu_jit_sync_t sync;
+    void *sync_obj;
+    uint64_t last;          // r14 when leaving
+    uint64_t next;          // r12 when leaving
+    int error;              // of the sync function
+    bit_t dropped;          // translated code was dropped
+
+    uint8_t *code;
+    size_t used;
+    size_t reserved;        // code kept by cpu_jit_flush() (entry and exit)
+    const uint8_t *exit;
+    cpu_jit_enter_t enter;
+    cpu_decoded_t *pool;
+    size_t pool_used;
+    struct cpu_jit_page *pages[BUS_NB_PAGES];
+    bit_t no_brk;
+};
+
+/**
+ * @brief Instruction of a block being translated
+ */
+typedef struct
+{
+    addr_t pc;
+    cpu_decoded_t d;
+    const data_t *bytes; // opcode then operands
+    uint32_t off;        // cycles from the start of the block to its start
+    uint32_t prev;       // same for the previous one, CPU_JIT_KEEP if none
+} cpu_jit_instr_t;
+
+/**
+ * @brief Block being translated
+ */
+typedef struct
+{
+    cpu_t *cpu;
+    struct cpu_jit *jit;
+    struct cpu_jit_page *page;
+    uint8_t *p;           // where to write the next byte
+    const uint8_t *entry;
+    addr_t start;
+} cpu_jit_block_t;
+
+// ======================================================================
+// x86-64 encoding
+
+// registers (or opcode extensions) in the reg field of ModRM
+enum { X86_EAX, X86_ECX, X86_EDX, X86_EBX, X86_ESP, X86_EBP, X86_ESI, X86_EDI };
+
+// 8-bit ALU operations: opcode extension of 80 /n, and n << 3 is the opcode of "op r/m8, r8"
+enum { X86_ADD, X86_OR, X86_ADC, X86_SBB, X86_AND, X86_SUB, X86_XOR, X86_CMP };
+
+// shifts and rotations: opcode extension of D0 /n and C0 /n
+enum { X86_ROL, X86_ROR, X86_RCL, X86_RCR, X86_SHL, X86_SHR, X86_SAR = 7 };
+
+// jumps
+#define X86_JMP 0x00
+#define X86_JAE 0x83
+#define X86_JZ  0x84
+#define X86_JNZ 0x85
+
+#define CPU_FIELD(x) offsetof(cpu_t, x)
+#define JIT_FIELD(x) offsetof(struct cpu_jit, x)
+
+static void cpu_jit_bytes(cpu_jit_block_t *b, const uint8_t *bytes, size_t n)
+{
+    memcpy(b->p, bytes, n);
+    b->p += n;
+}
+
+#define EMIT(b, ...) \
+    cpu_jit_bytes(b, (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void cpu_jit_u16(cpu_jit_block_t *b, uint16_t v)
+{
+    memcpy(b->p, &v, sizeof(v));
+    b->p += sizeof(v);
+}
+
+static void cpu_jit_u32(cpu_jit_block_t *b, uint32_t v)
+{
+    memcpy(b->p, &v, sizeof(v));
+    b->p += sizeof(v);
+}
+
+static void cpu_jit_u64(cpu_jit_block_t *b, uint64_t v)
+{
+    memcpy(b->p, &v, sizeof(v));
+    b->p += sizeof(v);
+}
+
+/**
+ * @brief ModRM and displacement of [rbx + offset] (a field of the cpu)
+ */
+static void cpu_jit_cpu(cpu_jit_block_t *b, uint8_t reg, size_t offset)
+{
+    EMIT(b, (uint8_t)(0x83 | reg << 3));
+    cpu_jit_u32(b, (uint32_t)offset);
+}
+
+/**
+ * @brief ModRM and displacement of [rbp + offset] (a field of the jit)
+ */
+static void cpu_jit_self(cpu_jit_block_t *b, uint8_t reg, size_t offset)
+{
+    EMIT(b, (uint8_t)(0x85 | reg << 3));
+    cpu_jit_u32(b, (uint32_t)offset);
+}
+
+/**
+ * @brief Emits a jump (X86_JMP or a conditional one) to be landed later
+ * @return its rel32
+ */
+static uint8_t *cpu_jit_jump(cpu_jit_block_t *b, uint8_t cc)
+{
+    if (cc == X86_JMP)
+        EMIT(b, 0xE9);
+    else
+        EMIT(b, 0x0F, cc);
+
+    uint8_t *rel = b->p;
+    cpu_jit_u32(b, 0);
+    return rel;
+}
+
+static void cpu_jit_patch(uint8_t *rel, const uint8_t *target)
+{
+    const int32_t d = (int32_t)(target - (rel + sizeof(int32_t)));
+    memcpy(rel, &d, sizeof(d));
+}
+
+static void cpu_jit_land(cpu_jit_block_t *b, uint8_t *rel)
+{
+    cpu_jit_patch(rel, b->p);
+}
+
+// ======================================================================
+// SM83 state
+
+static size_t cpu_jit_reg(uint8_t reg)
+{
+    switch (reg)
+    {
+    case REG_B_CODE:
+        return CPU_FIELD(B);
+    case REG_C_CODE:
+        return CPU_FIELD(C);
+    case REG_D_CODE:
+        return CPU_FIELD(D);
+    case REG_E_CODE:
+        return CPU_FIELD(E);
+    case REG_H_CODE:
+        return CPU_FIELD(H);
+    case REG_L_CODE:
+        return CPU_FIELD(L);
+    default:
+        return CPU_FIELD(A);
+    }
+}
+
+// register pair of the R16SP families (AF stands for SP)
+static size_t cpu_jit_pair(uint8_t pair)
+{
+    switch (pair)
+    {
+    case REG_BC_CODE:
+        return CPU_FIELD(BC);
+    case REG_DE_CODE:
+        return CPU_FIELD(DE);
+    case REG_HL_CODE:
+        return CPU_FIELD(HL);
+    default:
+        return CPU_FIELD(SP);
+    }
+}
+
+/**
+ * @brief Adds the cycles run to r12
+ * @param last cycles from the start of the block to the last instruction run,
+ *        CPU_JIT_KEEP if r14 already holds it
+ * @param next cycles from the start of the block to the next instruction
+ * @param idle whether a handler put extra cycles in cpu->idle_time
+ */
+static void cpu_jit_cycles(cpu_jit_block_t *b, uint32_t last, uint32_t next, bool idle)
+{
+    if (last != CPU_JIT_KEEP)
+    {
+        EMIT(b, 0x4D, 0x8D, 0xB4, 0x24); // lea r14, [r12 + last]
+        cpu_jit_u32(b, last);
+    }
+    if (next != 0)
+    {
+        EMIT(b, 0x49, 0x81, 0xC4); // add r12, next
+        cpu_jit_u32(b, next);
+    }
+    if (idle)
+    {
+        EMIT(b, 0x0F, 0xB6); // movzx eax, byte [cpu->idle_time]
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(idle_time));
+        EMIT(b, 0x49, 0x01, 0xC4); // add r12, rax
+        EMIT(b, 0xC6); // mov byte [cpu->idle_time], 0
+        cpu_jit_cpu(b, 0, CPU_FIELD(idle_time));
+        EMIT(b, 0x00);
+    }
+}
+
+/**
+ * @brief Gives back control to cpu_jit_cycle() (see cpu_jit_cycles())
+ */
+static void cpu_jit_exit(cpu_jit_block_t *b, uint32_t last, uint32_t next, uint32_t pc,
+                         bool idle, int reason)
+{
+    cpu_jit_cycles(b, last, next, idle);
+    if (pc != CPU_JIT_NO_PC)
+    {
+        EMIT(b, 0x66, 0xC7); // mov word [cpu->PC], pc
+        cpu_jit_cpu(b, 0, CPU_FIELD(PC));
+        cpu_jit_u16(b, (uint16_t)pc);
+    }
+    EMIT(b, 0xB8); // mov eax, reason
+    cpu_jit_u32(b, (uint32_t)reason);
+    cpu_jit_patch(cpu_jit_jump(b, X86_JMP), b->jit->exit);
+}
+
+/**
+ * @brief Goes on at a known address: jumps to its block if it is in the
+ *        same page (patched once translated), else gives back control
+ */
+static void cpu_jit_goto(cpu_jit_block_t *b, addr_t target, uint32_t last, uint32_t next)
+{
+    cpu_jit_cycles(b, last, next, false);
+
+    if (target >> BUS_PAGE_BITS == b->start >> BUS_PAGE_BITS)
+    {
+        const uint8_t *entry = target == b->start ? b->entry : b->page->entry[target & (BUS_PAGE_SIZE - 1)];
+        uint8_t *rel = cpu_jit_jump(b, X86_JMP);
+        if (entry != NULL)
+        {
+            cpu_jit_patch(rel, entry);
+            return;
+        }
+
+        struct cpu_jit_page *page = b->page;
+        if (page->nb_links == page->max_links)
+        {
+            const size_t max = page->max_links == 0 ? 16 : 2 * page->max_links;
+            struct cpu_jit_link *links = realloc(page->links, max * sizeof(*links));
+            if (links != NULL)
+            {
+                page->links = links;
+                page->max_links = max;
+            }
+        }
+        if (page->nb_links < page->max_links)
+        {
+            page->links[page->nb_links].site = rel;
+            page->links[page->nb_links].target = target;
+            ++page->nb_links;
+        }
+        // until then, to the exit just below
+        cpu_jit_land(b, rel);
+    }
+
+    cpu_jit_exit(b, CPU_JIT_KEEP, 0, target, false, CPU_JIT_CONTINUE);
+}
+
+/**
+ * @brief F = (SM83 flags of the last x86 operation & alu) | set | (F & keep)
+ */
+static void cpu_jit_flags(cpu_jit_block_t *b, uint8_t alu, uint8_t set, uint8_t keep)
+{
+    EMIT(b, 0x9F);                         // lahf
+    EMIT(b, 0x0F, 0xB6, 0xC4);             // movzx eax, ah
+    EMIT(b, 0x41, 0x0F, 0xB6, 0x04, 0x07); // movzx eax, byte [r15 + rax]
+    EMIT(b, 0x24, alu);                    // and al, alu
+    if (set != 0)
+        EMIT(b, 0x0C, set); // or al, set
+    if (keep != 0)
+    {
+        EMIT(b, 0x0F, 0xB6); // movzx ecx, byte [cpu->F]
+        cpu_jit_cpu(b, X86_ECX, CPU_FIELD(F));
+        EMIT(b, 0x80, 0xE1, keep); // and cl, keep
+        EMIT(b, 0x08, 0xC8);       // or al, cl
+    }
+    EMIT(b, 0x88); // mov [cpu->F], al
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+}
+
+/**
+ * @brief F = Z of the byte at offset (unless clear_z) | C of the last x86 rotation
+ */
+static void cpu_jit_flags_rot(cpu_jit_block_t *b, size_t offset, bool clear_z)
+{
+    EMIT(b, 0x0F, 0x92, 0xC1); // setc cl
+    EMIT(b, 0xC0, 0xE1, 0x04); // shl cl, 4
+    if (clear_z)
+    {
+        EMIT(b, 0x88, 0xC8); // mov al, cl
+    }
+    else
+    {
+        EMIT(b, 0x80); // cmp byte [offset], 0
+        cpu_jit_cpu(b, X86_CMP, offset);
+        EMIT(b, 0x00);
+        EMIT(b, 0x0F, 0x94, 0xC0); // setz al
+        EMIT(b, 0xC0, 0xE0, 0x07); // shl al, 7
+        EMIT(b, 0x08, 0xC8);       // or al, cl
+    }
+    EMIT(b, 0x88); // mov [cpu->F], al
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+}
+
+/**
+ * @brief x86 CF = SM83 C
+ */
+static void cpu_jit_load_carry(cpu_jit_block_t *b)
+{
+    EMIT(b, 0x0F, 0xB6); // movzx eax, byte [cpu->F]
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+    EMIT(b, 0xC0, 0xE8, 0x05); // shr al, 5
+}
+
+/**
+ * @brief Jumps (returned rel32) if the condition code does not hold
+ */
+static uint8_t *cpu_jit_unless(cpu_jit_block_t *b, uint8_t cc)
+{
+    const bool zero = cc == CC_NZ || cc == CC_Z;
+    EMIT(b, 0xF6); // test byte [cpu->F], Z or C
+    cpu_jit_cpu(b, 0, CPU_FIELD(F));
+    EMIT(b, zero ? FLAG_Z : FLAG_C);
+    return cpu_jit_jump(b, (cc == CC_NZ || cc == CC_NC) ? X86_JNZ : X86_JZ);
+}
+
+// ======================================================================
+// Instructions run by their handler
+
+/**
+ * @brief Tells whether the instructions of a family may access the bus
+ *        (other than to read their operands)
+ */
+static bool cpu_jit_touches_bus(opcode_family family)
+{
+    switch (family)
+    {
+    case LD_R8_R8:
+    case LD_R8_N8:
+    case LD_R16SP_N16:
+    case LD_SP_HL:
+    case ADD_A_N8:
+    case ADD_A_R8:
+    case ADD_HL_R16SP:
+    case INC_R16SP:
+    case INC_R8:
+    case LD_HLSP_S8:
+    case CP_A_N8:
+    case CP_A_R8:
+    case DEC_R16SP:
+    case DEC_R8:
+    case SUB_A_N8:
+    case SUB_A_R8:
+    case AND_A_N8:
+    case AND_A_R8:
+    case OR_A_N8:
+    case OR_A_R8:
+    case XOR_A_N8:
+    case XOR_A_R8:
+    case ROTA:
+    case ROTCA:
+    case ROTC_R8:
+    case ROT_R8:
+    case SWAP_R8:
+    case SLA_R8:
+    case SRA_R8:
+    case SRL_R8:
+    case BIT_U3_R8:
+    case CHG_U3_R8:
+    case CPL:
+    case DAA:
+    case SCCF:
+    case JP_CC_N16:
+    case JP_HL:
+    case JP_N16:
+    case JR_CC_E8:
+    case JR_E8:
+    case EDI:
+    case HALT:
+    case STOP:
+    case NOP:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief Tells whether the handler of a family sets PC
+ */
+static bool cpu_jit_sets_pc(opcode_family family)
+{
+    switch (family)
+    {
+    case JP_CC_N16:
+    case JP_HL:
+    case JP_N16:
+    case JR_CC_E8:
+    case JR_E8:
+    case CALL_CC_N16:
+    case CALL_N16:
+    case RET:
+    case RET_CC:
+    case RST_U3:
+    case RETI:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Tells whether a JR may close a polling loop: the interpreter
+ *        then runs it, to look for one (see cpu_idle_loop_check())
+ */
+static bool cpu_jit_may_poll(const instruction_t *lu, addr_t pc, const data_t *bytes)
+{
+    if (lu->family != JR_CC_E8)
+        return false;
+
+    const addr_t target = (addr_t)(pc + lu->bytes + (signed char)bytes[1]);
+    return target <= pc && pc - target <= CPU_IDLE_MAX_BODY;
+}
+
+/**
+ * @brief Tells whether a block ends after an instruction of the family
+ */
+static bool cpu_jit_ends_block(opcode_family family)
+{
+    switch (family)
+    {
+    case JP_CC_N16:
+    case JR_CC_E8:
+        return false;
+    case HALT:
+    case UNKN:
+        return true;
+    default:
+        return cpu_jit_sets_pc(family);
+    }
+}
+
+/**
+ * @brief Gives back control after the instruction if it dropped translated
+ *        code, remapped the page of the block, set *brk or made an interrupt pending
+ * @param bus whether the instruction may have accessed the bus
+ */
+static void cpu_jit_check(cpu_jit_block_t *b, const cpu_jit_instr_t *in, bool bus, uint32_t pc, bool idle)
+{
+    uint8_t *out[4];
+    size_t n = 0;
+
+    if (bus)
+    {
+        EMIT(b, 0x80); // cmp byte [jit->dropped], 0
+        cpu_jit_self(b, X86_CMP, JIT_FIELD(dropped));
+        EMIT(b, 0x00);
+        out[n++] = cpu_jit_jump(b, X86_JNZ);
+
+        EMIT(b, 0x48, 0x8B); // mov rax, [jit->brk]
+        cpu_jit_self(b, X86_EAX, JIT_FIELD(brk));
+        EMIT(b, 0x80, 0x38, 0x00); // cmp byte [rax], 0
+        out[n++] = cpu_jit_jump(b, X86_JNZ);
+
+        const size_t page = (size_t)(b->start >> BUS_PAGE_BITS) * sizeof(bus_page_t) + offsetof(bus_page_t, base);
+        EMIT(b, 0x48, 0x8B); // mov rax, [cpu->bus]
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(bus));
+        EMIT(b, 0x48, 0xB9); // mov rcx, base
+        cpu_jit_u64(b, (uintptr_t)b->page->base);
+        EMIT(b, 0x48, 0x39, 0x88); // cmp [rax + page], rcx
+        cpu_jit_u32(b, (uint32_t)page);
+        out[n++] = cpu_jit_jump(b, X86_JNZ);
+    }
+
+    EMIT(b, 0x80); // cmp byte [cpu->IME], 0
+    cpu_jit_cpu(b, X86_CMP, CPU_FIELD(IME));
+    EMIT(b, 0x00);
+    uint8_t *no_ime = cpu_jit_jump(b, X86_JZ);
+    EMIT(b, 0x0F, 0xB6); // movzx eax, byte [cpu->IE]
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(IE));
+    EMIT(b, 0x84); // test [cpu->IF], al
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(IF));
+    out[n++] = cpu_jit_jump(b, X86_JNZ);
+    cpu_jit_land(b, no_ime);
+    uint8_t *go_on = cpu_jit_jump(b, X86_JMP);
+
+    for (size_t i = 0; i < n; ++i)
+        cpu_jit_land(b, out[i]);
+    cpu_jit_exit(b, in->off, in->off + in->d.lu.cycles, pc, idle, CPU_JIT_STOP);
+    cpu_jit_land(b, go_on);
+}
+
+#ifdef CPU_LAZY_FLAGS
+/**
+ * @brief Writes the flags left pending by a handler to F
+ */
+static void cpu_jit_flags_sync(cpu_t *cpu)
+{
+    cpu_flags_sync(cpu);
+}
+#endif
+
+/**
+ * @brief Runs an instruction through its handler
+ * @return whether the block ends there
+ */
+static bool cpu_jit_call(cpu_jit_block_t *b, const cpu_jit_instr_t *in)
+{
+    struct cpu_jit *jit = b->jit;
+    const instruction_t *lu = &in->d.lu;
+    const bool bus = cpu_jit_touches_bus(lu->family);
+    const uint32_t next = in->off + lu->cycles;
+
+    if (bus && jit->sync != NULL)
+    {
+        EMIT(b, 0x49, 0x8D, 0xB4, 0x24); // lea rsi, [r12 + off]
+        cpu_jit_u32(b, in->off);
+        EMIT(b, 0x48, 0x8B); // mov rdi, [jit->sync_obj]
+        cpu_jit_self(b, X86_EDI, JIT_FIELD(sync_obj));
+        EMIT(b, 0xFF); // call [jit->sync]
+        cpu_jit_self(b, 2, JIT_FIELD(sync));
+        EMIT(b, 0x85, 0xC0); // test eax, eax
+        uint8_t *ok = cpu_jit_jump(b, X86_JZ);
+        EMIT(b, 0x89); // mov [jit->error], eax
+        cpu_jit_self(b, X86_EAX, JIT_FIELD(error));
+        cpu_jit_exit(b, in->prev, in->off, in->pc, false, CPU_JIT_STOP);
+        cpu_jit_land(b, ok);
+    }
+
+    EMIT(b, 0x66, 0xC7); // mov word [cpu->PC], pc
+    cpu_jit_cpu(b, 0, CPU_FIELD(PC));
+    cpu_jit_u16(b, in->pc);
+
+    switch (lu->family)
+    {
+    CPU_CASE_ALU_FAMILIES:
+        EMIT(b, 0x66, 0xC7); // mov word [cpu->alu.value], 0
+        cpu_jit_cpu(b, 0, CPU_FIELD(alu.value));
+        cpu_jit_u16(b, 0);
+        EMIT(b, 0xC6); // mov byte [cpu->alu.flags], 0
+        cpu_jit_cpu(b, 0, CPU_FIELD(alu.flags));
+        EMIT(b, 0x00);
+        break;
+    default:
+        break;
+    }
+
+    cpu_decoded_t *d = &jit->pool[jit->pool_used++];
+    *d = in->d;
+    uint64_t run = 0;
+    memcpy(&run, &d->run, sizeof(d->run));
+
+    EMIT(b, 0x48, 0xBF); // mov rdi, d
+    cpu_jit_u64(b, (uintptr_t)d);
+    EMIT(b, 0x48, 0x89, 0xDE); // mov rsi, rbx
+    EMIT(b, 0x48, 0xB8); // mov rax, d->run
+    cpu_jit_u64(b, run);
+    EMIT(b, 0xFF, 0xD0); // call rax
+    EMIT(b, 0x85, 0xC0); // test eax, eax
+    uint8_t *ok = cpu_jit_jump(b, X86_JZ);
+    // like cpu_cycle(), drops the error: the instruction is run again the next cycle
+    cpu_jit_exit(b, in->off, in->off + 1, CPU_JIT_NO_PC, false, CPU_JIT_STOP);
+    cpu_jit_land(b, ok);
+
+#ifdef CPU_LAZY_FLAGS
+    switch (lu->family)
+    {
+    CPU_CASE_ALU_FAMILIES:
+    {
+        // the translated code reads F directly
+        void (*sync)(cpu_t *) = cpu_jit_flags_sync;
+        memcpy(&run, &sync, sizeof(sync));
+        EMIT(b, 0x48, 0x89, 0xDF); // mov rdi, rbx
+        EMIT(b, 0x48, 0xB8); // mov rax, cpu_jit_flags_sync
+        cpu_jit_u64(b, run);
+        EMIT(b, 0xFF, 0xD0); // call rax
+        break;
+    }
+    default:
+        break;
+    }
+#endif
+
+    if (!cpu_jit_sets_pc(lu->family))
+    {
+        if (bus || lu->family == EDI)
+            cpu_jit_check(b, in, bus, (addr_t)(in->pc + lu->bytes), false);
+        if (lu->family == UNKN)
+            cpu_jit_goto(b, (addr_t)(in->pc + lu->bytes), in->off, next);
+        return lu->family == UNKN;
+    }
+
+    EMIT(b, 0x66, 0x81); // add word [cpu->PC], bytes
+    cpu_jit_cpu(b, X86_ADD, CPU_FIELD(PC));
+    cpu_jit_u16(b, lu->bytes);
+    cpu_jit_check(b, in, bus, CPU_JIT_NO_PC, true);
+
+    switch (lu->family)
+    {
+    case CALL_N16:
+        cpu_jit_goto(b, in->d.imm, in->off, next);
+        break;
+    case RST_U3:
+        cpu_jit_goto(b, (addr_t)(in->d.arg << 3u), in->off, next);
+        break;
+    default:
+        cpu_jit_exit(b, in->off, next, CPU_JIT_NO_PC, true, CPU_JIT_CONTINUE);
+        break;
+    }
+    return true;
+}
+
+// ======================================================================
+// Native instructions
+
+/**
+ * @brief x86 operation and SM83 flags of the 8-bit arithmetic families
+ * @return false if the family is not one of them
+ */
+static bool cpu_jit_arith_of(const instruction_t *lu, uint8_t *op, uint8_t *alu, uint8_t *set)
+{
+    const bool carry = bit_get(lu->opcode, OPCODE_CARRY_IDX);
+
+    switch (lu->family)
+    {
+    case ADD_A_HLR:
+    case ADD_A_N8:
+    case ADD_A_R8:
+        *op = carry ? X86_ADC : X86_ADD;
+        *alu = FLAG_Z | FLAG_H | FLAG_C;
+        *set = 0;
+        break;
+    case SUB_A_HLR:
+    case SUB_A_N8:
+    case SUB_A_R8:
+        *op = carry ? X86_SBB : X86_SUB;
+        *alu = FLAG_Z | FLAG_H | FLAG_C;
+        *set = FLAG_N;
+        break;
+    case CP_A_HLR:
+    case CP_A_N8:
+    case CP_A_R8:
+        *op = X86_CMP;
+        *alu = FLAG_Z | FLAG_H | FLAG_C;
+        *set = FLAG_N;
+        break;
+    case AND_A_HLR:
+    case AND_A_N8:
+    case AND_A_R8:
+        *op = X86_AND;
+        *alu = FLAG_Z;
+        *set = FLAG_H;
+        break;
+    case OR_A_HLR:
+    case OR_A_N8:
+    case OR_A_R8:
+        *op = X86_OR;
+        *alu = FLAG_Z;
+        *set = 0;
+        break;
+    case XOR_A_HLR:
+    case XOR_A_N8:
+    case XOR_A_R8:
+        *op = X86_XOR;
+        *alu = FLAG_Z;
+        *set = 0;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief A = A op x, x being cl or an immediate
+ */
+static void cpu_jit_arith(cpu_jit_block_t *b, const instruction_t *lu, bool imm, uint8_t value)
+{
+    uint8_t op = 0, alu = 0, set = 0;
+    (void)cpu_jit_arith_of(lu, &op, &alu, &set);
+
+    if (op == X86_ADC || op == X86_SBB)
+        cpu_jit_load_carry(b);
+    if (imm)
+    {
+        EMIT(b, 0x80); // op byte [cpu->A], value
+        cpu_jit_cpu(b, op, CPU_FIELD(A));
+        EMIT(b, value);
+    }
+    else
+    {
+        EMIT(b, (uint8_t)(op << 3)); // op [cpu->A], cl
+        cpu_jit_cpu(b, X86_ECX, CPU_FIELD(A));
+    }
+    cpu_jit_flags(b, alu, set, 0);
+}
+
+/**
+ * @brief BIT n, x (x in cl)
+ */
+static void cpu_jit_bit(cpu_jit_block_t *b, uint8_t n)
+{
+    EMIT(b, 0x0F, 0xB6); // movzx eax, byte [cpu->F]
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+    EMIT(b, 0x24, FLAG_C);                         // and al, C
+    EMIT(b, 0x0C, FLAG_H);                         // or al, H
+    EMIT(b, 0xF6, 0xC1, (uint8_t)(1u << n));       // test cl, 1 << n
+    EMIT(b, 0x75, 0x02);                           // jnz +2
+    EMIT(b, 0x0C, FLAG_Z);                         // or al, Z
+    EMIT(b, 0x88); // mov [cpu->F], al
+    cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+}
+
+/**
+ * @brief Gets the high RAM byte at addr, if it can be accessed directly
+ *        (plain memory, no side effect)
+ * @return its address, NULL if not
+ */
+static data_t *cpu_jit_high_ram(const cpu_t *cpu, addr_t addr, bool write)
+{
+    if (addr < HIGH_RAM_START || addr > HIGH_RAM_END)
+        return NULL;
+
+    const bus_page_t *page = &(*cpu->bus)[addr >> BUS_PAGE_BITS];
+    const bus_mmio_t *mmio = bus_mmio_at(*cpu->bus, addr);
+    if (!(page->flags & (write ? BUS_PAGE_WRITE : BUS_PAGE_READ)))
+        return NULL;
+    if (mmio != NULL && (write ? mmio->on_write : mmio->on_read) != NULL)
+        return NULL;
+
+    return bus_at(*cpu->bus, addr);
+}
+
+/**
+ * @brief Reads the byte at address edx into eax, if it is plain memory
+ *        (else jumps to one of the rel32 put in slow)
+ */
+static void cpu_jit_read(cpu_jit_block_t *b, uint8_t *slow[3])
+{
+    _Static_assert(sizeof(bus_page_t) < 128, "bus_page_t must fit in imm8");
+
+    EMIT(b, 0x89, 0xD1);                               // mov ecx, edx
+    EMIT(b, 0xC1, 0xE9, BUS_PAGE_BITS);                // shr ecx, BUS_PAGE_BITS
+    EMIT(b, 0x6B, 0xC9, (uint8_t)sizeof(bus_page_t));  // imul ecx, ecx, sizeof(bus_page_t)
+    EMIT(b, 0x48, 0x03); // add rcx, [cpu->bus]
+    cpu_jit_cpu(b, X86_ECX, CPU_FIELD(bus));
+    EMIT(b, 0x48, 0x8B, 0x41, (uint8_t)offsetof(bus_page_t, base)); // mov rax, [rcx + base]
+    EMIT(b, 0x48, 0x85, 0xC0);                                       // test rax, rax
+    slow[0] = cpu_jit_jump(b, X86_JZ);
+    EMIT(b, 0x48, 0x83, 0x79, (uint8_t)offsetof(bus_page_t, mmio), 0x00); // cmp qword [rcx + mmio], 0
+    slow[1] = cpu_jit_jump(b, X86_JNZ);
+    EMIT(b, 0xF6, 0x41, (uint8_t)offsetof(bus_page_t, flags), BUS_PAGE_READ); // test byte [rcx + flags], READ
+    slow[2] = cpu_jit_jump(b, X86_JZ);
+    EMIT(b, 0x0F, 0xB6, 0xD2);       // movzx edx, dl
+    EMIT(b, 0x0F, 0xB6, 0x04, 0x10); // movzx eax, byte [rax + rdx]
+}
+
+/**
+ * @brief Instructions reading the bus at a register pair (or a constant):
+ *        native if the memory there is plain, else run by their handler
+ */
+static void cpu_jit_load(cpu_jit_block_t *b, const cpu_jit_instr_t *in)
+{
+    const instruction_t *lu = &in->d.lu;
+    const opcode_t op = lu->opcode;
+
+    switch (lu->family)
+    {
+    case LD_A_BCR:
+        EMIT(b, 0x0F, 0xB7); // movzx edx, word [cpu->BC]
+        cpu_jit_cpu(b, X86_EDX, CPU_FIELD(BC));
+        break;
+    case LD_A_DER:
+        EMIT(b, 0x0F, 0xB7); // movzx edx, word [cpu->DE]
+        cpu_jit_cpu(b, X86_EDX, CPU_FIELD(DE));
+        break;
+    case LD_A_N16R:
+        EMIT(b, 0xBA); // mov edx, n16
+        cpu_jit_u32(b, (uint32_t)(in->bytes[1] | in->bytes[2] << 8));
+        break;
+    default:
+        EMIT(b, 0x0F, 0xB7); // movzx edx, word [cpu->HL]
+        cpu_jit_cpu(b, X86_EDX, CPU_FIELD(HL));
+        break;
+    }
+
+    uint8_t *slow[3];
+    cpu_jit_read(b, slow);
+
+    switch (lu->family)
+    {
+    case LD_R8_HLR:
+        EMIT(b, 0x88); // mov [r], al
+        cpu_jit_cpu(b, X86_EAX, cpu_jit_reg(extract_reg(op, 3)));
+        break;
+    case LD_A_HLRU:
+        EMIT(b, 0x88); // mov [cpu->A], al
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(A));
+        EMIT(b, 0x66, 0xFF); // inc/dec word [cpu->HL]
+        cpu_jit_cpu(b, extract_HL_increment(op) > 0 ? 0 : 1, CPU_FIELD(HL));
+        break;
+    case BIT_U3_HLR:
+        EMIT(b, 0x89, 0xC1); // mov ecx, eax
+        cpu_jit_bit(b, extract_n3(op));
+        break;
+    case LD_A_BCR:
+    case LD_A_DER:
+    case LD_A_N16R:
+        EMIT(b, 0x88); // mov [cpu->A], al
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(A));
+        break;
+    default:
+        EMIT(b, 0x89, 0xC1); // mov ecx, eax
+        cpu_jit_arith(b, lu, false, 0);
+        break;
+    }
+
+    uint8_t *done = cpu_jit_jump(b, X86_JMP);
+    for (size_t i = 0; i < 3; ++i)
+        cpu_jit_land(b, slow[i]);
+    (void)cpu_jit_call(b, in);
+    cpu_jit_land(b, done);
+}
+
+/**
+ * @brief Translates an instruction
+ * @return whether the block ends there
+ */
+static bool cpu_jit_instr(cpu_jit_block_t *b, const cpu_jit_instr_t *in)
+{
+    const instruction_t *lu = &in->d.lu;
+    const opcode_t op = lu->opcode;
+    const data_t *imm = in->bytes + 1;
+    const uint32_t next = in->off + lu->cycles;
+    const addr_t next_pc = (addr_t)(in->pc + lu->bytes);
+
+    switch (lu->family)
+    {
+    case NOP:
+        break;
+
+    // LOAD
+    case LD_R8_R8:
+        EMIT(b, 0x0F, 0xB6); // movzx eax, byte [s]
+        cpu_jit_cpu(b, X86_EAX, cpu_jit_reg(extract_reg(op, 0)));
+        EMIT(b, 0x88); // mov [r], al
+        cpu_jit_cpu(b, X86_EAX, cpu_jit_reg(extract_reg(op, 3)));
+        break;
+
+    case LD_R8_N8:
+        EMIT(b, 0xC6); // mov byte [r], n
+        cpu_jit_cpu(b, 0, cpu_jit_reg(extract_reg(op, 3)));
+        EMIT(b, imm[0]);
+        break;
+
+    case LD_R16SP_N16:
+        EMIT(b, 0x66, 0xC7); // mov word [rr], n16
+        cpu_jit_cpu(b, 0, cpu_jit_pair(extract_reg_pair(op)));
+        cpu_jit_u16(b, (uint16_t)(imm[0] | imm[1] << 8));
+        break;
+
+    case LD_SP_HL:
+        EMIT(b, 0x0F, 0xB7); // movzx eax, word [cpu->HL]
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(HL));
+        EMIT(b, 0x66, 0x89); // mov [cpu->SP], ax
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(SP));
+        break;
+
+    case LD_R8_HLR:
+    case LD_A_BCR:
+    case LD_A_DER:
+    case LD_A_HLRU:
+    case LD_A_N16R:
+    case ADD_A_HLR:
+    case SUB_A_HLR:
+    case CP_A_HLR:
+    case AND_A_HLR:
+    case OR_A_HLR:
+    case XOR_A_HLR:
+    case BIT_U3_HLR:
+        cpu_jit_load(b, in);
+        break;
+
+    case LD_A_N8R:
+    {
+        const data_t *p = cpu_jit_high_ram(b->cpu, (addr_t)(REGISTERS_START + imm[0]), false);
+        if (p == NULL)
+            return cpu_jit_call(b, in);
+        EMIT(b, 0x48, 0xB8); // mov rax, p
+        cpu_jit_u64(b, (uintptr_t)p);
+        EMIT(b, 0x0F, 0xB6, 0x00); // movzx eax, byte [rax]
+        EMIT(b, 0x88);             // mov [cpu->A], al
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(A));
+    }
+    break;
+
+    case LD_N8R_A:
+    {
+        const data_t *p = cpu_jit_high_ram(b->cpu, (addr_t)(REGISTERS_START + imm[0]), true);
+        if (p == NULL)
+            return cpu_jit_call(b, in);
+        EMIT(b, 0x0F, 0xB6); // movzx ecx, byte [cpu->A]
+        cpu_jit_cpu(b, X86_ECX, CPU_FIELD(A));
+        EMIT(b, 0x48, 0xB8); // mov rax, p
+        cpu_jit_u64(b, (uintptr_t)p);
+        EMIT(b, 0x88, 0x08); // mov [rax], cl
+    }
+    break;
+
+    // ALU
+    case ADD_A_R8:
+    case SUB_A_R8:
+    case CP_A_R8:
+    case AND_A_R8:
+    case OR_A_R8:
+    case XOR_A_R8:
+        EMIT(b, 0x0F, 0xB6); // movzx ecx, byte [s]
+        cpu_jit_cpu(b, X86_ECX, cpu_jit_reg(extract_reg(op, 0)));
+        cpu_jit_arith(b, lu, false, 0);
+        break;
+
+    case ADD_A_N8:
+    case SUB_A_N8:
+    case CP_A_N8:
+    case AND_A_N8:
+    case OR_A_N8:
+    case XOR_A_N8:
+        cpu_jit_arith(b, lu, true, imm[0]);
+        break;
+
+    case INC_R8:
+    case DEC_R8:
+        EMIT(b, 0xFE); // inc/dec byte [r]
+        cpu_jit_cpu(b, lu->family == INC_R8 ? 0 : 1, cpu_jit_reg(extract_reg(op, 3)));
+        cpu_jit_flags(b, FLAG_Z | FLAG_H, lu->family == INC_R8 ? 0 : FLAG_N, FLAG_C);
+        break;
+
+    case INC_R16SP:
+    case DEC_R16SP:
+        EMIT(b, 0x66, 0xFF); // inc/dec word [rr]
+        cpu_jit_cpu(b, lu->family == INC_R16SP ? 0 : 1, cpu_jit_pair(extract_reg_pair(op)));
+        break;
+
+    case ADD_HL_R16SP:
+        EMIT(b, 0x0F, 0xB7); // movzx eax, word [rr]
+        cpu_jit_cpu(b, X86_EAX, cpu_jit_pair(extract_reg_pair(op)));
+        EMIT(b, 0x00); // add [cpu->L], al
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(L));
+        EMIT(b, 0x10); // adc [cpu->H], ah
+        cpu_jit_cpu(b, 4, CPU_FIELD(H));
+        cpu_jit_flags(b, FLAG_H | FLAG_C, 0, FLAG_Z);
+        break;
+
+    case CPL:
+        EMIT(b, 0xF6); // not byte [cpu->A]
+        cpu_jit_cpu(b, 2, CPU_FIELD(A));
+        EMIT(b, 0x80); // or byte [cpu->F], N | H
+        cpu_jit_cpu(b, X86_OR, CPU_FIELD(F));
+        EMIT(b, FLAG_N | FLAG_H);
+        break;
+
+    case SCCF:
+        if (extract_sccf(op))
+        {
+            EMIT(b, 0x80); // xor byte [cpu->F], C (CCF)
+            cpu_jit_cpu(b, X86_XOR, CPU_FIELD(F));
+            EMIT(b, FLAG_C);
+            EMIT(b, 0x80); // and byte [cpu->F], Z | C
+            cpu_jit_cpu(b, X86_AND, CPU_FIELD(F));
+            EMIT(b, FLAG_Z | FLAG_C);
+        }
+        else
+        {
+            EMIT(b, 0x80); // and byte [cpu->F], Z (SCF)
+            cpu_jit_cpu(b, X86_AND, CPU_FIELD(F));
+            EMIT(b, FLAG_Z);
+            EMIT(b, 0x80); // or byte [cpu->F], C
+            cpu_jit_cpu(b, X86_OR, CPU_FIELD(F));
+            EMIT(b, FLAG_C);
+        }
+        break;
+
+    // ROTATIONS AND SHIFTS
+    case ROTCA:
+    case ROTA:
+    case ROTC_R8:
+    case ROT_R8:
+    {
+        const bool a = lu->family == ROTCA || lu->family == ROTA;
+        const bool carry = lu->family == ROTA || lu->family == ROT_R8;
+        const size_t r = a ? CPU_FIELD(A) : cpu_jit_reg(extract_reg(op, 0));
+        const bool right = extract_rot_dir(op) == RIGHT;
+        if (carry)
+            cpu_jit_load_carry(b);
+        EMIT(b, 0xD0); // rol/ror/rcl/rcr byte [r], 1
+        cpu_jit_cpu(b, carry ? (right ? X86_RCR : X86_RCL) : (right ? X86_ROR : X86_ROL), r);
+        cpu_jit_flags_rot(b, r, a);
+    }
+    break;
+
+    case SLA_R8:
+    case SRA_R8:
+    case SRL_R8:
+        EMIT(b, 0xD0); // shl/sar/shr byte [r], 1
+        cpu_jit_cpu(b, lu->family == SLA_R8 ? X86_SHL : lu->family == SRA_R8 ? X86_SAR : X86_SHR,
+                    cpu_jit_reg(extract_reg(op, 0)));
+        cpu_jit_flags(b, FLAG_Z | FLAG_C, 0, 0);
+        break;
+
+    case SWAP_R8:
+    {
+        const size_t r = cpu_jit_reg(extract_reg(op, 0));
+        EMIT(b, 0xC0); // rol byte [r], 4
+        cpu_jit_cpu(b, X86_ROL, r);
+        EMIT(b, 0x04);
+        EMIT(b, 0x80); // cmp byte [r], 0
+        cpu_jit_cpu(b, X86_CMP, r);
+        EMIT(b, 0x00);
+        EMIT(b, 0x0F, 0x94, 0xC0); // setz al
+        EMIT(b, 0xC0, 0xE0, 0x07); // shl al, 7
+        EMIT(b, 0x88); // mov [cpu->F], al
+        cpu_jit_cpu(b, X86_EAX, CPU_FIELD(F));
+    }
+    break;
+
+    // BITS
+    case BIT_U3_R8:
+        EMIT(b, 0x0F, 0xB6); // movzx ecx, byte [r]
+        cpu_jit_cpu(b, X86_ECX, cpu_jit_reg(extract_reg(op, 0)));
+        cpu_jit_bit(b, extract_n3(op));
+        break;
+
+    case CHG_U3_R8:
+    {
+        const uint8_t mask = (uint8_t)(1u << extract_n3(op));
+        EMIT(b, 0x80); // or/and byte [r], mask
+        cpu_jit_cpu(b, extract_sr_bit(op) ? X86_OR : X86_AND, cpu_jit_reg(extract_reg(op, 0)));
+        EMIT(b, extract_sr_bit(op) ? mask : (uint8_t)~mask);
+    }
+    break;
+
+    // JUMPS
+    case JP_N16:
+        cpu_jit_goto(b, (addr_t)(imm[0] | imm[1] << 8), in->off, next);
+        return true;
+
+    case JR_E8:
+        cpu_jit_goto(b, (addr_t)(next_pc + (signed char)imm[0]), in->off, next);
+        return true;
+
+    case JP_CC_N16:
+    case JR_CC_E8:
+    {
+        if (cpu_jit_may_poll(lu, in->pc, in->bytes))
+            return cpu_jit_call(b, in);
+
+        const addr_t target = lu->family == JP_CC_N16 ? (addr_t)(imm[0] | imm[1] << 8)
+                                                      : (addr_t)(next_pc + (signed char)imm[0]);
+        uint8_t *not_taken = cpu_jit_unless(b, in->d.arg);
+        cpu_jit_goto(b, target, in->off, next + lu->xtra_cycles);
+        cpu_jit_land(b, not_taken);
+    }
+    break;
+
+    case HALT:
+        EMIT(b, 0xC6); // mov byte [cpu->HALT], 1
+        cpu_jit_cpu(b, 0, CPU_FIELD(HALT));
+        EMIT(b, 0x01);
+        cpu_jit_exit(b, in->off, next, next_pc, false, CPU_JIT_STOP);
+        return true;
+
+    default:
+        return cpu_jit_call(b, in);
+    }
+
+    return false;
+}
+
+// ======================================================================
+// Translation
+
+/**
+ * @brief Tells whether the code of a bus page may be translated
+ */
+static bool cpu_jit_translatable(const bus_page_t *page, unsigned index)
+{
+    const unsigned addr = index << BUS_PAGE_BITS;
+
+    // echo RAM aliases work RAM (see cpu_decode_cacheable());
+    // code read with side effects must be interpreted
+    return page->base != NULL && (page->flags & BUS_PAGE_READ)
+           && (page->mmio == NULL || (!page->mmio_split && page->mmio->on_read == NULL))
+           && (addr < ECHO_RAM_START || addr > ECHO_RAM_END);
+}
+
+/**
+ * @brief Gets the translated code of a bus page for the memory plugged there
+ * @return NULL if no memory
+ */
+static struct cpu_jit_page *cpu_jit_page(struct cpu_jit *jit, const bus_page_t *bp, unsigned index)
+{
+    struct cpu_jit_page *page = jit->pages[index];
+    while (page != NULL && page->base != bp->base)
+        page = page->next;
+
+    if (page == NULL)
+    {
+        page = calloc(1, sizeof(*page));
+        if (page == NULL)
+            return NULL;
+        page->base = bp->base;
+        page->next = jit->pages[index];
+        jit->pages[index] = page;
+    }
+    return page;
+}
+
+static void cpu_jit_drop(struct cpu_jit_page *page)
+{
+    memset(page->entry, 0, sizeof(page->entry));
+    memset(page->covered, 0, sizeof(page->covered));
+    page->nb_links = 0;
+}
+
+/**
+ * @brief Drops all the translated code (the executable memory is full)
+ */
+static void cpu_jit_flush(struct cpu_jit *jit)
+{
+    for (size_t i = 0; i < BUS_NB_PAGES; ++i)
+    {
+        while (jit->pages[i] != NULL)
+        {
+            struct cpu_jit_page *next = jit->pages[i]->next;
+            free(jit->pages[i]->links);
+            free(jit->pages[i]);
+            jit->pages[i] = next;
+        }
+    }
+    jit->used = jit->reserved;
+    jit->pool_used = 0;
+}
+
+/**
+ * @brief Translates the block starting at pc
+ * @return its code, NULL if it cannot be translated
+ */
+static const uint8_t *cpu_jit_translate(cpu_t *cpu, struct cpu_jit *jit, const bus_page_t *bp, addr_t pc)
+{
+    const unsigned index = pc >> BUS_PAGE_BITS;
+
+    if (CPU_JIT_CODE_SIZE - jit->used < CPU_JIT_BLOCK_BYTES || CPU_JIT_POOL_SIZE - jit->pool_used < CPU_JIT_MAX_INSTR)
+        cpu_jit_flush(jit);
+
+    struct cpu_jit_page *page = cpu_jit_page(jit, bp, index);
+    if (page == NULL)
+        return NULL;
+
+    // decodes the block: instructions straddling two pages are never translated
+    cpu_jit_instr_t block[CPU_JIT_MAX_INSTR];
+    size_t n = 0;
+    uint32_t off = 0;
+    addr_t addr = pc;
+    bool ends = false;
+    while (n < CPU_JIT_MAX_INSTR && !ends && addr >> BUS_PAGE_BITS == index)
+    {
+        const size_t o = addr & (BUS_PAGE_SIZE - 1);
+        const data_t *bytes = bp->base + o;
+        if (bytes[0] == PREFIXED && o + 1 >= BUS_PAGE_SIZE)
+            break;
+
+        const instruction_t *lu = bytes[0] == PREFIXED ? &instruction_prefixed[bytes[1]] : &instruction_direct[bytes[0]];
+        // STOP counts no cycle, which the interpreter turns into 256 idle ones
+        if (o + lu->bytes > BUS_PAGE_SIZE || lu->cycles == 0)
+            break;
+
+        cpu_jit_instr_t *in = &block[n];
+        if (cpu_decode(lu, bytes, &in->d) != ERR_NONE)
+            break;
+        in->pc = addr;
+        in->bytes = bytes;
+        in->off = off;
+        in->prev = n == 0 ? CPU_JIT_KEEP : block[n - 1].off;
+
+        ends = cpu_jit_ends_block(lu->family) || cpu_jit_may_poll(lu, addr, bytes);
+        off += lu->cycles;
+        addr = (addr_t)(addr + lu->bytes);
+        ++n;
+    }
+
+    if (n == 0)
+        return NULL;
+
+    cpu_jit_block_t b = { cpu, jit, page, jit->code + jit->used, NULL, pc };
+    b.entry = b.p;
+
+    // each instruction first checks that it starts before stop
+    uint8_t *late[CPU_JIT_MAX_INSTR];
+    bool ended = false;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (block[i].off == 0)
+        {
+            EMIT(&b, 0x4D, 0x39, 0xEC); // cmp r12, r13
+        }
+        else
+        {
+            EMIT(&b, 0x49, 0x8D, 0x84, 0x24); // lea rax, [r12 + off]
+            cpu_jit_u32(&b, block[i].off);
+            EMIT(&b, 0x4C, 0x39, 0xE8); // cmp rax, r13
+        }
+        late[i] = cpu_jit_jump(&b, X86_JAE);
+        ended = cpu_jit_instr(&b, &block[i]);
+    }
+    if (!ended)
+        cpu_jit_goto(&b, addr, block[n - 1].off, off);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        cpu_jit_land(&b, late[i]);
+        cpu_jit_exit(&b, block[i].prev, block[i].off, block[i].pc, false, CPU_JIT_STOP);
+    }
+
+    jit->used = (size_t)(b.p - jit->code);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t k = 0; k < block[i].d.lu.bytes; ++k)
+        {
+            const size_t o = (block[i].pc + k) & (BUS_PAGE_SIZE - 1);
+            page->covered[o / 64] |= UINT64_C(1) << (o % 64);
+        }
+    }
+    page->entry[pc & (BUS_PAGE_SIZE - 1)] = b.entry;
+
+    // the jumps waiting for this block now go there
+    for (size_t i = 0; i < page->nb_links;)
+    {
+        if (page->links[i].target == pc)
+        {
+            cpu_jit_patch(page->links[i].site, b.entry);
+            page->links[i] = page->links[--page->nb_links];
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return b.entry;
+}
+
+/**
+ * @brief Gets the translated block starting at pc, translating it if hot enough
+ * @return NULL if none
+ */
+static const uint8_t *cpu_jit_lookup(cpu_t *cpu, struct cpu_jit *jit, addr_t pc)
+{
+    const unsigned index = pc >> BUS_PAGE_BITS;
+    const bus_page_t *bp = &(*cpu->bus)[index];
+    if (!cpu_jit_translatable(bp, index))
+        return NULL;
+
+    struct cpu_jit_page *page = cpu_jit_page(jit, bp, index);
+    if (page == NULL)
+        return NULL;
+
+    const size_t o = pc & (BUS_PAGE_SIZE - 1);
+    if (page->entry[o] != NULL)
+        return page->entry[o];
+
+    if (++page->hits[o] < CPU_JIT_HOT)
+        return NULL;
+    page->hits[o] = 0;
+
+    return cpu_jit_translate(cpu, jit, bp, pc);
+}
+
+// ======================================================================
+/**
+ * @brief Writes the entry and exit of the translated code:
+ *        int enter(cpu, jit, code, cycle, stop)
+ */
+static void cpu_jit_trampoline(struct cpu_jit *jit)
+{
+    cpu_jit_block_t b = { NULL, jit, NULL, jit->code, NULL, 0 };
+
+    EMIT(&b, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57); // push rbx, rbp, r12-r15
+    EMIT(&b, 0x48, 0x83, 0xEC, 0x08); // sub rsp, 8 (calls need a 16-byte aligned stack)
+    EMIT(&b, 0x48, 0x89, 0xFB);       // mov rbx, rdi
+    EMIT(&b, 0x48, 0x89, 0xF5);       // mov rbp, rsi
+    EMIT(&b, 0x49, 0x89, 0xCC);       // mov r12, rcx
+    EMIT(&b, 0x4D, 0x89, 0xC5);       // mov r13, r8
+    EMIT(&b, 0x49, 0xC7, 0xC6, 0xFF, 0xFF, 0xFF, 0xFF); // mov r14, CPU_JIT_NONE
+    EMIT(&b, 0x4C, 0x8D); // lea r15, [jit->flags]
+    cpu_jit_self(&b, 7, JIT_FIELD(flags));
+    EMIT(&b, 0xFF, 0xE2); // jmp rdx
+
+    jit->exit = b.p;
+    EMIT(&b, 0x4C, 0x89); // mov [jit->last], r14
+    cpu_jit_self(&b, 6, JIT_FIELD(last));
+    EMIT(&b, 0x4C, 0x89); // mov [jit->next], r12
+    cpu_jit_self(&b, 4, JIT_FIELD(next));
+    EMIT(&b, 0x48, 0x83, 0xC4, 0x08); // add rsp, 8
+    EMIT(&b, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B); // pop r15-r12, rbp, rbx
+    EMIT(&b, 0xC3); // ret
+
+    memcpy(&jit->enter, &jit->code, sizeof(jit->enter));
+    jit->used = jit->reserved = (size_t)(b.p - jit->code);
+}
+
+int cpu_jit_create(cpu_t *cpu)
+{
+    M_REQUIRE_NON_NULL(cpu);
+    _Static_assert(sizeof(cpu_jit_enter_t) == sizeof(uint8_t *), "code and data pointers must have the same size");
+
+    cpu->jit = NULL;
+
+    struct cpu_jit *jit = calloc(1, sizeof(*jit));
+    M_EXIT_IF_NULL(jit, sizeof(*jit));
+
+    jit->pool = calloc(CPU_JIT_POOL_SIZE, sizeof(*jit->pool));
+    if (jit->pool == NULL)
+    {
+        free(jit);
+        M_EXIT_IF_NULL(NULL, CPU_JIT_POOL_SIZE * sizeof(cpu_decoded_t));
+    }
+
+    void *code = mmap(NULL, CPU_JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+        // the system refuses executable memory: interprets
+        debug_print("no executable memory, %s", "the code will not be translated");
+        free(jit->pool);
+        free(jit);
+        return ERR_NONE;
+    }
+    jit->code = code;
+
+    // LAHF: SF ZF 0 AF 0 PF 1 CF
+    for (unsigned ah = 0; ah < 256; ++ah)
+    {
+        jit->flags[ah] = (uint8_t)(((ah & 0x40) ? FLAG_Z : 0) | ((ah & 0x10) ? FLAG_H : 0)
+                                   | ((ah & 0x01) ? FLAG_C : 0));
+    }
+    jit->brk = &jit->no_brk;
+    cpu_jit_trampoline(jit);
+
+    cpu->jit = jit;
+    return ERR_NONE;
+}
+
+void cpu_jit_free(cpu_t *cpu)
+{
+    if (cpu == NULL || cpu->jit == NULL)
+        return;
+
+    cpu_jit_flush(cpu->jit);
+    munmap(cpu->jit->code, CPU_JIT_CODE_SIZE);
+    free(cpu->jit->pool);
+    free(cpu->jit);
+    cpu->jit = NULL;
+}
+
+void cpu_jit_set_sync(cpu_t *cpu, cpu_jit_sync_t sync, void *obj)
+{
+    if (cpu == NULL || cpu->jit == NULL)
+        return;
+
+    // the calls are compiled in
+    if (cpu->jit->sync != sync || cpu->jit->sync_obj != obj)
+        cpu_jit_flush(cpu->jit);
+    cpu->jit->sync = sync;
+    cpu->jit->sync_obj = obj;
+}
+
+int cpu_jit_cycle(cpu_t *cpu, uint64_t *cycle, uint64_t stop, const bit_t *brk)
+{
+    M_REQUIRE_NON_NULL(cpu);
+    M_REQUIRE_NON_NULL(cycle);
+
+    struct cpu_jit *jit = cpu->jit;
+    // an OAM DMA holds the bus: the translated code would read through it
+    if (jit == NULL || cpu->idle_time > 0 || cpu->HALT || cpu->bus_locked || (cpu->IME && (cpu->IE & cpu->IF)))
+        return cpu_cycle(cpu);
+
+    jit->brk = brk != NULL ? brk : &jit->no_brk;
+    cpu->idle_loop.cycles = 0;
+#ifdef CPU_LAZY_FLAGS
+    cpu_flags_sync(cpu); // the translated code keeps F up to date
+#endif
+
+    uint64_t now = *cycle;
+    uint64_t last = CPU_JIT_NONE;
+    const uint8_t *entry = NULL;
+    while (now < stop && !cpu->bus_locked && (entry = cpu_jit_lookup(cpu, jit, cpu->PC)) != NULL)
+    {
+        jit->dropped = 0;
+        jit->error = ERR_NONE;
+        const int reason = jit->enter(cpu, jit, entry, now, stop);
+
+        if (jit->last != CPU_JIT_NONE)
+        {
+            last = jit->last;
+            now = jit->next;
+        }
+        M_EXIT_IF_ERR(jit->error);
+        if (reason != CPU_JIT_CONTINUE || cpu->idle_loop.cycles != 0)
+            break;
+    }
+
+    if (last == CPU_JIT_NONE)
+        return cpu_cycle(cpu);
+
+    *cycle = last;
+    cpu->idle_time = (uint8_t)(now - last - 1);
+    return ERR_NONE;
+}
+
+void cpu_jit_invalidate(cpu_t *cpu, addr_t addr)
+{
+    if (cpu == NULL || cpu->jit == NULL)
+        return;
+
+    const unsigned index = addr >> BUS_PAGE_BITS;
+    const size_t o = addr & (BUS_PAGE_SIZE - 1);
+    const bus_page_t *bp = &(*cpu->bus)[index];
+    if (!(bp->flags & BUS_PAGE_WRITE))
+        return; // the memory did not change
+
+    for (struct cpu_jit_page *page = cpu->jit->pages[index]; page != NULL; page = page->next)
+    {
+        if (page->base == bp->base && (page->covered[o / 64] >> (o % 64) & 1))
+        {
+            cpu_jit_drop(page);
+            cpu->jit->dropped = 1;
+        }
+    }
+}
+
+#else // CPU_JIT
+
+int cpu_jit_create(cpu_t *cpu)
+{
+    M_REQUIRE_NON_NULL(cpu);
+    cpu->jit = NULL;
+    return ERR_NONE;
+}
+
+void cpu_jit_free(cpu_t *cpu)
+{
+    (void)cpu;
+}
+
+void cpu_jit_set_sync(cpu_t *cpu, cpu_jit_sync_t sync, void *obj)
+{
+    (void)cpu;
+    (void)sync;
+    (void)obj;
+}
+
+int cpu_jit_cycle(cpu_t *cpu, uint64_t *cycle, uint64_t stop, const bit_t *brk)
+{
+    M_REQUIRE_NON_NULL(cpu);
+    M_REQUIRE_NON_NULL(cycle);
+    (void)stop;
+    (void)brk;
+    return cpu_cycle(cpu);
+}
+
+void cpu_jit_invalidate(cpu_t *cpu, addr_t addr)
+{
+    (void)cpu;
+    (void)addr;
+}
+
+#endif // CPU_JIT
@@ -0,0 +1,99 @@
+#pragma once
+
+/**
+ * @file cpu-jit.h
+ * @brief Translation of hot blocks of SM83 code to x86-64 machine code
+ *        (build with -DCPU_JIT, i.e. make CPU_CORE=jit, to use it)
+ *
+ * A block is a run of instructions in one bus page, translated once its
+ * first address has been reached often enough. The instruction families
+ * of this project (loads, jumps, the ALU operations implemented in
+ * cpu-exec.h) are translated to native code; the others call the
+ * pre-decoded handler of the instruction (see cpu-decode.h).
+ * The translated code is dropped when the CPU writes over it.
+ *
+ * Without CPU_JIT (or if no executable memory can be had), these
+ * functions fall back to the interpreter.
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+/**
+ * @brief Tells the rest of the machine the cycle at which an instruction
+ *        which may access its registers starts (e.g. for the timer)
+ *
+ * @param obj as given to cpu_jit_set_sync()
+ * @param cycle cycle at which the instruction starts
+ * @return error code
+ */
+typedef int (*cpu_jit_sync_t)(void* obj, uint64_t cycle);
+
+//=========================================================================
+/**
+ * @brief Creates the translator of a CPU (called by cpu_init())
+ *
+ * @param cpu cpu to translate the code of
+ * @return error code
+ */
+int cpu_jit_create(cpu_t* cpu);
+
+
+/**
+ * @brief Frees the translator of a CPU: it then only interprets
+ *
+ * @param cpu cpu whose translator is freed
+ */
+void cpu_jit_free(cpu_t* cpu);
+
+
+/**
+ * @brief Sets the function to be called before the instructions that
+ *        are not translated (NULL if none is needed)
+ *
+ * @param cpu cpu to set it to
+ * @param sync function to call
+ * @param obj its first argument
+ */
+void cpu_jit_set_sync(cpu_t* cpu, cpu_jit_sync_t sync, void* obj);
+
+
+/**
+ * @brief Runs instructions from PC, at least one (same as cpu_cycle()),
+ *        more as long as they are translated, start before stop and
+ *        do not request an interrupt nor set *brk
+ *
+ * Like cpu_cycle(), expects cpu->idle_time to be zero when an instruction
+ * is to be run.
+ *
+ * @param cpu (modified), the CPU which shall run
+ * @param cycle (modified), the cycle at which PC starts;
+ *        set to the cycle at which the last instruction run started
+ *        (cpu->idle_time then holds its remaining cycles)
+ * @param stop first cycle at which no instruction may start
+ * @param brk flag set by the bus handlers when the caller must reschedule
+ * @return error code
+ */
+int cpu_jit_cycle(cpu_t* cpu, uint64_t* cycle, uint64_t stop, const bit_t* brk);
+
+
+/**
+ * @brief Drops the translated code overlapping an address
+ *        (called by cpu_decode_invalidate())
+ *
+ * @param cpu cpu whose translated code is concerned
+ * @param addr modified address
+ */
+void cpu_jit_invalidate(cpu_t* cpu, addr_t addr);
+
+#ifdef __cplusplus
+}
+#endif
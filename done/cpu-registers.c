@@ -7,6 +7,7 @@
  */
 
 #include "cpu-registers.h"
+#include "cpu-alu.h" // cpu_lazy_eval()
 #include "error.h"
 #include "bit.h"
 
@@ -42,7 +43,12 @@ uint16_t cpu_reg_pair_get(const cpu_t *cpu, reg_pair_kind reg)
     switch (reg)
     {
     case REG_AF_CODE:
+#ifdef CPU_LAZY_FLAGS
+        // F may still be pending (PUSH AF)
+        return (uint16_t)(cpu->A << 8 | cpu_lazy_eval(&cpu->lazy, cpu->F));
+#else
         return cpu->AF;
+#endif
     case REG_HL_CODE:
         return cpu->HL;
     case REG_BC_CODE:
@@ -101,6 +107,7 @@ void cpu_reg_pair_set(cpu_t *cpu, reg_pair_kind reg, uint16_t value)
     case REG_AF_CODE:
         value = value & 0xFFF0; //force the 4 lsb to 0;
         cpu->AF = value;
+        cpu->lazy.kind = LAZY_NONE; // F is given, drop the pending flags
         break;
     default:
         // Do nothing
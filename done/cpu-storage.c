@@ -12,14 +12,22 @@
 #include "gameboy.h"       // REGISTER_START
 #include "util.h"
 #include "opcode.h"   //instruction_direct
+#include "cpu-exec.h" // cpu_exec_storage
 #include <inttypes.h> // PRIX8
 #include <stdio.h>    // fprintf
 
+// the CPU is locked out of the bus at that address (OAM DMA)
+#define cpu_bus_locked_at(cpu, addr) ((cpu)->bus_locked && (addr) < CPU_BUS_LOCK_FREE_START)
+
 data_t cpu_read_at_idx(const cpu_t *cpu, addr_t addr)
 {
     data_t result = 0;
     
+    if (cpu != NULL && cpu_bus_locked_at(cpu, addr))
+        return 0xFF;
+
     if (cpu != NULL) {
+        RETURN_IF_ERROR_MSG_ONLY(bus_notify_read(*(cpu->bus), addr));
         bus_read(*(cpu->bus), addr, &result);
     }
 
@@ -30,6 +38,11 @@ addr_t cpu_read16_at_idx(const cpu_t *cpu, addr_t addr)
 {
     addr_t result = 0;
 
+    if (cpu->bus_locked)
+        return merge8(cpu_read_at_idx(cpu, addr), cpu_read_at_idx(cpu, (addr_t)(addr + 1)));
+
+    RETURN_IF_ERROR_MSG_ONLY(bus_notify_read(*(cpu->bus), addr));
+    RETURN_IF_ERROR_MSG_ONLY(bus_notify_read(*(cpu->bus), (addr_t)(addr + 1)));
     bus_read16(*(cpu->bus), addr, &result);
 
     return result;
@@ -39,16 +52,30 @@ int cpu_write_at_idx(cpu_t *cpu, addr_t addr, data_t data)
 {
     M_REQUIRE_NON_NULL(cpu);
 
-    cpu->write_listener = addr;
-    return bus_write(*(cpu->bus), addr, data);
+    if (cpu_bus_locked_at(cpu, addr))
+        return ERR_NONE;
+
+    M_EXIT_IF_ERR(bus_write(*(cpu->bus), addr, data));
+    cpu_decode_invalidate(cpu, addr);
+    return bus_notify_write(*(cpu->bus), addr, data);
 }
 
 int cpu_write16_at_idx(cpu_t *cpu, addr_t addr, addr_t data16)
 {
     M_REQUIRE_NON_NULL(cpu);
 
-    cpu->write_listener = addr;
-    return bus_write16(*cpu->bus, addr, data16);
+    if (cpu->bus_locked)
+    {
+        M_EXIT_IF_ERR(cpu_write_at_idx(cpu, addr, lsb8(data16)));
+        return cpu_write_at_idx(cpu, (addr_t)(addr + 1), msb8(data16));
+    }
+
+    M_EXIT_IF_ERR(bus_write16(*cpu->bus, addr, data16));
+    cpu_decode_invalidate(cpu, addr);
+    cpu_decode_invalidate(cpu, (addr_t)(addr + 1));
+    // both bytes are written, both may have side effects
+    M_EXIT_IF_ERR(bus_notify_write(*cpu->bus, addr, lsb8(data16)));
+    return bus_notify_write(*cpu->bus, (addr_t)(addr + 1), msb8(data16));
 }
 
 int cpu_SP_push(cpu_t *cpu, addr_t data16)
@@ -76,108 +103,5 @@ int cpu_dispatch_storage(const instruction_t *lu, cpu_t *cpu)
     M_REQUIRE_NON_NULL(cpu);
     M_REQUIRE_NON_NULL(lu);
 
-    switch (lu->family)
-    {
-
-    case LD_A_BCR:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_BC_get(cpu)));
-        break;
-
-    case LD_A_CR:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, REGISTERS_START + cpu_reg_get(cpu, REG_C_CODE)));
-        break;
-
-    case LD_A_DER:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_DE_get(cpu)));
-        break;
-
-    case LD_A_HLRU:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_HL(cpu));
-        cpu_HL_set(cpu, cpu_HL_get(cpu) + extract_HL_increment(lu->opcode));
-        break;
-
-    case LD_A_N16R:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, cpu_read_addr_after_opcode(cpu)));
-        break;
-
-    case LD_A_N8R:
-        cpu_reg_set(cpu, REG_A_CODE, cpu_read_at_idx(cpu, REGISTERS_START + cpu_read_data_after_opcode(cpu)));
-        break;
-
-    case LD_BCR_A:
-        cpu_write_at_idx(cpu, cpu_BC_get(cpu), cpu_reg_get(cpu, REG_A_CODE));
-        break;
-
-    case LD_CR_A:
-        cpu_write_at_idx(cpu, REGISTERS_START + cpu_reg_get(cpu, REG_C_CODE), cpu_reg_get(cpu, REG_A_CODE));
-        break;
-
-    case LD_DER_A:
-        cpu_write_at_idx(cpu, cpu_DE_get(cpu), cpu_reg_get(cpu, REG_A_CODE));
-        break;
-
-    case LD_HLRU_A:
-        cpu_write_at_HL(cpu, cpu_reg_get(cpu, REG_A_CODE));
-        cpu_HL_set(cpu, cpu_HL_get(cpu) + extract_HL_increment(lu->opcode));
-        break;
-
-    case LD_HLR_N8:
-        cpu_write_at_HL(cpu, cpu_read_data_after_opcode(cpu));
-        break;
-
-    case LD_HLR_R8:
-        cpu_write_at_HL(cpu, cpu_reg_get(cpu, extract_reg(lu->opcode, 0)));
-        break;
-
-    case LD_N16R_A:
-        cpu_write_at_idx(cpu, cpu_read_addr_after_opcode(cpu), cpu_reg_get(cpu, REG_A_CODE));
-        break;
-
-    case LD_N16R_SP:
-        cpu_write16_at_idx(cpu, cpu_read_addr_after_opcode(cpu), cpu->SP);
-        break;
-
-    case LD_N8R_A:
-        cpu_write_at_idx(cpu, REGISTERS_START + cpu_read_data_after_opcode(cpu), cpu_reg_get(cpu, REG_A_CODE));
-        break;
-
-    case LD_R16SP_N16:
-        cpu_reg_pair_SP_set(cpu, extract_reg_pair(lu->opcode), cpu_read_addr_after_opcode(cpu));
-        break;
-
-    case LD_R8_HLR:
-        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), cpu_read_at_HL(cpu));
-        break;
-
-    case LD_R8_N8:
-        cpu_reg_set(cpu, extract_reg(lu->opcode, 3), cpu_read_data_after_opcode(cpu));
-        break;
-
-    case LD_R8_R8:
-    {
-        reg_kind s = extract_reg(lu->opcode, 0);
-        reg_kind r = extract_reg(lu->opcode, 3);
-        cpu_reg_set(cpu, r, cpu_reg_get(cpu, s));
-    }
-    break;
-
-    case LD_SP_HL:
-        cpu->SP = cpu_HL_get(cpu);
-        break;
-
-    case POP_R16:
-        cpu_reg_pair_set(cpu, extract_reg_pair(lu->opcode), cpu_SP_pop(cpu));
-        break;
-
-    case PUSH_R16:
-        cpu_SP_push(cpu, cpu_reg_pair_get(cpu, extract_reg_pair(lu->opcode)));
-        break;
-
-    default:
-        fprintf(stderr, "Unknown STORAGE instruction, Code: 0x%" PRIX8 "\n", cpu_read_at_idx(cpu, cpu->PC));
-        return ERR_INSTR;
-        break;
-    } // switch
-
-    return ERR_NONE;
+    return cpu_exec_storage(lu, cpu);
 }
@@ -0,0 +1,179 @@
+/**
+ * @file cpu-threaded.c
+ * @brief Threaded-code CPU interpreter
+ *
+ * Every one of the 512 opcodes gets its own handler, generated from the
+ * INSTR_DEF tables (see opcode-table.h). A handler runs a constant
+ * instruction: once cpu_threaded_run() is inlined into it, the family
+ * switch and the operand extraction (registers, n3, cc...) are resolved
+ * at compile time. Dispatch is a single computed goto (GCC labels as values).
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "cpu-threaded.h"
+#include "cpu-exec.h"
+#include "opcode-table.h"
+
+// ======================================================================
+/**
+ * @brief Executes a (constant) instruction, see cpu_dispatch() in cpu.c
+ */
+CPU_EXEC_INLINE int cpu_threaded_run(const instruction_t *lu, cpu_t *cpu)
+{
+    //remet à 0 l'ALU du CPU
+    cpu->alu.value = 0u;
+    cpu->alu.flags = 0u;
+
+    const addr_t next_PC = (addr_t)(cpu->PC + lu->bytes);
+
+    switch (lu->family)
+    {
+
+    // ALU
+    CPU_CASE_ALU_FAMILIES:
+        M_EXIT_IF_ERR(cpu_exec_alu(lu, cpu));
+        break;
+
+    // STORAGE
+    CPU_CASE_STORAGE_FAMILIES:
+        M_EXIT_IF_ERR(cpu_exec_storage(lu, cpu));
+        break;
+
+    // JUMP
+    case JP_CC_N16:
+        if (cpu_cc_holds(cpu_F_get(cpu), extract_cc(lu->opcode)))
+        {
+            cpu->PC = (addr_t)(cpu_read_addr_after_opcode(cpu) - lu->bytes);
+            cpu->idle_time += lu->xtra_cycles;
+        }
+        break;
+
+    case JP_HL:
+        cpu->PC = (addr_t)(cpu->HL - lu->bytes);
+        break;
+
+    case JP_N16:
+        cpu->PC = (addr_t)(cpu_read_addr_after_opcode(cpu) - lu->bytes);
+        break;
+
+    case JR_CC_E8:
+        if (cpu_cc_holds(cpu_F_get(cpu), extract_cc(lu->opcode)))
+        {
+            const signed char e8 = (signed char)cpu_read_data_after_opcode(cpu);
+            cpu_idle_loop_check(cpu, cpu->PC, (addr_t)(next_PC + e8));
+            cpu->PC = (addr_t)(cpu->PC + e8);
+            cpu->idle_time += lu->xtra_cycles;
+        }
+        else
+        {
+            cpu->idle_loop.armed = 0;
+        }
+        break;
+
+    case JR_E8:
+        cpu->PC = (addr_t)(cpu->PC + (signed char)cpu_read_data_after_opcode(cpu));
+        break;
+
+    // CALLS
+    case CALL_CC_N16:
+        if (cpu_cc_holds(cpu_F_get(cpu), extract_cc(lu->opcode)))
+        {
+            M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
+            cpu->PC = (addr_t)(cpu_read_addr_after_opcode(cpu) - lu->bytes);
+            cpu->idle_time += lu->xtra_cycles;
+        }
+        break;
+
+    case CALL_N16:
+        M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
+        cpu->PC = (addr_t)(cpu_read_addr_after_opcode(cpu) - lu->bytes);
+        break;
+
+    // RETURN (from call)
+    case RET:
+        cpu->PC = (addr_t)(cpu_SP_pop(cpu) - lu->bytes);
+        break;
+
+    case RET_CC:
+        if (cpu_cc_holds(cpu_F_get(cpu), extract_cc(lu->opcode)))
+        {
+            cpu->PC = (addr_t)(cpu_SP_pop(cpu) - lu->bytes);
+            cpu->idle_time += lu->xtra_cycles;
+        }
+        break;
+
+    case RST_U3:
+        M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
+        cpu->PC = (addr_t)((extract_n3(lu->opcode) << 3u) - lu->bytes); //n3 * 8
+        break;
+
+    // INTERRUPT & MISC.
+    case EDI:
+        cpu->IME = extract_ime(lu->opcode);
+        break;
+
+    case RETI:
+        cpu->IME = 1;
+        cpu->PC = (addr_t)(cpu_SP_pop(cpu) - lu->bytes);
+        break;
+
+    case HALT:
+        cpu->HALT = 1;
+        break;
+
+    case STOP:
+    case NOP:
+        // ne rien faire
+        break;
+
+    default:
+        fprintf(stderr, "Unknown instruction, Code: 0x%" PRIX8 "\n", cpu_read_at_idx(cpu, cpu->PC));
+        return ERR_INSTR;
+
+    } // switch
+
+    //met à jour l'idle time et le PC
+    cpu->PC = (addr_t)(cpu->PC + lu->bytes);
+    cpu->idle_time = (uint8_t)(cpu->idle_time + lu->cycles - 1);
+    return ERR_NONE;
+}
+
+// ======================================================================
+// Handlers: each OP_... entry of the tables expands (through INSTR_DFX)
+// into the run of its own constant instruction
+#undef INSTR_DFX
+#define INSTR_DFX(Kind, Family, Code, Bytes, Cycles, Xtra) \
+    { \
+        static const instruction_t lu = \
+            { .kind = Kind, .family = Family, .opcode = Code, .bytes = Bytes, .cycles = Cycles, .xtra_cycles = Xtra }; \
+        return cpu_threaded_run(&lu, cpu); \
+    }
+
+#define DIRECT_LABEL(Code, Op)     [Code] = &&direct_##Code,
+#define PREFIXED_LABEL(Code, Op)   [Code] = &&prefixed_##Code,
+#define DIRECT_HANDLER(Code, Op)   direct_##Code: Op
+#define PREFIXED_HANDLER(Code, Op) prefixed_##Code: Op
+
+// labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+int cpu_threaded_exec(cpu_t *cpu)
+{
+    M_REQUIRE_NON_NULL(cpu);
+
+    static const void *const direct[256] = { INSTR_DIRECT_TABLE(DIRECT_LABEL) };
+    static const void *const prefixed[256] = { INSTR_PREFIXED_TABLE(PREFIXED_LABEL) };
+
+    const data_t opcode = cpu_read_at_idx(cpu, cpu->PC);
+    if (opcode == PREFIXED)
+        goto *prefixed[cpu_read_data_after_opcode(cpu)];
+    goto *direct[opcode];
+
+    INSTR_DIRECT_TABLE(DIRECT_HANDLER)
+    INSTR_PREFIXED_TABLE(PREFIXED_HANDLER)
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * @file cpu-threaded.h
+ * @brief Threaded-code CPU interpreter (build with -DCPU_THREADED to use it)
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "cpu.h"
+
+//=========================================================================
+/**
+ * @brief Executes the instruction at PC: one handler per opcode,
+ *        reached through a single computed goto
+ *
+ * @param cpu (modified), the CPU which shall execute
+ * @return error code
+ */
+int cpu_threaded_exec(cpu_t* cpu);
+
+#ifdef __cplusplus
+}
+#endif
@@ -14,17 +14,72 @@
 #include <stdio.h>
 #include "cpu-registers.h"
 #include "cpu-storage.h"
+#include "cpu-exec.h" // cpu_cc_holds
+#include "cpu-threaded.h"
+#include "cpu-decode.h"
+#include "cpu-jit.h"
+#include "gameboy.h" // ECHO_RAM_START
 #include <inttypes.h> // PRIX8
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define INTERRUPTS 5
 
-typedef enum
+// ======================================================================
+// Pre-decoded instructions
+//
+// Chaque instruction est décodée une seule fois : on garde le handler à
+// appeler et les opérandes déjà extraits (immédiat, condition, vecteur).
+// Le cache est indexé par adresse et par page de bus ; une page est
+// étiquetée par la mémoire qui y est branchée, de sorte qu'un changement
+// de mapping (boot ROM, banque de ROM) la vide. Les écritures du CPU
+// invalident les entrées qu'elles recouvrent.
+//
+// Les pages en lecture seule (ROM) ne changent jamais : elles sont
+// décodées en entier une seule fois et partagées par tous les CPU du
+// processus (les instances d'un même jeu partagent aussi sa ROM, voir
+// rom-cache.h), et libérées quand le dernier CPU qui les utilise les
+// lâche. Seules les pages de RAM sont propres à chaque CPU.
+
+struct cpu_decode_page
 {
-    NZ,
-    Z,
-    NC,
-    C
-} cc_t;
+    const data_t *tag; // memory the page was decoded from
+    uint8_t flags;     // its bus access: BUS_PAGE_READ only for shared pages
+    cpu_decoded_t entry[BUS_PAGE_SIZE];
+    // shared pages only
+    struct cpu_decode_page *next; // in its bucket
+    unsigned refs;                // number of CPUs pointing to it
+    data_t bytes[BUS_PAGE_SIZE];  // content decoded (the memory may be remapped)
+};
+
+// shared pages, by memory (freed when the last CPU pointing to them lets them go)
+#define CPU_SHARED_BUCKETS 1024
+static struct cpu_decode_page *cpu_shared_pages[CPU_SHARED_BUCKETS];
+static pthread_mutex_t cpu_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define cpu_decode_page_shared(page) ((page)->flags == BUS_PAGE_READ)
+#define cpu_shared_bucket(base) (((uintptr_t) (base) >> BUS_PAGE_BITS) % CPU_SHARED_BUCKETS)
+
+/**
+ * @brief Lets go of a shared page got with cpu_decode_shared(),
+ *        freed if no other CPU points to it
+ * @param page, the shared page
+ */
+static void cpu_decode_shared_release(struct cpu_decode_page *page)
+{
+    pthread_mutex_lock(&cpu_shared_lock);
+    if (--page->refs == 0)
+    {
+        struct cpu_decode_page **p = &cpu_shared_pages[cpu_shared_bucket(page->tag)];
+        while (*p != page)
+            p = &(*p)->next;
+        *p = page->next;
+        free(page);
+    }
+    pthread_mutex_unlock(&cpu_shared_lock);
+}
 
 int cpu_init(cpu_t *cpu)
 {
@@ -35,19 +90,27 @@ int cpu_init(cpu_t *cpu)
     cpu->SP = 0u;
     cpu->bus = NULL;
     cpu->F = 0u;
+    cpu->lazy.kind = LAZY_NONE;
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
     cpu->alu.value = 0u;
     cpu->alu.flags = 0u;
-    cpu->write_listener = 0u;
     cpu->IME = 0u;
     cpu->IE = 0u;
     cpu->IF = 0u;
     cpu->HALT = 0u;
+    cpu->bus_locked = 0u;
 
     for (int i = REG_BC_CODE; i <= REG_AF_CODE; ++i)
     {
         cpu_reg_pair_set(cpu, i, 0u);
     }
-    M_EXIT_IF_ERR(component_create(&cpu->high_ram, HIGH_RAM_SIZE));
+    // created when plugged, if the bus has no high RAM
+    memset(&cpu->high_ram, 0, sizeof(cpu->high_ram));
+
+    cpu->decoded = calloc(BUS_NB_PAGES, sizeof(*cpu->decoded));
+    M_EXIT_IF_NULL(cpu->decoded, BUS_NB_PAGES * sizeof(*cpu->decoded));
+
+    M_EXIT_IF_ERR(cpu_jit_create(cpu));
 
     return ERR_NONE;
 }
@@ -58,10 +121,14 @@ int cpu_plug(cpu_t *cpu, bus_t *bus)
     M_REQUIRE_NON_NULL(bus);
 
     cpu->bus = bus;
-    M_EXIT_IF_ERR(bus_plug(*cpu->bus, &cpu->high_ram, HIGH_RAM_START, HIGH_RAM_END));
+    if (bus_at(*cpu->bus, HIGH_RAM_START) == NULL)
+    {
+        M_EXIT_IF_ERR(component_create(&cpu->high_ram, HIGH_RAM_SIZE));
+        M_EXIT_IF_ERR(bus_plug(*cpu->bus, &cpu->high_ram, HIGH_RAM_START, HIGH_RAM_END));
+    }
 
-    (*cpu->bus)[REG_IE] = &cpu->IE;
-    (*cpu->bus)[REG_IF] = &cpu->IF;
+    M_EXIT_IF_ERR(bus_plug_register(*cpu->bus, REG_IE, &cpu->IE));
+    M_EXIT_IF_ERR(bus_plug_register(*cpu->bus, REG_IF, &cpu->IF));
 
     return ERR_NONE;
 }
@@ -70,12 +137,25 @@ void cpu_free(cpu_t *cpu)
 {
     if (cpu != NULL)
     {
-        bus_unplug(*cpu->bus, &cpu->high_ram);
+        if (cpu->bus != NULL)
+        {
+            if (cpu->high_ram.mem != NULL)
+                bus_unplug(*cpu->bus, &cpu->high_ram);
+            bus_plug_register(*cpu->bus, REG_IE, NULL);
+            bus_plug_register(*cpu->bus, REG_IF, NULL);
+        }
         component_free(&cpu->high_ram);
-        //unplug IE and IF
-        //(*cpu->bus)[REG_IE] = NULL;
-        //(*cpu->bus)[REG_IF] = NULL;
-        
+        for (size_t p = 0; cpu->decoded != NULL && p < BUS_NB_PAGES; ++p)
+        {
+            if (cpu->decoded[p] != NULL && cpu_decode_page_shared(cpu->decoded[p]))
+                cpu_decode_shared_release(cpu->decoded[p]);
+            else
+                free(cpu->decoded[p]);
+        }
+        free(cpu->decoded);
+        cpu_jit_free(cpu);
+
+        cpu->decoded = NULL;
         cpu->bus = NULL;
     }
 }
@@ -88,219 +168,621 @@ void cpu_free(cpu_t *cpu)
  */
 int is_condition(flags_t flags, opcode_t opcode)
 {
-    flag_bit_t c = get_C(flags);
-    flag_bit_t z = get_Z(flags);
-    switch (extract_cc(opcode))
+    return cpu_cc_holds(flags, extract_cc(opcode));
+}
+
+static int cpu_run_alu(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    return cpu_dispatch_alu(&d->lu, cpu);
+}
+
+static int cpu_run_storage(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    return cpu_dispatch_storage(&d->lu, cpu);
+}
+
+static int cpu_run_jp_cc(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    if (cpu_cc_holds(cpu_F_get(cpu), d->arg))
     {
-    case NZ:
-        return !z;
-    case Z:
-        return z;
-    case NC:
-        return !c;
-    case C:
-        return c;
-    default:
-        return ERR_BAD_PARAMETER;
+        cpu->PC = d->imm - d->lu.bytes;
+        cpu->idle_time += d->lu.xtra_cycles;
+    }
+    return ERR_NONE;
+}
+
+static int cpu_run_jp_hl(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->PC = cpu->HL - d->lu.bytes;
+    return ERR_NONE;
+}
+
+static int cpu_run_jp(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->PC = d->imm - d->lu.bytes;
+    return ERR_NONE;
+}
+
+static int cpu_run_jr_cc(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    if (cpu_cc_holds(cpu_F_get(cpu), d->arg))
+    {
+        cpu_idle_loop_check(cpu, cpu->PC, (addr_t)(cpu->PC + d->lu.bytes + (signed char)d->imm));
+        cpu->PC += (signed char)d->imm;
+        cpu->idle_time += d->lu.xtra_cycles;
+    }
+    else
+    {
+        cpu->idle_loop.armed = 0;
+    }
+    return ERR_NONE;
+}
+
+static int cpu_run_jr(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->PC += (signed char)d->imm;
+    return ERR_NONE;
+}
+
+static int cpu_run_call_cc(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    if (cpu_cc_holds(cpu_F_get(cpu), d->arg))
+    {
+        M_EXIT_IF_ERR(cpu_SP_push(cpu, cpu->PC + d->lu.bytes));
+        cpu->PC = d->imm - d->lu.bytes;
+        cpu->idle_time += d->lu.xtra_cycles;
+    }
+    return ERR_NONE;
+}
+
+static int cpu_run_call(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    M_EXIT_IF_ERR(cpu_SP_push(cpu, cpu->PC + d->lu.bytes));
+    cpu->PC = d->imm - d->lu.bytes;
+    return ERR_NONE;
+}
+
+static int cpu_run_ret(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->PC = cpu_SP_pop(cpu) - d->lu.bytes;
+    return ERR_NONE;
+}
+
+static int cpu_run_ret_cc(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    if (cpu_cc_holds(cpu_F_get(cpu), d->arg))
+    {
+        cpu->PC = cpu_SP_pop(cpu) - d->lu.bytes;
+        cpu->idle_time += d->lu.xtra_cycles;
     }
+    return ERR_NONE;
 }
 
+static int cpu_run_rst(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    M_EXIT_IF_ERR(cpu_SP_push(cpu, cpu->PC + d->lu.bytes));
+    cpu->PC = (addr_t)((d->arg << 3u) - d->lu.bytes); //n3 * 8
+    return ERR_NONE;
+}
+
+static int cpu_run_edi(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->IME = d->arg;
+    return ERR_NONE;
+}
+
+static int cpu_run_reti(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    cpu->IME = 1;
+    cpu->PC = cpu_SP_pop(cpu) - d->lu.bytes;
+    return ERR_NONE;
+}
+
+static int cpu_run_halt(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    (void)d;
+    cpu->HALT = 1;
+    return ERR_NONE;
+}
+
+static int cpu_run_nop(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    // ne rien faire
+    (void)d;
+    (void)cpu;
+    return ERR_NONE;
+}
+
+static int cpu_run_unknown(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    (void)d;
+    fprintf(stderr, "Unknown instruction, Code: 0x%" PRIX8 "\n", cpu_read_at_idx(cpu, cpu->PC));
+    return ERR_INSTR;
+}
+
+// immediate operands of an instruction, from its bytes
+#define cpu_decode_n8(bytes)  ((bytes)[1])
+#define cpu_decode_n16(bytes) merge8((bytes)[1], (bytes)[2])
+
 /**
- * @brief Executes an instruction
+ * @brief Decodes an instruction
  * @param lu instruction
- * @param cpu, the CPU which shall execute
+ * @param bytes, the lu->bytes bytes of the instruction
+ * @param d (output), the decoded instruction
  * @return error code
- *
- * See opcode.h and cpu.h
  */
-static int cpu_dispatch(const instruction_t *lu, cpu_t *cpu)
+int cpu_decode(const instruction_t *lu, const data_t *bytes, cpu_decoded_t *d)
 {
     M_REQUIRE_NON_NULL(lu);
-    M_REQUIRE_NON_NULL(cpu);
+    M_REQUIRE_NON_NULL(bytes);
+    M_REQUIRE_NON_NULL(d);
 
-    //remet à 0 l'ALU du CPU
-    cpu->alu.value = 0u;
-    cpu->alu.flags = 0u;
+    d->lu = *lu;
+    d->imm = 0;
+    d->arg = 0;
 
-    //recupere les adresse interessante pour le PC
-    addr_t next_PC = cpu->PC + lu->bytes;
-
-    //exécution de l'instruction reçue
     switch (lu->family)
     {
 
     // ALU
-    case ADD_A_HLR:
-    case ADD_A_N8:
-    case ADD_A_R8:
-    case INC_HLR:
-    case INC_R8:
-    case ADD_HL_R16SP:
-    case INC_R16SP:
-    case SUB_A_HLR:
-    case SUB_A_N8:
-    case SUB_A_R8:
-    case DEC_HLR:
-    case DEC_R8:
-    case DEC_R16SP:
-    case AND_A_HLR:
-    case AND_A_N8:
-    case AND_A_R8:
-    case OR_A_HLR:
-    case OR_A_N8:
-    case OR_A_R8:
-    case XOR_A_HLR:
-    case XOR_A_N8:
-    case XOR_A_R8:
-    case CPL:
-    case CP_A_HLR:
-    case CP_A_N8:
-    case CP_A_R8:
-    case SLA_HLR:
-    case SLA_R8:
-    case SRA_HLR:
-    case SRA_R8:
-    case SRL_HLR:
-    case SRL_R8:
-    case ROTCA:
-    case ROTA:
-    case ROTC_HLR:
-    case ROT_HLR:
-    case ROTC_R8:
-    case ROT_R8:
-    case SWAP_HLR:
-    case SWAP_R8:
-    case BIT_U3_HLR:
-    case BIT_U3_R8:
-    case CHG_U3_HLR:
-    case CHG_U3_R8:
-    case LD_HLSP_S8:
-    case DAA:
-    case SCCF:
-        M_EXIT_IF_ERR(cpu_dispatch_alu(lu, cpu));
+    CPU_CASE_ALU_FAMILIES:
+        d->run = cpu_run_alu;
         break;
 
     // STORAGE
-    case LD_A_BCR:
-    case LD_A_CR:
-    case LD_A_DER:
-    case LD_A_HLRU:
-    case LD_A_N16R:
-    case LD_A_N8R:
-    case LD_BCR_A:
-    case LD_CR_A:
-    case LD_DER_A:
-    case LD_HLRU_A:
-    case LD_HLR_N8:
-    case LD_HLR_R8:
-    case LD_N16R_A:
-    case LD_N16R_SP:
-    case LD_N8R_A:
-    case LD_R16SP_N16:
-    case LD_R8_HLR:
-    case LD_R8_N8:
-    case LD_R8_R8:
-    case LD_SP_HL:
-    case POP_R16:
-    case PUSH_R16:
-        M_EXIT_IF_ERR(cpu_dispatch_storage(lu, cpu));
+    CPU_CASE_STORAGE_FAMILIES:
+        d->run = cpu_run_storage;
         break;
 
     // JUMP
     case JP_CC_N16:
-        if (is_condition(cpu->F, lu->opcode))
-        {
-            cpu->PC = cpu_read_addr_after_opcode(cpu) - lu->bytes;
-            cpu->idle_time += lu->xtra_cycles;
-        }
+        d->run = cpu_run_jp_cc;
+        d->imm = cpu_decode_n16(bytes);
+        d->arg = extract_cc(lu->opcode);
         break;
 
     case JP_HL:
-        cpu->PC = cpu->HL - lu->bytes;
+        d->run = cpu_run_jp_hl;
         break;
 
     case JP_N16:
-        cpu->PC = cpu_read_addr_after_opcode(cpu) - lu->bytes;
+        d->run = cpu_run_jp;
+        d->imm = cpu_decode_n16(bytes);
         break;
 
     case JR_CC_E8:
-        if (is_condition(cpu->F, lu->opcode))
-        {
-            cpu->PC += (signed char)cpu_read_data_after_opcode(cpu);
-            cpu->idle_time += lu->xtra_cycles;
-        }
+        d->run = cpu_run_jr_cc;
+        d->imm = cpu_decode_n8(bytes);
+        d->arg = extract_cc(lu->opcode);
         break;
 
     case JR_E8:
-        cpu->PC += (signed char)cpu_read_data_after_opcode(cpu);
+        d->run = cpu_run_jr;
+        d->imm = cpu_decode_n8(bytes);
         break;
 
     // CALLS
     case CALL_CC_N16:
-        if (is_condition(cpu->F, lu->opcode))
-        {
-            M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
-            cpu->PC = cpu_read_addr_after_opcode(cpu) - lu->bytes;
-            cpu->idle_time += lu->xtra_cycles;
-        }
+        d->run = cpu_run_call_cc;
+        d->imm = cpu_decode_n16(bytes);
+        d->arg = extract_cc(lu->opcode);
         break;
 
     case CALL_N16:
-        M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
-        cpu->PC = cpu_read_addr_after_opcode(cpu) - lu->bytes;
+        d->run = cpu_run_call;
+        d->imm = cpu_decode_n16(bytes);
         break;
 
     // RETURN (from call)
     case RET:
-        cpu->PC = cpu_SP_pop(cpu) - lu->bytes;
+        d->run = cpu_run_ret;
         break;
 
     case RET_CC:
-        if (is_condition(cpu->F, lu->opcode))
-        {
-            cpu->PC = cpu_SP_pop(cpu) - lu->bytes;
-            cpu->idle_time += lu->xtra_cycles;
-        }
+        d->run = cpu_run_ret_cc;
+        d->arg = extract_cc(lu->opcode);
         break;
 
     case RST_U3:
-        M_EXIT_IF_ERR(cpu_SP_push(cpu, next_PC));
-        cpu->PC = (extract_n3(lu->opcode) << 3u) - lu->bytes; //n3 * 8
+        d->run = cpu_run_rst;
+        d->arg = extract_n3(lu->opcode);
         break;
 
     // INTERRUPT & MISC.
     case EDI:
-        cpu->IME = extract_ime(lu->opcode);
+        d->run = cpu_run_edi;
+        d->arg = extract_ime(lu->opcode);
         break;
 
     case RETI:
-        cpu->IME = 1;
-        cpu->PC = cpu_SP_pop(cpu) - lu->bytes;
+        d->run = cpu_run_reti;
         break;
 
     case HALT:
-        cpu->HALT = 1;
+        d->run = cpu_run_halt;
         break;
 
     case STOP:
     case NOP:
-        // ne rien faire
+        d->run = cpu_run_nop;
         break;
 
     default:
-    {
-        fprintf(stderr, "Unknown instruction, Code: 0x%" PRIX8 "\n", cpu_read_at_idx(cpu, cpu->PC));
-        return ERR_INSTR;
-    }
-    break;
+        d->run = cpu_run_unknown;
+        break;
 
     } // switch
 
+    return ERR_NONE;
+}
+
+/**
+ * @brief Runs a decoded instruction
+ * @param d, the decoded instruction
+ * @param cpu, the CPU which shall execute
+ * @return error code
+ */
+static inline int cpu_run(const cpu_decoded_t *d, cpu_t *cpu)
+{
+    //remet à 0 l'ALU du CPU
+    cpu->alu.value = 0u;
+    cpu->alu.flags = 0u;
+
+    M_EXIT_IF_ERR(d->run(d, cpu));
+
     //met à jour l'idle time et le PC
-    cpu->PC += lu->bytes;
-    cpu->idle_time += lu->cycles - 1;
+    cpu->PC += d->lu.bytes;
+    cpu->idle_time += d->lu.cycles - 1;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the bytes of the instruction at PC from the bus
+ * @param cpu, the CPU which shall execute it
+ * @param lu, the instruction
+ * @param bytes (output), its lu->bytes bytes
+ */
+static void cpu_read_instruction(const cpu_t *cpu, const instruction_t *lu, data_t *bytes)
+{
+    for (addr_t i = 1; i < lu->bytes && i < CPU_INSTR_MAX_BYTES; ++i)
+    {
+        bytes[i] = cpu_read_at_idx(cpu, (addr_t)(cpu->PC + i));
+    }
+}
+
+/**
+ * @brief Executes an instruction
+ * @param lu instruction
+ * @param cpu, the CPU which shall execute
+ * @return error code
+ *
+ * See opcode.h and cpu.h
+ */
+int cpu_dispatch(const instruction_t *lu, cpu_t *cpu)
+{
+    M_REQUIRE_NON_NULL(lu);
+    M_REQUIRE_NON_NULL(cpu);
+
+    data_t bytes[CPU_INSTR_MAX_BYTES] = {0};
+    cpu_read_instruction(cpu, lu, bytes);
+    cpu_decoded_t d;
+    M_EXIT_IF_ERR(cpu_decode(lu, bytes, &d));
+    M_EXIT_IF_ERR(cpu_run(&d, cpu));
+
+    // one instruction at a time: the caller looks at F
+    cpu_flags_sync(cpu);
+    return ERR_NONE;
+}
+
+/**
+ * @brief Tells whether instructions at the given address may be cached
+ *
+ * Echo RAM aliases work RAM: writes through one would not invalidate
+ * the other, so it is always decoded on the fly.
+ */
+static inline int cpu_decode_cacheable(addr_t addr)
+{
+    return addr < ECHO_RAM_START || addr > ECHO_RAM_END;
+}
+
+#ifndef CPU_THREADED
+/**
+ * @brief Looks up the instruction of some bytes
+ */
+static inline const instruction_t *cpu_instruction_of(const data_t *bytes)
+{
+    return bytes[0] == PREFIXED ? &instruction_prefixed[bytes[1]] : &instruction_direct[bytes[0]];
+}
+
+/**
+ * @brief Gets the shared, fully decoded, page of some read-only memory
+ *        (to give back with cpu_decode_shared_release())
+ * @param base, the memory of the page
+ * @param page (output), the decoded page
+ * @return error code
+ */
+static int cpu_decode_shared(const data_t *base, struct cpu_decode_page **page)
+{
+    const size_t bucket = cpu_shared_bucket(base);
+    int err = ERR_NONE;
+
+    pthread_mutex_lock(&cpu_shared_lock);
+    struct cpu_decode_page *p = cpu_shared_pages[bucket];
+    while (p != NULL && (p->tag != base || memcmp(p->bytes, base, BUS_PAGE_SIZE) != 0))
+        p = p->next;
+
+    if (p == NULL && (p = calloc(1, sizeof(*p))) == NULL)
+        err = ERR_MEM;
+    else if (p->tag == NULL)
+    {
+        p->tag = base;
+        p->flags = BUS_PAGE_READ;
+        memcpy(p->bytes, base, BUS_PAGE_SIZE);
+
+        // instructions straddling two pages are never cached
+        for (size_t a = 0; a < BUS_PAGE_SIZE && err == ERR_NONE; ++a)
+        {
+            if (p->bytes[a] == PREFIXED && a + 1 >= BUS_PAGE_SIZE)
+                break;
+            const instruction_t *lu = cpu_instruction_of(&p->bytes[a]);
+            if (a + lu->bytes <= BUS_PAGE_SIZE)
+                err = cpu_decode(lu, &p->bytes[a], &p->entry[a]);
+        }
+
+        if (err == ERR_NONE)
+        {
+            p->next = cpu_shared_pages[bucket];
+            cpu_shared_pages[bucket] = p;
+        }
+        else
+        {
+            free(p);
+        }
+    }
+    if (err == ERR_NONE)
+    {
+        ++p->refs;
+        *page = p;
+    }
+    pthread_mutex_unlock(&cpu_shared_lock);
+
+    return err;
+}
+
+/**
+ * @brief Points the cache of a page to what is now mapped there
+ * @param cpu, the CPU
+ * @param index, the page index
+ * @param mapped, the bus page
+ * @return error code
+ */
+static int cpu_decode_remap(cpu_t *cpu, size_t index, const bus_page_t *mapped)
+{
+    struct cpu_decode_page *cache = cpu->decoded[index];
+    const bit_t was_shared = cache != NULL && cpu_decode_page_shared(cache);
+
+    if (mapped->flags == BUS_PAGE_READ)
+    {
+        M_EXIT_IF_ERR(cpu_decode_shared(mapped->base, &cpu->decoded[index]));
+        if (was_shared)
+            cpu_decode_shared_release(cache);
+        else
+            free(cache);
+        return ERR_NONE;
+    }
+
+    // RAM: a page of its own, decoded as it runs
+    if (cache == NULL || was_shared)
+    {
+        struct cpu_decode_page *own = malloc(sizeof(*own));
+        M_EXIT_IF_NULL(own, sizeof(*own));
+        if (was_shared)
+            cpu_decode_shared_release(cache);
+        cache = own;
+        cpu->decoded[index] = cache;
+    }
+    memset(cache->entry, 0, sizeof(cache->entry));
+    cache->tag = mapped->base;
+    cache->flags = mapped->flags;
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Fetches the decoded instruction at PC, decoding it if needed
+ * @param cpu, the CPU which shall run
+ * @param scratch, where to decode instructions that cannot be cached
+ * @param d (output), the instruction to run
+ * @return error code
+ */
+static int cpu_fetch(cpu_t *cpu, cpu_decoded_t *scratch, const cpu_decoded_t **d)
+{
+    const addr_t pc = cpu->PC;
+    const size_t index = pc >> BUS_PAGE_BITS;
+    const bus_page_t *page = &(*cpu->bus)[index];
+    cpu_decoded_t *slot = NULL;
+
+    // only contiguous readable pages have a stable identity to tag the cache with
+    // (and the bus gives nothing but 0xFF to a CPU locked out of it)
+    if (cpu->decoded != NULL && page->base != NULL && (page->flags & BUS_PAGE_READ) && cpu_decode_cacheable(pc)
+        && !cpu->bus_locked)
+    {
+        struct cpu_decode_page *cache = cpu->decoded[index];
+        if (cache == NULL || cache->tag != page->base || cache->flags != page->flags)
+        {
+            M_EXIT_IF_ERR(cpu_decode_remap(cpu, index, page));
+            cache = cpu->decoded[index];
+        }
+
+        slot = &cache->entry[pc & (BUS_PAGE_SIZE - 1)];
+        if (slot->run != NULL)
+        {
+            *d = slot;
+            return ERR_NONE;
+        }
+        // shared pages are complete (and never written)
+        if (cpu_decode_page_shared(cache))
+            slot = NULL;
+    }
+
+    data_t bytes[CPU_INSTR_MAX_BYTES] = {cpu_read_at_idx(cpu, pc)};
+    if (bytes[0] == PREFIXED)
+        bytes[1] = cpu_read_data_after_opcode(cpu);
+    const instruction_t *lu = cpu_instruction_of(bytes);
+    cpu_read_instruction(cpu, lu, bytes);
+    M_EXIT_IF_ERR(cpu_decode(lu, bytes, scratch));
+
+    // instructions straddling two pages are never cached
+    if (slot != NULL && (pc & (BUS_PAGE_SIZE - 1)) + lu->bytes <= BUS_PAGE_SIZE)
+    {
+        *slot = *scratch;
+        *d = slot;
+    }
+    else
+    {
+        *d = scratch;
+    }
+
     return ERR_NONE;
 }
+#endif
+
+void cpu_decode_invalidate(cpu_t *cpu, addr_t addr)
+{
+    if (cpu == NULL || cpu->decoded == NULL)
+        return;
+
+    cpu_jit_invalidate(cpu, addr);
+
+    // every instruction overlapping addr starts at most CPU_INSTR_MAX_BYTES - 1 bytes before
+    for (int k = 0; k < CPU_INSTR_MAX_BYTES; ++k)
+    {
+        const addr_t a = (addr_t)(addr - k);
+        struct cpu_decode_page *cache = cpu->decoded[a >> BUS_PAGE_BITS];
+        // shared pages are read-only: the write is lost
+        if (cache != NULL && !cpu_decode_page_shared(cache))
+            cache->entry[a & (BUS_PAGE_SIZE - 1)].run = NULL;
+    }
+
+    // echo RAM is never cached, but writing through it modifies work RAM
+    if (addr >= ECHO_RAM_START && addr <= ECHO_RAM_END)
+        cpu_decode_invalidate(cpu, (addr_t)(addr - ECHO_RAM_START + WORK_RAM_START));
+}
+
+// ======================================================================
+// Polling loops
+//
+// Une boucle d'attente typique lit un registre d'I/O, le teste et
+// recommence : `ld a,(ff44) ; cp n ; jr nz`. Tant que les registres lus ne
+// changent pas (c.-à-d. jusqu'au prochain événement), chaque itération
+// refait exactement la même chose ; gameboy_cpu_step() peut alors sauter
+// directement à cet événement.
+
+/**
+ * @brief Tells whether a polling loop may read the given address
+ *
+ * I/O registers only change with scheduled events, high RAM and IE only
+ * with CPU writes (that is, interrupt handlers). The timer registers
+ * change on their own.
+ */
+static inline int cpu_idle_pollable(addr_t addr)
+{
+    return addr >= REGISTERS_START && (addr < REG_DIV || addr > REG_TAC);
+}
+
+/**
+ * @brief Computes the cycles of one iteration of a loop, if it only polls
+ * @param cpu, the CPU running the loop
+ * @param from, first instruction of the loop
+ * @param jr, the JR closing the loop
+ * @return cycles per iteration (jump included), 0 if the loop is not a polling loop
+ */
+static uint8_t cpu_idle_loop_period(const cpu_t *cpu, addr_t from, addr_t jr)
+{
+    unsigned cycles = 0;
+    addr_t pc = from;
+
+    // only instructions that read pollable registers and write A or F
+    while (pc < jr)
+    {
+        data_t op = 0;
+        bus_read(*cpu->bus, pc, &op);
+        const instruction_t *lu = &instruction_direct[op];
+        if (op == PREFIXED)
+        {
+            bus_read(*cpu->bus, (addr_t)(pc + 1), &op);
+            lu = &instruction_prefixed[op];
+        }
+
+        data_t n8 = 0;
+        addr_t n16 = 0;
+        switch (lu->family)
+        {
+        case LD_A_N8R:
+            bus_read(*cpu->bus, (addr_t)(pc + 1), &n8);
+            if (!cpu_idle_pollable((addr_t)(REGISTERS_START + n8)))
+                return 0;
+            break;
+
+        case LD_A_N16R:
+            bus_read16(*cpu->bus, (addr_t)(pc + 1), &n16);
+            if (!cpu_idle_pollable(n16))
+                return 0;
+            break;
+
+        case NOP:
+        case CP_A_N8:
+        case CP_A_R8:
+        case AND_A_N8:
+        case AND_A_R8:
+        case OR_A_R8:
+        case BIT_U3_R8:
+            break;
+
+        default:
+            return 0;
+        }
+
+        cycles += lu->cycles;
+        pc = (addr_t)(pc + lu->bytes);
+    }
+
+    if (pc != jr)
+        return 0;
+
+    data_t op = 0;
+    bus_read(*cpu->bus, jr, &op);
+    const instruction_t *lu = &instruction_direct[op];
+    return (uint8_t)(cycles + lu->cycles + lu->xtra_cycles);
+}
+
+void cpu_idle_loop_check(cpu_t *cpu, addr_t jr, addr_t target)
+{
+    cpu_idle_loop_t *loop = &cpu->idle_loop;
+
+    // only short backward jumps
+    if (target > jr || jr - target > CPU_IDLE_MAX_BODY)
+    {
+        loop->armed = 0;
+        return;
+    }
+
+    if (jr != loop->jr)
+    {
+        loop->jr = jr;
+        loop->period = cpu_idle_loop_period(cpu, target, jr);
+        loop->armed = 0;
+    }
+
+    // one whole iteration left A and F unchanged: the loop is spinning
+    // (the code is checked again, it may have been remapped meanwhile)
+    const uint16_t AF = cpu_reg_pair_get(cpu, REG_AF_CODE);
+    if (loop->armed && loop->period != 0 && AF == loop->AF)
+        loop->cycles = cpu_idle_loop_period(cpu, target, jr);
+
+    loop->AF = AF;
+    loop->armed = 1;
+}
 
 /**
  * @brief 
@@ -322,7 +804,7 @@ interrupt_t get_interrupt_number(uint8_t active_interrupt)
 }
 
 /**
- * @brief Obtains the next instruction to execute and calls cpu_dispatch()
+ * @brief Obtains the next instruction to execute and runs it
  * 
  * @param cpu, the CPU which shall run
  * 
@@ -336,6 +818,7 @@ static int cpu_do_cycle(cpu_t *cpu)
     if (cpu->IME && (active_interrupts))
     {
         cpu->IME = 0;
+        cpu->idle_loop.armed = 0;
         interrupt_t interrupt_to_handle = get_interrupt_number(active_interrupts);
     
         bit_unset(&cpu->IF, interrupt_to_handle);
@@ -346,9 +829,14 @@ static int cpu_do_cycle(cpu_t *cpu)
     
     while (cpu->idle_time > 0) cpu->idle_time--;
 
-    data_t byte_at_PC = cpu_read_at_idx(cpu, cpu->PC);
-    instruction_t instruction = byte_at_PC == PREFIXED ? instruction_prefixed[cpu_read_data_after_opcode(cpu)] : instruction_direct[byte_at_PC];
-    M_EXIT_IF_ERR(cpu_dispatch(&instruction, cpu));
+#ifdef CPU_THREADED
+    M_EXIT_IF_ERR(cpu_threaded_exec(cpu));
+#else
+    cpu_decoded_t scratch;
+    const cpu_decoded_t *instruction = NULL;
+    M_EXIT_IF_ERR(cpu_fetch(cpu, &scratch, &instruction));
+    M_EXIT_IF_ERR(cpu_run(instruction, cpu));
+#endif
 
     return ERR_NONE;
 }
@@ -357,8 +845,7 @@ int cpu_cycle(cpu_t *cpu)
 {
     M_REQUIRE_NON_NULL(cpu);
 
-    cpu->write_listener = 0;
-
+    cpu->idle_loop.cycles = 0;
     if (cpu->idle_time > 0u)
     {
         cpu->idle_time--;
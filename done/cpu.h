@@ -14,6 +14,7 @@ extern "C" {
 
 #include "alu.h"
 #include "bus.h"
+#include "opcode.h"
 
 //=========================================================================
 /**
@@ -29,6 +30,9 @@ typedef enum {
 #define HIGH_RAM_START   0xFF80
 #define HIGH_RAM_END     0xFFFE
 #define HIGH_RAM_SIZE ((HIGH_RAM_END - HIGH_RAM_START)+1)
+// first address the CPU still reaches while an OAM DMA holds the bus
+// (I/O registers, high RAM and IE)
+#define CPU_BUS_LOCK_FREE_START 0xFF00
 // Initialise la structure des pairs de registres
 #define REG_PAIR_INIT(X, Y) \
     union {                 \
@@ -40,6 +44,33 @@ typedef enum {
         uint16_t X##Y;      \
     }
 
+//=========================================================================
+/**
+ * @brief Last flag-setting operation whose flags are not in F yet
+ *        (lazy flags mode, see cpu_flags_sync() in cpu-alu.h)
+ */
+typedef struct {
+    uint8_t kind; // cpu_lazy_op_t, LAZY_NONE when F is up to date
+    uint8_t x;    // first operand
+    uint8_t y;    // second operand
+    uint8_t c;    // carry (borrow) in, or the C flag kept by INC/DEC
+} cpu_lazy_flags_t;
+
+// longest polling loop body looked at, in bytes (JR excluded)
+#define CPU_IDLE_MAX_BODY 16
+
+//=========================================================================
+/**
+ * @brief Polling loop detection, see cpu_idle_loop_check()
+ */
+typedef struct {
+    uint16_t jr;    // address of the last short backward JR taken
+    uint16_t AF;    // AF when it was taken
+    uint8_t period; // cycles per iteration of the loop it closes, 0 if it is not a polling loop
+    bit_t armed;    // the CPU ran straight from that JR back to it
+    uint8_t cycles; // set by the last instruction if the CPU spins in a polling loop: cycles per iteration
+} cpu_idle_loop_t;
+
 //=========================================================================
 /**
  * @brief Type to represent CPU
@@ -58,9 +89,13 @@ typedef struct{
     uint8_t IE;
     uint8_t IF;
     bit_t HALT;
-    component_t high_ram;
-    addr_t write_listener;
+    bit_t bus_locked;     // an OAM DMA holds the bus: below CPU_BUS_LOCK_FREE_START, reads give 0xFF and writes are lost
+    component_t high_ram; // own high RAM, when the bus has none (see cpu_plug())
     uint8_t idle_time;
+    struct cpu_decode_page** decoded; // pre-decoded instructions, one block per bus page (ROM ones are shared)
+    struct cpu_jit* jit;             // translated code, NULL unless built with CPU_JIT
+    cpu_lazy_flags_t lazy;           // pending flags (lazy flags mode only)
+    cpu_idle_loop_t idle_loop;       // polling loop detection
 
 } cpu_t;
 
@@ -75,7 +110,19 @@ int cpu_cycle(cpu_t* cpu);
 
 
 /**
- * @brief Plugs a bus into the cpu
+ * @brief Executes an instruction, without going through the decoding cache
+ *        (the cores run pre-decoded instructions; this is for the tests)
+ *
+ * @param lu instruction
+ * @param cpu (modified), the CPU which shall execute it
+ * @return error code
+ */
+int cpu_dispatch(const instruction_t* lu, cpu_t* cpu);
+
+
+/**
+ * @brief Plugs a bus into the cpu, with IE and IF. The cpu plugs its own
+ *        high RAM unless the bus already has one (the Game Boy memory).
  *
  * @param cpu cpu to plug into
  * @param bus bus to plug
@@ -109,6 +156,31 @@ void cpu_free(cpu_t* cpu);
 void cpu_request_interrupt(cpu_t* cpu, interrupt_t i);
 
 
+/**
+ * @brief Drops the pre-decoded instructions overlapping an address
+ *        (to be called whenever the memory at addr is modified)
+ *
+ * @param cpu cpu whose decoding cache is concerned
+ * @param addr modified address
+ */
+void cpu_decode_invalidate(cpu_t* cpu, addr_t addr);
+
+
+/**
+ * @brief Looks for a polling loop closed by a taken JR (called by the CPU cores)
+ *
+ * A polling loop only reads I/O registers into A and tests them before
+ * jumping back: as long as the registers it reads keep their value, all
+ * its iterations do exactly the same. When the CPU spins in one,
+ * cpu->idle_loop.cycles is set to the cycles of one iteration.
+ *
+ * @param cpu cpu which took the jump
+ * @param jr address of the JR
+ * @param target address jumped to
+ */
+void cpu_idle_loop_check(cpu_t* cpu, addr_t jr, addr_t target);
+
+
 #ifdef __cplusplus
 }
 #endif
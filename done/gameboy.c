@@ -10,54 +10,293 @@
 #include "error.h"
 #include "bootrom.h"
 #include "cpu-storage.h"
+#include "cpu-jit.h"
+#include "scheduler.h"
 
 #ifdef BLARGG
-static int blargg_bus_listener(gameboy_t *gameboy, addr_t addr)
+static int blargg_bus_listener(void *obj, addr_t addr, data_t data)
 {
-    M_REQUIRE_NON_NULL(gameboy);
+    (void)addr;
+    M_REQUIRE_NON_NULL(obj);
 
-    if (addr == BLARGG_REG)
-        printf("%c", cpu_read_at_idx(&gameboy->cpu, addr));
+    printf("%c", data);
 
     return ERR_NONE;
 }
 #endif
 
+/**
+ * @brief Runs the timer up to the given cycle (included)
+ */
+static int gameboy_timer_sync(gameboy_t *gameboy, uint64_t cycle)
+{
+    if (gameboy->timer_cycles <= cycle)
+    {
+        M_EXIT_IF_ERR(timer_advance(&gameboy->timer, cycle + 1 - gameboy->timer_cycles));
+        gameboy->timer_cycles = cycle + 1;
+    }
+    return ERR_NONE;
+}
+
 // ----------------------------------------------------------------------
+// I/O registers side effects, run on CPU accesses only
+
+static int gameboy_timer_read(void *obj, addr_t addr, data_t data)
+{
+    (void)addr;
+    (void)data;
+    gameboy_t *gameboy = obj;
+    // DIV and TIMA are only brought up to date when the CPU reads them
+    M_EXIT_IF_ERR(gameboy_timer_sync(gameboy, gameboy->cycles));
+    return timer_bus_update(&gameboy->timer);
+}
+
+static int gameboy_timer_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    gameboy_t *gameboy = obj;
+    // the write applies after the cycles already run, and moves the next overflow
+    M_EXIT_IF_ERR(gameboy_timer_sync(gameboy, gameboy->cycles));
+    gameboy->reschedule = 1;
+    return timer_bus_listener(&gameboy->timer, addr);
+}
+
+static int gameboy_bootrom_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    return bootrom_bus_listener(obj, addr);
+}
+
+static int gameboy_lcdc_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    gameboy_t *gameboy = obj;
+    // the LCDC may have to be rescheduled before the CPU goes on
+    gameboy->reschedule = 1;
+    return lcdc_bus_listener(&gameboy->screen, addr);
+}
+
+static int gameboy_dma_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    gameboy_t *gameboy = obj;
+    M_EXIT_IF_ERR(lcdc_bus_listener(&gameboy->screen, addr));
+
+    // the whole transfer is done when it ends; until then only
+    // I/O registers and high RAM answer the CPU
+    gameboy->cpu.bus_locked = 1;
+    gameboy->reschedule = 1;
+    return scheduler_post(&gameboy->scheduler, SCHED_DMA, gameboy->cycles + DMA_CYCLES);
+}
+
+static int gameboy_vram_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    return lcdc_vram_write(&((gameboy_t *)obj)->screen, addr);
+}
+
+static int gameboy_oam_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    return lcdc_oam_write(&((gameboy_t *)obj)->screen, addr);
+}
+
+static int gameboy_joypad_write(void *obj, addr_t addr, data_t data)
+{
+    (void)data;
+    return joypad_bus_listener(&((gameboy_t *)obj)->pad, addr);
+}
+
+static const struct {
+    addr_t addr;
+    bus_handler_t on_read;
+    bus_handler_t on_write;
+} gameboy_mmio[] = {
+    { REG_P1,               NULL,               gameboy_joypad_write },
+#ifdef BLARGG
+    { BLARGG_REG,           NULL,               blargg_bus_listener },
+#endif
+    { REG_DIV,              gameboy_timer_read, gameboy_timer_write },
+    { REG_TIMA,             gameboy_timer_read, gameboy_timer_write },
+    { REG_TMA,              NULL,               gameboy_timer_write },
+    { REG_TAC,              NULL,               gameboy_timer_write },
+    { REG_LCDC,             NULL,               gameboy_lcdc_write },
+    { REG_LYC,              NULL,               gameboy_lcdc_write },
+    { REG_DMA,              NULL,               gameboy_dma_write },
+    { REG_BOOT_ROM_DISABLE, NULL,               gameboy_bootrom_write },
+};
+
+#define GB_NB_MMIO (sizeof(gameboy_mmio) / sizeof(gameboy_mmio[0]))
+
+/**
+ * @brief Called by the translated code before the instructions which may
+ *        access the bus: the timer registers handlers need their cycle
+ */
+static int gameboy_jit_sync(void *obj, uint64_t cycle)
+{
+    ((gameboy_t *)obj)->cycles = cycle;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Posts the next timer deadline: the cycle at which it requests
+ *        an interrupt (a halted CPU sleeps until then at the latest)
+ */
+static int gameboy_schedule_timer(gameboy_t *gameboy)
+{
+    const uint64_t to_timer = timer_cycles_to_event(&gameboy->timer);
+
+    return scheduler_post(&gameboy->scheduler, SCHED_TIMER,
+                          to_timer == UINT64_MAX ? SCHED_NEVER : gameboy->timer_cycles + to_timer - 1);
+}
+
+/**
+ * @brief Posts the next LCDC deadline, from cycle on
+ */
+static int gameboy_schedule_lcdc(gameboy_t *gameboy, uint64_t cycle)
+{
+    const lcdc_t *lcd = &gameboy->screen;
+    uint64_t lcdc_next = lcd->next_cycle;
+    if (lcdc_next == UINT64_MAX && (cpu_read_at_idx(&gameboy->cpu, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK))
+    {
+        // écran allumé mais pas encore démarré
+        lcdc_next = cycle;
+    }
+
+    return scheduler_post(&gameboy->scheduler, SCHED_LCDC, lcdc_next);
+}
+
 /**
- * @brief init the specified X component of the gameboy 
+ * @brief Wakes up a halted CPU as soon as an interrupt is pending
+ */
+static int gameboy_wake_cpu(gameboy_t *gameboy, uint64_t cycle)
+{
+    if (gameboy->scheduler.deadline[SCHED_CPU] == SCHED_NEVER && (gameboy->cpu.IF & gameboy->cpu.IE))
+        M_EXIT_IF_ERR(scheduler_post(&gameboy->scheduler, SCHED_CPU, cycle));
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Runs the CPU from the given cycle on, instruction after instruction
+ *        (the idle cycles in between being skipped), as long as no other
+ *        component has something to do, then posts its next cycle
+ *
+ * The LCDC only acts on its own events and the timer is only synced when
+ * the CPU accesses its registers or when it requests an interrupt, so the
+ * CPU may run up to the next LCDC, timer or OAM DMA event unless it
+ * changes the registers of one of them.
+ *
+ * When the CPU spins in a polling loop (see cpu_idle_loop_check()) and
+ * its last iteration ran after the previous event, the iterations which
+ * end before the next event are not run; their cycles are counted in
+ * gameboy->idle_skipped.
+ *
+ * @param gameboy the Game Boy
+ * @param cycle first cycle to run
+ * @param until first cycle not to be run (end of the caller's slice)
+ * @param last (output) last cycle run
+ * @return error code
  */
-#define INIT_COMPONENT(X, i)                                           \
-    do                                                                 \
-    {                                                                  \
-        component_t c;                                                 \
-        M_EXIT_IF_ERR(component_create(&c, MEM_SIZE(X)));              \
-        gameboy->components[i] = c;                                    \
-        M_EXIT_IF_ERR(bus_plug(gameboy->bus, &c, X##_START, X##_END)); \
+static int gameboy_cpu_step(gameboy_t *gameboy, uint64_t cycle, uint64_t until, uint64_t *last)
+{
+    cpu_t *cpu = &gameboy->cpu;
+    const uint64_t lcdc_next = gameboy->scheduler.deadline[SCHED_LCDC];
+    const uint64_t timer_next = gameboy->scheduler.deadline[SCHED_TIMER];
+    const uint64_t dma_next = gameboy->scheduler.deadline[SCHED_DMA];
+    uint64_t stop = lcdc_next < until ? lcdc_next : until;
+    stop = timer_next < stop ? timer_next : stop;
+    stop = dma_next < stop ? dma_next : stop;
+    const uint64_t first = cycle; // no event since then
+    uint64_t next = cycle;
+
+    gameboy->reschedule = 0;
+    do
+    {
+        cycle = next;
+
+        // the timer registers handlers need the current cycle
+        gameboy->cycles = cycle;
+        cpu->idle_time = 0;
+        // runs a whole block when it is translated (see cpu-jit.h)
+        M_EXIT_IF_ERR(cpu_jit_cycle(cpu, &cycle, stop, &gameboy->reschedule));
+
+        next = cycle + cpu->idle_time + 1;
+        if (cpu->idle_loop.cycles != 0 && next >= first + cpu->idle_loop.cycles && next < stop)
+        {
+            // the last iteration read registers that do not change before the next
+            // event: skip the iterations that would end before it
+            const uint64_t skipped = (stop - next) / cpu->idle_loop.cycles * cpu->idle_loop.cycles;
+            next += skipped;
+            gameboy->idle_skipped += skipped;
+        }
+        if (cpu->HALT && cpu->idle_time == 0 && !(cpu->IF & cpu->IE))
+        {
+            // sleeps until an interrupt is requested
+            next = SCHED_NEVER;
+        }
+    } while (next < stop && !gameboy->reschedule);
+
+    *last = cycle;
+    M_EXIT_IF_ERR(scheduler_post(&gameboy->scheduler, SCHED_CPU, next));
+
+    // the CPU may have written to the timer or LCDC registers
+    M_EXIT_IF_ERR(gameboy_schedule_timer(gameboy));
+    return gameboy_schedule_lcdc(gameboy, cycle + 1);
+}
+
+// ----------------------------------------------------------------------
+/**
+ * @brief init the specified X component of the gameboy, on its area
+ *        of the gameboy memory
+ */
+#define INIT_COMPONENT(X, area, i)                                              \
+    do                                                                          \
+    {                                                                           \
+        const int k = (i);                                                      \
+        gameboy->areas[k].memory = gameboy->memory->area;                       \
+        gameboy->areas[k].size = sizeof(gameboy->memory->area);                 \
+        gameboy->areas[k].read_only = false;                                    \
+        component_t c = {&gameboy->areas[k], 0, 0};                             \
+        M_EXIT_IF_ERR(bus_plug(gameboy->bus, &c, X##_START, X##_END));          \
+        gameboy->components[k] = c;                                             \
     } while (0)
 
-int gameboy_create(gameboy_t *gameboy, const char *filename)
+/**
+ * @brief Creates a gameboy, which runs the boot ROM unless skip_boot
+ */
+static int gameboy_init(gameboy_t *gameboy, const char *filename, bit_t skip_boot)
 {
     M_REQUIRE_NON_NULL(gameboy);
 
     memset(gameboy->bus, 0, sizeof(bus_t));
 
-    M_EXIT_IF_ERR(cartridge_init(&gameboy->cartridge, filename));
-    M_EXIT_IF_ERR(cartridge_plug(&gameboy->cartridge, gameboy->bus));
-
-    gameboy->boot = 1u;
-    M_EXIT_IF_ERR(bootrom_init(&gameboy->bootrom));
-    M_EXIT_IF_ERR(bootrom_plug(&gameboy->bootrom, gameboy->bus));
-
     M_EXIT_IF_ERR(timer_init(&gameboy->timer, &gameboy->cpu));
 
+    gameboy->memory = aligned_alloc(GB_CACHE_LINE, sizeof(gameboy_memory_t));
+    M_EXIT_IF_NULL(gameboy->memory, sizeof(gameboy_memory_t));
+    memset(gameboy->memory, 0, sizeof(gameboy_memory_t));
+
     int i = 0;
-    INIT_COMPONENT(WORK_RAM, i++);
-    INIT_COMPONENT(REGISTERS, i++);
-    INIT_COMPONENT(EXTERN_RAM, i++);
-    INIT_COMPONENT(VIDEO_RAM, i++);
-    INIT_COMPONENT(GRAPH_RAM, i++);
-    INIT_COMPONENT(USELESS, i++);
+    INIT_COMPONENT(WORK_RAM, work_ram, i++);
+    INIT_COMPONENT(REGISTERS, registers, i++);
+    INIT_COMPONENT(EXTERN_RAM, extern_ram, i++);
+    INIT_COMPONENT(VIDEO_RAM, video_ram, i++);
+    INIT_COMPONENT(GRAPH_RAM, graph_ram, i++);
+    INIT_COMPONENT(USELESS, useless, i++);
+    INIT_COMPONENT(HIGH_RAM, high_ram, i++);
+
+    // plugged over EXTERN_RAM when the cartridge has its own RAM
+    M_EXIT_IF_ERR(cartridge_init(&gameboy->cartridge, filename));
+    M_EXIT_IF_ERR(cartridge_plug(&gameboy->cartridge, gameboy->bus));
+
+    gameboy->boot = 0u;
+    if (!skip_boot)
+    {
+        gameboy->boot = 1u;
+        M_EXIT_IF_ERR(bootrom_init(&gameboy->bootrom));
+        M_EXIT_IF_ERR(bootrom_plug(&gameboy->bootrom, gameboy->bus));
+    }
 
     component_t echo_ram;
     /* On n'ajoute pas echo_ram à la liste components car il partage
@@ -68,22 +307,62 @@ int gameboy_create(gameboy_t *gameboy, const char *filename)
 
     M_EXIT_IF_ERR(cpu_init(&gameboy->cpu));
     M_EXIT_IF_ERR(cpu_plug(&gameboy->cpu, &gameboy->bus));
+    cpu_jit_set_sync(&gameboy->cpu, gameboy_jit_sync, gameboy);
 
     gameboy->cycles = 0;
     gameboy->nb_components = GB_NB_COMPONENTS;
 
     M_EXIT_IF_ERR(joypad_init_and_plug(&gameboy->pad, &gameboy->cpu));
 
+    // before the LCDC and the timer look at their registers
+    if (skip_boot)
+        M_EXIT_IF_ERR(bootrom_skip(gameboy));
+
     M_EXIT_IF_ERR(lcdc_init(gameboy));
     M_EXIT_IF_ERR(lcdc_plug(&gameboy->screen, gameboy->bus));
 
+    for (size_t k = 0; k < GB_NB_MMIO; ++k)
+    {
+        M_EXIT_IF_ERR(bus_set_mmio(gameboy->bus, gameboy_mmio[k].addr, gameboy_mmio[k].addr,
+                                   gameboy_mmio[k].on_read, gameboy_mmio[k].on_write, gameboy));
+    }
+    // the tiles the CPU writes to are decoded again before the next line
+    M_EXIT_IF_ERR(bus_set_mmio(gameboy->bus, TILE_SRC_ADDR_LOW, TILE_SRC_ADDR_END, NULL, gameboy_vram_write, gameboy));
+    // and the sprites of the lines selected again after a write to OAM
+    M_EXIT_IF_ERR(bus_set_mmio(gameboy->bus, GRAPH_RAM_START, GRAPH_RAM_END, NULL, gameboy_oam_write, gameboy));
+
+    gameboy->timer_cycles = 0;
+    gameboy->idle_skipped = 0;
+    M_EXIT_IF_ERR(scheduler_init(&gameboy->scheduler));
+    M_EXIT_IF_ERR(scheduler_post(&gameboy->scheduler, SCHED_CPU, 0));
+    M_EXIT_IF_ERR(gameboy_schedule_timer(gameboy));
+    M_EXIT_IF_ERR(gameboy_schedule_lcdc(gameboy, 0));
+
     return ERR_NONE;
 }
 
+int gameboy_create(gameboy_t *gameboy, const char *filename)
+{
+    return gameboy_init(gameboy, filename, 0);
+}
+
+int gameboy_create_skip_boot(gameboy_t *gameboy, const char *filename)
+{
+    return gameboy_init(gameboy, filename, 1);
+}
+
 void gameboy_free(gameboy_t *gameboy)
 {
     if (gameboy != NULL)
     {
+        for (size_t k = 0; k < GB_NB_MMIO; ++k)
+        {
+            RETURN_IF_ERROR_MSG_ONLY(bus_set_mmio(gameboy->bus, gameboy_mmio[k].addr, gameboy_mmio[k].addr,
+                                                  NULL, NULL, NULL));
+        }
+        RETURN_IF_ERROR_MSG_ONLY(bus_set_mmio(gameboy->bus, TILE_SRC_ADDR_LOW, TILE_SRC_ADDR_END, NULL, NULL, NULL));
+        RETURN_IF_ERROR_MSG_ONLY(bus_set_mmio(gameboy->bus, GRAPH_RAM_START, GRAPH_RAM_END, NULL, NULL, NULL));
+
         // Unplug a clone of echo_ram
         component_t echo_clone = {NULL, ECHO_RAM_START, ECHO_RAM_END};
         RETURN_IF_ERROR_MSG_ONLY(bus_unplug(gameboy->bus, &echo_clone));
@@ -91,13 +370,15 @@ void gameboy_free(gameboy_t *gameboy)
         for (size_t i = 0; i < GB_NB_COMPONENTS; ++i)
         {
             RETURN_IF_ERROR_MSG_ONLY(bus_unplug(gameboy->bus, &gameboy->components[i]));
-            component_free(&gameboy->components[i]);
+            gameboy->components[i].mem = NULL;
         }
+        free(gameboy->memory);
+        gameboy->memory = NULL;
 
         RETURN_IF_ERROR_MSG_ONLY(bus_unplug(gameboy->bus, &gameboy->bootrom));
-        component_free(&gameboy->bootrom);
+        bootrom_free(&gameboy->bootrom);
 
-        RETURN_IF_ERROR_MSG_ONLY(bus_unplug(gameboy->bus, &gameboy->cartridge.c));
+        RETURN_IF_ERROR_MSG_ONLY(cartridge_unplug(&gameboy->cartridge, gameboy->bus));
         cartridge_free(&gameboy->cartridge);
 
         cpu_free(&gameboy->cpu);
@@ -109,21 +390,62 @@ void gameboy_free(gameboy_t *gameboy)
 
 int gameboy_run_until(gameboy_t *gameboy, uint64_t cycle)
 {
+    M_REQUIRE_NON_NULL(gameboy);
+
+    scheduler_t *sched = &gameboy->scheduler;
+
     while (gameboy->cycles < cycle)
     {
-        M_EXIT_IF_ERR(timer_cycle(&gameboy->timer));
-        M_EXIT_IF_ERR(lcdc_cycle(&gameboy->screen, gameboy->cycles));
-        M_EXIT_IF_ERR(cpu_cycle(&gameboy->cpu));
+        // an interrupt may have been requested from outside (joypad)
+        M_EXIT_IF_ERR(gameboy_wake_cpu(gameboy, gameboy->cycles));
 
-        M_EXIT_IF_ERR(timer_bus_listener(&gameboy->timer, gameboy->cpu.write_listener));
-        M_EXIT_IF_ERR(bootrom_bus_listener(gameboy, gameboy->cpu.write_listener));
-        M_EXIT_IF_ERR(lcdc_bus_listener(&gameboy->screen, gameboy->cpu.write_listener));
-#ifdef BLARGG
-        M_EXIT_IF_ERR(blargg_bus_listener(gameboy, gameboy->cpu.write_listener));
-#endif
-        M_EXIT_IF_ERR(joypad_bus_listener(&gameboy->pad, gameboy->cpu.write_listener));
+        const uint64_t now = scheduler_next(sched);
+        if (now >= cycle)
+            break;
+
+        if (sched->deadline[SCHED_TIMER] == now)
+        {
+            M_EXIT_IF_ERR(gameboy_timer_sync(gameboy, now));
+            M_EXIT_IF_ERR(gameboy_schedule_timer(gameboy));
+        }
+
+        if (sched->deadline[SCHED_LCDC] == now)
+        {
+            M_EXIT_IF_ERR(lcdc_cycle(&gameboy->screen, now));
+            M_EXIT_IF_ERR(gameboy_schedule_lcdc(gameboy, now + 1));
+
+            // VBlank (single event on its first line): saves go to disk
+            data_t ly = 0;
+            M_EXIT_IF_ERR(bus_read(gameboy->bus, REG_LY, &ly));
+            if (ly == LCD_HEIGHT)
+                M_EXIT_IF_ERR(cartridge_save_sync(&gameboy->cartridge));
+        }
+
+        if (sched->deadline[SCHED_DMA] == now)
+        {
+            M_EXIT_IF_ERR(lcdc_dma(&gameboy->screen));
+            gameboy->cpu.bus_locked = 0;
+            M_EXIT_IF_ERR(scheduler_post(sched, SCHED_DMA, SCHED_NEVER));
+        }
 
-        gameboy->cycles++;
+        uint64_t last = now;
+        M_EXIT_IF_ERR(gameboy_wake_cpu(gameboy, now));
+        if (sched->deadline[SCHED_CPU] == now)
+        {
+            M_EXIT_IF_ERR(gameboy_cpu_step(gameboy, now, cycle, &last));
+        }
+
+        gameboy->cycles = last + 1;
     }
-    return ERR_NONE;
+
+    if (gameboy->cycles < cycle)
+    {
+        // nothing else happens until then
+        gameboy->cycles = cycle;
+    }
+
+    // DIV keeps counting: registers up to date for the caller
+    if (cycle > 0)
+        M_EXIT_IF_ERR(gameboy_timer_sync(gameboy, cycle - 1));
+    return timer_bus_update(&gameboy->timer);
 }
@@ -18,6 +18,7 @@
 #include "cartridge.h"
 #include "lcdc.h"
 #include "joypad.h"
+#include "scheduler.h"
 
 
 
@@ -25,48 +26,6 @@
 extern "C" {
 #endif
 
-#define GB_NB_COMPONENTS 6
-
-/**
- * @brief Game Boy data structure.
- *        Regroups everything needed to simulate the Game Boy.
- */
-struct gameboy_{
-    bus_t bus;
-    cpu_t cpu;
-    uint64_t cycles;
-    gbtimer_t timer;
-    cartridge_t cartridge;  
-    component_t components[GB_NB_COMPONENTS]; 
-    size_t nb_components;
-    component_t bootrom;
-    bit_t boot;
-    lcdc_t screen;
-    joypad_t pad;
-};
-
-// Number of Game Boy cycles per second (= 2^20)
-#define GB_CYCLES_PER_S  (((uint64_t) 1) << 20)
-
-/**
- * @brief Creates a gameboy
- *
- * @param gameboy pointer to gameboy to create
- */
-int gameboy_create(gameboy_t* gameboy, const char* filename);
-
-/**
- * @brief Destroys a gameboy
- *
- * @param gameboy pointer to gameboy to destroy
- */
-void gameboy_free(gameboy_t* gameboy);
-
-/**
- * @brief Runs a gamefor for/until a given cycle
- */
-int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
-
 /**
  * @brief Adresses of the GameBoy
  *
@@ -107,6 +66,95 @@ int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
 #define REG_BOOT_ROM_DISABLE  0xFF50
 
 
+#define GB_NB_COMPONENTS 7
+
+// alignment of the memory of a Game Boy
+#define GB_CACHE_LINE 64
+
+/**
+ * @brief Memory owned by a Game Boy, in a single allocation:
+ *        every area has a fixed offset and a state copy is one memcpy.
+ *        (The cartridge owns its ROM and RAM, the CPU its IE and IF.)
+ */
+typedef struct {
+    _Alignas(GB_CACHE_LINE) data_t video_ram[MEM_SIZE(VIDEO_RAM)];
+    data_t extern_ram[MEM_SIZE(EXTERN_RAM)];
+    data_t work_ram[MEM_SIZE(WORK_RAM)];
+    data_t graph_ram[MEM_SIZE(GRAPH_RAM)];
+    data_t useless[MEM_SIZE(USELESS)];
+    data_t registers[MEM_SIZE(REGISTERS)];
+    data_t high_ram[HIGH_RAM_SIZE];
+} gameboy_memory_t;
+
+/**
+ * @brief Game Boy data structure.
+ *        Regroups everything needed to simulate the Game Boy.
+ *        Fields are ordered by how often the main loop touches them: what
+ *        every instruction needs comes first, what only create and free
+ *        need comes last. Everything that can be shared between Game Boys
+ *        (opcode tables, boot ROM, cartridge ROM, decoded ROM pages) lives
+ *        outside of it.
+ */
+struct gameboy_{
+    // hot: every CPU step and event
+    cpu_t cpu;
+    scheduler_t scheduler;
+    gbtimer_t timer;
+    uint64_t cycles;
+    uint64_t timer_cycles; // first cycle not yet run by the timer
+    bit_t reschedule;      // the CPU wrote to a timer or LCDC register during its current run
+    bit_t boot;
+    lcdc_t screen;
+    joypad_t pad;
+    bus_t bus;
+    // cold: set up once
+    cartridge_t cartridge;
+    gameboy_memory_t* memory;
+    memory_t areas[GB_NB_COMPONENTS];         // of memory, one per component
+    component_t components[GB_NB_COMPONENTS];
+    size_t nb_components;
+    component_t bootrom;
+    uint64_t idle_skipped; // cycles skipped in polling loops (see gameboy_cpu_step())
+};
+
+// Budget of sizeof(gameboy_t) (its RAM and cartridge are allocated apart), checked by the tests
+#define GB_SIZE_BUDGET 9216
+
+
+// Number of Game Boy cycles per second (= 2^20)
+#define GB_CYCLES_PER_S  (((uint64_t) 1) << 20)
+
+/**
+ * @brief Creates a gameboy
+ *
+ * @param gameboy pointer to gameboy to create
+ */
+int gameboy_create(gameboy_t* gameboy, const char* filename);
+
+/**
+ * @brief Creates a gameboy which does not run the boot ROM (about 2.4 s of
+ *        emulated time): it starts in the state the boot ROM leaves,
+ *        at 0x0100 of the cartridge (see bootrom_skip())
+ *
+ * @param gameboy pointer to gameboy to create
+ * @param filename cartridge file
+ */
+int gameboy_create_skip_boot(gameboy_t* gameboy, const char* filename);
+
+/**
+ * @brief Destroys a gameboy
+ *
+ * @param gameboy pointer to gameboy to destroy
+ */
+void gameboy_free(gameboy_t* gameboy);
+
+/**
+ * @brief Runs a gamefor for/until a given cycle
+ */
+int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
+
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -60,15 +60,14 @@ static void generate_image(guchar *pixels, int height, int width)
     int err = gameboy_run_until(&gb, get_time_in_GB_cycles_since(&start));
     if (err != ERR_NONE)
         return;
-    for (int x = 0; x < width; ++x)
+    // straight from the frame buffer, line after line
+    const data_t *frame = gb.screen.frame;
+    for (int y = 0; y < height; ++y)
     {
-        for (int y = 0; y < height; ++y)
+        const data_t *line = frame + (size_t)(y / SCALE) * LCD_WIDTH;
+        for (int x = 0; x < width; ++x)
         {
-
-            uint8_t pixel = 0;
-            if (image_get_pixel(&pixel, &gb.screen.display, (size_t)x / SCALE, (size_t)y / SCALE) != ERR_NONE)
-                pixel = 0;
-            set_grey(pixels, y, x, width, 255 - 85 * pixel);
+            set_grey(pixels, y, x, width, (guchar)(255 - 85 * line[x / SCALE]));
         }
     }
 }
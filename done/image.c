@@ -90,6 +90,367 @@ int image_line_set_word(image_line_t *piml, size_t index, uint32_t msb, uint32_t
     return ERR_NONE;
 }
 
+// ======================================================================
+// Pixel kernels: one color per byte, 16 (SSSE3) or 32 (AVX2) pixels at a
+// time, the palette being applied by a byte shuffle. The version is chosen
+// at run time; a scalar one is used elsewhere (or with -DIMAGE_NO_SIMD).
+
+#if !defined(IMAGE_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_SIMD
+#include <immintrin.h>
+#endif
+
+#define BYTES_1(b) ((b) * 0x0101010101010101u) // b in each byte of a 64-bit word
+
+// bit of each pixel, leftmost first: in tile bytes (bit 7 to 0), in image line words (bit 0 to 7)
+#define TILE_PIXEL_BITS 0x0102040810204080u
+#define WORD_PIXEL_BITS 0x8040201008040201u
+
+/**
+ * @brief One plane of the colors of a palette, as a mask per color
+ */
+static void palette_masks(uint64_t masks[PALETTE_COLOR_COUNT], palette_t map, unsigned plane)
+{
+    for (unsigned color = 0; color < PALETTE_COLOR_COUNT; ++color)
+        masks[color] = 0 - (uint64_t)((map >> (2 * color + plane)) & 1);
+}
+
+/**
+ * @brief One plane of the colors given by a palette (see palette_masks()),
+ *        for pixels whose planes are the bits of msb and lsb
+ */
+static uint64_t palette_plane(uint64_t msb, uint64_t lsb, const uint64_t masks[PALETTE_COLOR_COUNT])
+{
+    return (~msb & ~lsb & masks[0]) | (~msb & lsb & masks[1]) | (msb & ~lsb & masks[2]) | (msb & lsb & masks[3]);
+}
+
+/**
+ * @brief 8 pixels of a plane, from the bits of byte (bits gives the bit of
+ *        each one), to bit 0 of each byte of a 64-bit word, first pixel lowest
+ */
+static uint64_t spread_plane(uint64_t byte, uint64_t bits)
+{
+    const uint64_t set = BYTES_1(byte & 0xFF) & bits;
+    // a set bit (at most 0x80) carries into the highest bit of its byte
+    return ((set + BYTES_1(0x7F)) >> 7) & BYTES_1(1);
+}
+
+// 8 pixels as the bytes of a 64-bit word, first pixel lowest
+static uint64_t load_pixels(const uint8_t *input)
+{
+    uint64_t pixels = 0;
+    for (size_t i = 0; i < 8; ++i)
+        pixels |= (uint64_t) input[i] << (8 * i);
+    return pixels;
+}
+
+static void store_pixels(uint8_t *output, uint64_t pixels)
+{
+    for (size_t i = 0; i < 8; ++i)
+        output[i] = (uint8_t)(pixels >> (8 * i));
+}
+
+static void tile_rows_scalar(uint8_t *output, const uint8_t *rows, size_t nb_rows, palette_t map)
+{
+    uint64_t lsb_masks[PALETTE_COLOR_COUNT], msb_masks[PALETTE_COLOR_COUNT];
+    palette_masks(lsb_masks, map, 0);
+    palette_masks(msb_masks, map, 1);
+
+    for (size_t r = 0; r < nb_rows; ++r)
+    {
+        const uint64_t lsb = palette_plane(rows[2 * r + 1], rows[2 * r], lsb_masks);
+        const uint64_t msb = palette_plane(rows[2 * r + 1], rows[2 * r], msb_masks);
+        store_pixels(output + 8 * r, spread_plane(lsb, TILE_PIXEL_BITS) | spread_plane(msb, TILE_PIXEL_BITS) << 1);
+    }
+}
+
+static void from_word_scalar(uint8_t *output, uint32_t msb, uint32_t lsb, palette_t map)
+{
+    for (size_t i = 0; i < IMAGE_LINE_WORD_BITS; ++i)
+    {
+        const unsigned color = ((msb >> i) & 1) << 1 | ((lsb >> i) & 1);
+        output[i] = (uint8_t)((map >> (2 * color)) & 0x3);
+    }
+}
+
+static void to_word_scalar(const uint8_t *pixels, uint32_t *msb, uint32_t *lsb)
+{
+    *msb = 0;
+    *lsb = 0;
+    for (size_t i = 0; i < IMAGE_LINE_WORD_BITS / 8; ++i)
+    {
+        const uint64_t colors = load_pixels(pixels + 8 * i);
+        // the multiplication gathers bit 0 of each byte in the highest byte
+        *lsb |= (uint32_t)(((colors & BYTES_1(1)) * TILE_PIXEL_BITS) >> 56) << (8 * i);
+        *msb |= (uint32_t)((((colors >> 1) & BYTES_1(1)) * TILE_PIXEL_BITS) >> 56) << (8 * i);
+    }
+}
+
+static void map_colors_scalar(uint8_t *output, const uint8_t *input, size_t size, palette_t map)
+{
+    for (size_t i = 0; i < size; ++i)
+        output[i] = (uint8_t)((map >> (2 * input[i])) & 0x3);
+}
+
+static void map_word_scalar(uint32_t *msb, uint32_t *lsb, palette_t map)
+{
+    uint64_t masks[PALETTE_COLOR_COUNT];
+    palette_masks(masks, map, 0);
+    const uint32_t lsb_mapped = (uint32_t) palette_plane(*msb, *lsb, masks);
+    palette_masks(masks, map, 1);
+    *msb = (uint32_t) palette_plane(*msb, *lsb, masks);
+    *lsb = lsb_mapped;
+}
+
+#ifdef IMAGE_SIMD
+// ----------------------------------------------------------------------
+/**
+ * @brief The colors of a palette, one per byte, color 0 first
+ */
+static uint32_t palette_colors(palette_t map)
+{
+    return (uint32_t)(map & 0x3) | (uint32_t)((map >> 2) & 0x3) << 8
+           | (uint32_t)((map >> 4) & 0x3) << 16 | (uint32_t)((map >> 6) & 0x3) << 24;
+}
+
+/**
+ * @brief Colors of 16 pixels from their bit planes: byte k of lsb (resp. msb)
+ *        holds the plane of pixel k in the bit of byte k of bits
+ */
+__attribute__((target("ssse3")))
+static __m128i pixels_ssse3(__m128i lsb, __m128i msb, __m128i bits, __m128i lut)
+{
+    const __m128i l = _mm_cmpeq_epi8(_mm_and_si128(lsb, bits), bits);
+    const __m128i m = _mm_cmpeq_epi8(_mm_and_si128(msb, bits), bits);
+    const __m128i color = _mm_or_si128(_mm_and_si128(l, _mm_set1_epi8(1)), _mm_and_si128(m, _mm_set1_epi8(2)));
+    return _mm_shuffle_epi8(lut, color);
+}
+
+__attribute__((target("ssse3")))
+static void tile_rows_ssse3(uint8_t *output, const uint8_t *rows, size_t nb_rows, palette_t map)
+{
+    const __m128i lut = _mm_cvtsi32_si128((int)palette_colors(map));
+    const __m128i bits = _mm_set1_epi64x((long long)TILE_PIXEL_BITS);
+    // 2 rows: bytes 0 and 2 hold their lsb planes, 1 and 3 their msb ones
+    const __m128i lsb_of = _mm_set_epi64x((long long)BYTES_1(2), 0);
+    const __m128i msb_of = _mm_set_epi64x((long long)BYTES_1(3), (long long)BYTES_1(1));
+
+    size_t r = 0;
+    for (; r + 2 <= nb_rows; r += 2)
+    {
+        int32_t bytes;
+        memcpy(&bytes, rows + 2 * r, sizeof(bytes));
+        const __m128i v = _mm_cvtsi32_si128(bytes);
+        _mm_storeu_si128((__m128i *)(void *)(output + 8 * r),
+                         pixels_ssse3(_mm_shuffle_epi8(v, lsb_of), _mm_shuffle_epi8(v, msb_of), bits, lut));
+    }
+    tile_rows_scalar(output + 8 * r, rows + 2 * r, nb_rows - r, map);
+}
+
+__attribute__((target("ssse3")))
+static void from_word_ssse3(uint8_t *output, uint32_t msb, uint32_t lsb, palette_t map)
+{
+    const __m128i lut = _mm_cvtsi32_si128((int)palette_colors(map));
+    const __m128i bits = _mm_set1_epi64x((long long)WORD_PIXEL_BITS);
+    const __m128i byte_of = _mm_set_epi64x((long long)BYTES_1(1), 0);
+
+    for (size_t h = 0; h < 2; ++h)
+    {
+        const __m128i l = _mm_shuffle_epi8(_mm_cvtsi32_si128((int)(lsb >> (16 * h))), byte_of);
+        const __m128i m = _mm_shuffle_epi8(_mm_cvtsi32_si128((int)(msb >> (16 * h))), byte_of);
+        _mm_storeu_si128((__m128i *)(void *)(output + 16 * h), pixels_ssse3(l, m, bits, lut));
+    }
+}
+
+__attribute__((target("ssse3")))
+static void to_word_ssse3(const uint8_t *pixels, uint32_t *msb, uint32_t *lsb)
+{
+    // the plane bits are moved to the sign bit of each byte
+    const __m128i v0 = _mm_loadu_si128((const __m128i *)(const void *)pixels);
+    const __m128i v1 = _mm_loadu_si128((const __m128i *)(const void *)(pixels + 16));
+    *lsb = (uint32_t)_mm_movemask_epi8(_mm_slli_epi16(v0, 7))
+           | (uint32_t)_mm_movemask_epi8(_mm_slli_epi16(v1, 7)) << 16;
+    *msb = (uint32_t)_mm_movemask_epi8(_mm_slli_epi16(v0, 6))
+           | (uint32_t)_mm_movemask_epi8(_mm_slli_epi16(v1, 6)) << 16;
+}
+
+__attribute__((target("ssse3")))
+static void map_colors_ssse3(uint8_t *output, const uint8_t *input, size_t size, palette_t map)
+{
+    const __m128i lut = _mm_cvtsi32_si128((int)palette_colors(map));
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(input + i));
+        _mm_storeu_si128((__m128i *)(void *)(output + i), _mm_shuffle_epi8(lut, v));
+    }
+    map_colors_scalar(output + i, input + i, size - i, map);
+}
+
+__attribute__((target("ssse3")))
+static void map_word_ssse3(uint32_t *msb, uint32_t *lsb, palette_t map)
+{
+    uint8_t pixels[IMAGE_LINE_WORD_BITS];
+    from_word_ssse3(pixels, *msb, *lsb, map);
+    to_word_ssse3(pixels, msb, lsb);
+}
+
+// ----------------------------------------------------------------------
+// Each AVX2 kernel clears the upper halves of the registers when done, for
+// the SSE code run next not to pay for a state transition.
+
+/**
+ * @brief Colors of 32 pixels from their bit planes (see pixels_ssse3())
+ */
+__attribute__((target("avx2")))
+static __m256i pixels_avx2(__m256i lsb, __m256i msb, __m256i bits, __m256i lut)
+{
+    const __m256i l = _mm256_cmpeq_epi8(_mm256_and_si256(lsb, bits), bits);
+    const __m256i m = _mm256_cmpeq_epi8(_mm256_and_si256(msb, bits), bits);
+    const __m256i color = _mm256_or_si256(_mm256_and_si256(l, _mm256_set1_epi8(1)),
+                                          _mm256_and_si256(m, _mm256_set1_epi8(2)));
+    return _mm256_shuffle_epi8(lut, color);
+}
+
+__attribute__((target("avx2")))
+static void tile_rows_avx2(uint8_t *output, const uint8_t *rows, size_t nb_rows, palette_t map)
+{
+    // byte shuffles stay within 128-bit lanes: the palette is in both
+    const __m256i lut = _mm256_set1_epi32((int)palette_colors(map));
+    const __m256i bits = _mm256_set1_epi64x((long long)TILE_PIXEL_BITS);
+    // 4 rows, each lane seeing all of their bytes
+    const __m256i lsb_of = _mm256_set_epi64x((long long)BYTES_1(6), (long long)BYTES_1(4),
+                                             (long long)BYTES_1(2), 0);
+    const __m256i msb_of = _mm256_set_epi64x((long long)BYTES_1(7), (long long)BYTES_1(5),
+                                             (long long)BYTES_1(3), (long long)BYTES_1(1));
+
+    size_t r = 0;
+    for (; r + 4 <= nb_rows; r += 4)
+    {
+        int64_t bytes;
+        memcpy(&bytes, rows + 2 * r, sizeof(bytes));
+        const __m256i v = _mm256_set1_epi64x(bytes);
+        _mm256_storeu_si256((__m256i *)(void *)(output + 8 * r),
+                            pixels_avx2(_mm256_shuffle_epi8(v, lsb_of), _mm256_shuffle_epi8(v, msb_of), bits, lut));
+    }
+    _mm256_zeroupper();
+    tile_rows_ssse3(output + 8 * r, rows + 2 * r, nb_rows - r, map);
+}
+
+__attribute__((target("avx2")))
+static void from_word_avx2(uint8_t *output, uint32_t msb, uint32_t lsb, palette_t map)
+{
+    const __m256i lut = _mm256_set1_epi32((int)palette_colors(map));
+    const __m256i bits = _mm256_set1_epi64x((long long)WORD_PIXEL_BITS);
+    const __m256i byte_of = _mm256_set_epi64x((long long)BYTES_1(3), (long long)BYTES_1(2),
+                                              (long long)BYTES_1(1), 0);
+
+    const __m256i l = _mm256_shuffle_epi8(_mm256_set1_epi32((int)lsb), byte_of);
+    const __m256i m = _mm256_shuffle_epi8(_mm256_set1_epi32((int)msb), byte_of);
+    _mm256_storeu_si256((__m256i *)(void *)output, pixels_avx2(l, m, bits, lut));
+    _mm256_zeroupper();
+}
+
+__attribute__((target("avx2")))
+static void to_word_avx2(const uint8_t *pixels, uint32_t *msb, uint32_t *lsb)
+{
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)pixels);
+    *lsb = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+    *msb = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 6));
+    _mm256_zeroupper();
+}
+
+__attribute__((target("avx2")))
+static void map_colors_avx2(uint8_t *output, const uint8_t *input, size_t size, palette_t map)
+{
+    const __m256i lut = _mm256_set1_epi32((int)palette_colors(map));
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(const void *)(input + i));
+        _mm256_storeu_si256((__m256i *)(void *)(output + i), _mm256_shuffle_epi8(lut, v));
+    }
+    _mm256_zeroupper();
+    map_colors_ssse3(output + i, input + i, size - i, map);
+}
+
+__attribute__((target("avx2")))
+static void map_word_avx2(uint32_t *msb, uint32_t *lsb, palette_t map)
+{
+    // from_word_avx2() then to_word_avx2(), the pixels staying in a register
+    const __m256i lut = _mm256_set1_epi32((int)palette_colors(map));
+    const __m256i bits = _mm256_set1_epi64x((long long)WORD_PIXEL_BITS);
+    const __m256i byte_of = _mm256_set_epi64x((long long)BYTES_1(3), (long long)BYTES_1(2),
+                                              (long long)BYTES_1(1), 0);
+
+    const __m256i l = _mm256_shuffle_epi8(_mm256_set1_epi32((int)*lsb), byte_of);
+    const __m256i m = _mm256_shuffle_epi8(_mm256_set1_epi32((int)*msb), byte_of);
+    const __m256i v = pixels_avx2(l, m, bits, lut);
+    *lsb = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+    *msb = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(v, 6));
+    _mm256_zeroupper();
+}
+
+#define IMAGE_DISPATCH(name, ...)                   \
+    do                                              \
+    {                                               \
+        if (__builtin_cpu_supports("avx2"))         \
+        {                                           \
+            name##_avx2(__VA_ARGS__);               \
+            return;                                 \
+        }                                           \
+        if (__builtin_cpu_supports("ssse3"))        \
+        {                                           \
+            name##_ssse3(__VA_ARGS__);              \
+            return;                                 \
+        }                                           \
+    } while (0)
+#else
+#define IMAGE_DISPATCH(name, ...) \
+    do                            \
+    {                             \
+    } while (0)
+#endif
+
+/**
+ * @brief Applies a palette to a word of each plane of an image line
+ */
+static void map_word(uint32_t *msb, uint32_t *lsb, palette_t map)
+{
+    IMAGE_DISPATCH(map_word, msb, lsb, map);
+    map_word_scalar(msb, lsb, map);
+}
+
+// ======================================================================
+void image_pixels_from_tile_rows(uint8_t *output, const uint8_t *rows, size_t nb_rows, palette_t map)
+{
+    IMAGE_DISPATCH(tile_rows, output, rows, nb_rows, map);
+    tile_rows_scalar(output, rows, nb_rows, map);
+}
+
+// ======================================================================
+void image_pixels_from_word(uint8_t *output, uint32_t msb, uint32_t lsb, palette_t map)
+{
+    IMAGE_DISPATCH(from_word, output, msb, lsb, map);
+    from_word_scalar(output, msb, lsb, map);
+}
+
+// ======================================================================
+void image_pixels_to_word(const uint8_t *pixels, uint32_t *msb, uint32_t *lsb)
+{
+    IMAGE_DISPATCH(to_word, pixels, msb, lsb);
+    to_word_scalar(pixels, msb, lsb);
+}
+
+// ======================================================================
+void image_pixels_map_colors(uint8_t *output, const uint8_t *input, size_t size, palette_t map)
+{
+    IMAGE_DISPATCH(map_colors, output, input, size, map);
+    map_colors_scalar(output, input, size, map);
+}
+
 // ======================================================================
 int image_line_shift(image_line_t *output, image_line_t iml, int64_t shift)
 {
@@ -134,88 +495,31 @@ int image_line_map_colors(image_line_t *output, image_line_t iml, palette_t map)
 
         do_image_line(output);
 #undef do_imlc
-        return ERR_NONE;
+        return valid(output);
     }
 
     output->lsb = bit_vector_create(iml.lsb->size, 0);
     output->msb = bit_vector_create(iml.msb->size, 0);
     output->opacity = bit_vector_cpy(iml.opacity);
+    if (valid(output) != ERR_NONE)
+        return ERR_MEM;
+
+    // one word at a time: decoded with the palette applied, then encoded back
+    const size_t nb_words = size_to_content_size(iml.msb->size);
+    for (size_t i = 0; i < nb_words; ++i)
+    {
+        output->msb->content[i] = iml.msb->content[i];
+        output->lsb->content[i] = iml.lsb->content[i];
+        map_word(&output->msb->content[i], &output->lsb->content[i], map);
+    }
 
-    for (size_t i = 0; i < PALETTE_COLOR_COUNT; ++i)
+    // the bits past the end of the line stay 0
+    const size_t rest = iml.msb->size % IMAGE_LINE_WORD_BITS;
+    if (rest != 0)
     {
-        bit_vector_t *mask = NULL;
-
-        const bit_t color_bit_0 = (bit_t)(map & (1 << (i * 2)));
-        const bit_t color_bit_1 = (bit_t)(map & (1 << (i * 2 + 1)));
-
-        if (color_bit_0 || color_bit_1)
-        {
-            switch (i)
-            {
-            case 0:
-            {
-                bit_vector_t *tmp = bit_vector_not(bit_vector_cpy(iml.lsb));
-
-                if (tmp == NULL)
-                {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), tmp);
-                bit_vector_free(&tmp);
-            }
-            break;
-
-            case 1:
-            {
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), iml.lsb);
-            }
-            break;
-
-            case 2:
-            {
-                mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.lsb)), iml.msb);
-            }
-            break;
-
-            case 3:
-            {
-                mask = bit_vector_and(bit_vector_cpy(iml.lsb), iml.msb);
-            }
-            break;
-            }
-
-            if (mask == NULL)
-            {
-                image_line_free(output);
-                return ERR_MEM;
-            }
-
-            if (color_bit_0)
-            {
-                output->lsb = bit_vector_or(output->lsb, mask);
-
-                if (output->lsb == NULL)
-                {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-            }
-
-            if (color_bit_1)
-            {
-                output->msb = bit_vector_or(output->msb, mask);
-
-                if (output->msb == NULL)
-                {
-                    image_line_free(output);
-                    return ERR_MEM;
-                }
-            }
-
-            bit_vector_free(&mask);
-        }
+        const uint32_t mask = (UINT32_C(1) << rest) - 1;
+        output->msb->content[nb_words - 1] &= mask;
+        output->lsb->content[nb_words - 1] &= mask;
     }
 
     return ERR_NONE;
@@ -67,6 +67,45 @@ int image_line_create(image_line_t* piml, size_t size);
  */
 int image_line_set_word(image_line_t* piml, size_t index, uint32_t msb, uint32_t lsb);
 
+//=========================================================================
+/**
+ * @brief Decodes rows of tiles (2 bits per pixel, planar: the lsb byte then
+ *        the msb byte of 8 pixels, leftmost pixel in bit 7) into one color
+ *        per byte, mapped through a palette on the way
+ * @param output where to write the nb_rows * 8 colors
+ * @param rows the 2 * nb_rows tile bytes
+ * @param nb_rows number of rows
+ * @param map palette to use (DEFAULT_PALETTE for the color numbers)
+ */
+void image_pixels_from_tile_rows(uint8_t* output, const uint8_t* rows, size_t nb_rows, palette_t map);
+//=========================================================================
+/**
+ * @brief Decodes an image line word (IMAGE_LINE_WORD_BITS pixels, leftmost
+ *        pixel in bit 0) into one color per byte, mapped through a palette
+ * @param output where to write the IMAGE_LINE_WORD_BITS colors
+ * @param msb msb word
+ * @param lsb lsb word
+ * @param map palette to use (DEFAULT_PALETTE for the color numbers)
+ */
+void image_pixels_from_word(uint8_t* output, uint32_t msb, uint32_t lsb, palette_t map);
+//=========================================================================
+/**
+ * @brief Encodes IMAGE_LINE_WORD_BITS colors (one per byte, 0 to 3) into
+ *        image line words (see image_line_set_word())
+ * @param pixels colors to encode
+ * @param msb pointer to write the msb word to
+ * @param lsb pointer to write the lsb word to
+ */
+void image_pixels_to_word(const uint8_t* pixels, uint32_t* msb, uint32_t* lsb);
+//=========================================================================
+/**
+ * @brief Maps colors (one per byte, 0 to 3) through a palette
+ * @param output where to write the size colors (may be input)
+ * @param input colors to map
+ * @param size number of colors
+ * @param map palette to use
+ */
+void image_pixels_map_colors(uint8_t* output, const uint8_t* input, size_t size, palette_t map);
 //=========================================================================
 /**
  * @brief Shift image line
@@ -0,0 +1,108 @@
+/**
+ * @file joypad.c
+ * @brief Game Boy joypad simulation
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <string.h>
+
+#include "joypad.h"
+#include "bit.h"
+#include "error.h"
+
+// P1 bits 4 and 5 select the key row (active low), bits 6 and 7 are unused
+#define P1_ROW_SELECT_MASK 0x30
+#define P1_FIXED_MASK      0xC0
+#define P1_KEYS_MASK       0x0F
+
+/**
+ * @brief Computes the (active high) state of the keys of the selected rows
+ */
+static uint8_t joypad_state(const joypad_t *pad)
+{
+    uint8_t state = 0;
+    for (int row = 0; row < NB_GB_KEY_ROWS; ++row)
+    {
+        if (!bit_get(*pad->p_P1, row + 4))
+            state |= pad->keys_state[row];
+    }
+    return state & P1_KEYS_MASK;
+}
+
+/**
+ * @brief Exposes the given key state in P1 (keys are active low)
+ */
+static void joypad_update(joypad_t *pad, uint8_t state)
+{
+    pad->intern = (data_t)((pad->intern & ~P1_KEYS_MASK) | (~state & P1_KEYS_MASK));
+    *pad->p_P1 = pad->intern;
+    pad->old_state = state;
+}
+
+/**
+ * @brief Computes the keys state and requests the joypad interrupt
+ *        if some selected key has just been pressed
+ */
+static uint8_t joypad_request_interrupt(joypad_t *pad)
+{
+    const uint8_t state = joypad_state(pad);
+    if (state & ~pad->old_state)
+        cpu_request_interrupt(pad->cpu, JOYPAD);
+    return state;
+}
+
+int joypad_init_and_plug(joypad_t *pad, cpu_t *cpu)
+{
+    M_REQUIRE_NON_NULL(pad);
+    M_REQUIRE_NON_NULL(cpu);
+    M_REQUIRE_NON_NULL(cpu->bus);
+
+    memset(pad, 0, sizeof(*pad));
+    pad->cpu = cpu;
+    pad->p_P1 = bus_at(*cpu->bus, REG_P1);
+    M_REQUIRE_NON_NULL(pad->p_P1);
+    pad->intern = P1_FIXED_MASK;
+
+    joypad_update(pad, joypad_state(pad));
+
+    return ERR_NONE;
+}
+
+int joypad_bus_listener(joypad_t *pad, addr_t addr)
+{
+    M_REQUIRE_NON_NULL(pad);
+
+    if (addr == REG_P1)
+    {
+        // only the row selection is writable
+        pad->intern = (data_t)((pad->intern & ~P1_ROW_SELECT_MASK) | (*pad->p_P1 & P1_ROW_SELECT_MASK));
+        *pad->p_P1 = pad->intern;
+        joypad_update(pad, joypad_request_interrupt(pad));
+    }
+
+    return ERR_NONE;
+}
+
+int joypad_key_pressed(joypad_t *pad, gb_key_t key)
+{
+    M_REQUIRE_NON_NULL(pad);
+    M_REQUIRE(key < NB_GB_KEYS, ERR_BAD_PARAMETER, "unknown key %d", key);
+
+    bit_set(&pad->keys_state[key / NB_GB_KEY_COLS], key % NB_GB_KEY_COLS);
+    joypad_update(pad, joypad_request_interrupt(pad));
+
+    return ERR_NONE;
+}
+
+int joypad_key_released(joypad_t *pad, gb_key_t key)
+{
+    M_REQUIRE_NON_NULL(pad);
+    M_REQUIRE(key < NB_GB_KEYS, ERR_BAD_PARAMETER, "unknown key %d", key);
+
+    bit_unset(&pad->keys_state[key / NB_GB_KEY_COLS], key % NB_GB_KEY_COLS);
+    joypad_update(pad, joypad_state(pad));
+
+    return ERR_NONE;
+}
@@ -0,0 +1,563 @@
+/**
+ * @file lcdc.c
+ * @brief Game Boy LCD (liquid cristal display) controller simulation
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lcdc.h"
+#include "gameboy.h"
+#include "error.h"
+
+#define SPRITE_SIZE         4   // bytes per OAM entry
+#define SPRITE_Y_OFFSET     16
+#define SPRITE_X_OFFSET     8
+#define SPRITE_HEIGHT       8
+#define SPRITE_HEIGHT_BIG   16
+
+#define SPRITE_ATTR_PALETTE_MASK  0x10
+#define SPRITE_ATTR_X_FLIP_MASK   0x20
+#define SPRITE_ATTR_Y_FLIP_MASK   0x40
+#define SPRITE_ATTR_BEHIND_MASK   0x80
+
+// sprite pixels of a line (see lcdc_sprites_line())
+#define LCDC_NO_SPRITE     0xFF
+#define LCDC_SPRITE_BEHIND 0x80
+
+// ----------------------------------------------------------------------
+/**
+ * @brief Reads a LCDC register (or video memory)
+ */
+static data_t lcdc_reg_get(const lcdc_t *lcd, addr_t addr)
+{
+    data_t value = 0;
+    bus_read(*lcd->cpu->bus, addr, &value);
+    return value;
+}
+
+/**
+ * @brief Writes a LCDC register from the controller side:
+ *        this is not a CPU write, so no I/O handler is triggered
+ */
+static int lcdc_reg_set(lcdc_t *lcd, addr_t addr, data_t value)
+{
+    return bus_write(*lcd->cpu->bus, addr, value);
+}
+
+/**
+ * @brief Updates the LYC=LY flag of STAT (and requests the interrupt if enabled)
+ */
+static int lcdc_check_lyc(lcdc_t *lcd)
+{
+    data_t stat = lcdc_reg_get(lcd, REG_STAT);
+    const bit_t eq = lcdc_reg_get(lcd, REG_LY) == lcdc_reg_get(lcd, REG_LYC);
+
+    bit_edit(&stat, STAT_REG_LYC_EQ_LY_BIT, eq);
+    M_EXIT_IF_ERR(lcdc_reg_set(lcd, REG_STAT, stat));
+
+    if (eq && bit_get(stat, STAT_REG_INT_LYC_BIT))
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+
+    return ERR_NONE;
+}
+
+/**
+ * @brief Sets the mode in STAT (and requests the interrupt if enabled)
+ */
+static int lcdc_set_mode(lcdc_t *lcd, data_t mode)
+{
+    const data_t stat = (data_t)((lcdc_reg_get(lcd, REG_STAT) & ~STAT_REG_MODE_MASK) | (mode & STAT_REG_MODE_MASK));
+    M_EXIT_IF_ERR(lcdc_reg_set(lcd, REG_STAT, stat));
+
+    // STAT bits 3, 4 and 5 enable the interrupt of modes 0, 1 and 2
+    if (mode <= 2 && bit_get(stat, mode + 3))
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+
+    return ERR_NONE;
+}
+
+// ----------------------------------------------------------------------
+/**
+ * @brief Decodes a tile of video RAM into the tile cache
+ *
+ * @param lcd LCD controler
+ * @param index tile number in video RAM (0 to NB_TILES - 1)
+ */
+static void lcdc_decode_tile(lcdc_t *lcd, size_t index)
+{
+    image_pixels_from_tile_rows(lcd->tiles->pixels[index][0], lcd->vram + index * TILE_SIZE, 8, DEFAULT_PALETTE);
+
+    for (size_t row = 0; row < 8; ++row)
+    {
+        for (size_t i = 0; i < 8; ++i)
+            lcd->tiles->flipped[index][row][i] = lcd->tiles->pixels[index][row][7 - i];
+    }
+}
+
+/**
+ * @brief Decodes the tiles written since the last line
+ */
+static void lcdc_update_tiles(lcdc_t *lcd)
+{
+    for (size_t w = 0; w < NB_TILES / 64; ++w)
+    {
+        uint64_t dirty = lcd->tiles->dirty[w];
+        lcd->tiles->dirty[w] = 0;
+        for (size_t b = 0; dirty != 0; ++b, dirty >>= 1)
+        {
+            if (dirty & 1)
+                lcdc_decode_tile(lcd, w * 64 + b);
+        }
+    }
+}
+
+/**
+ * @brief Gets one row of a decoded tile: 8 color numbers (0 to 3),
+ *        leftmost pixel first
+ *
+ * @param lcd LCD controler
+ * @param src tile data start address
+ * @param tile tile number from src
+ * @param row row in the tile (rows 8 to 15 being the ones of the next tile)
+ * @param flip whether to flip the row horizontally
+ * @return the 8 pixels
+ */
+static const data_t *lcdc_tile_row(const lcdc_t *lcd, addr_t src, data_t tile, data_t row, bit_t flip)
+{
+    const size_t index = (size_t)(src - VIDEO_RAM_START) / TILE_SIZE + tile + (row >> 3);
+    return flip ? lcd->tiles->flipped[index][row & 0x7] : lcd->tiles->pixels[index][row & 0x7];
+}
+
+/**
+ * @brief Decodes consecutive tiles of a tile map line (wrapping after
+ *        TILE_LINE_SIZE tiles)
+ *
+ * @param output where to write the nb_tiles * 8 pixels
+ * @param lcd LCD controler
+ * @param lcdc LCDC register
+ * @param high_area whether the tile map is the high one (0x9C00)
+ * @param x first tile of the line
+ * @param y line in the tile map
+ * @param nb_tiles number of tiles
+ */
+static void lcdc_tiles_line(data_t *output, const lcdc_t *lcd, data_t lcdc, bit_t high_area,
+                            size_t x, data_t y, size_t nb_tiles)
+{
+    const data_t *map = lcd->vram + ((high_area ? TILE_ADDR_BASE_HIGH : TILE_ADDR_BASE_LOW) - VIDEO_RAM_START)
+                        + (y >> 3) * TILE_LINE_SIZE;
+    const bit_t low_source = (lcdc & LCDC_REG_TILE_SOURCE_MASK) != 0;
+    const addr_t src = low_source ? TILE_SRC_ADDR_LOW : TILE_SRC_ADDR_HIGH;
+    // signed tile numbers, centered on 0x9000
+    const data_t offset = low_source ? 0 : 0x80;
+
+    for (size_t i = 0; i < nb_tiles; ++i)
+    {
+        const data_t tile = (data_t)(map[(x + i) % TILE_LINE_SIZE] + offset);
+        memcpy(output + 8 * i, lcdc_tile_row(lcd, src, tile, y & 0x7, 0), 8);
+    }
+}
+
+// ----------------------------------------------------------------------
+/**
+ * @brief Selects the sprites of every line, if OAM or the sprite height
+ *        changed since the last time: on each line, the first
+ *        MAX_SPRITES_ON_LINE ones covering it, sorted by X (then OAM index)
+ *
+ * @param lcd LCD controler
+ * @param height sprite height
+ */
+static void lcdc_update_sprites(lcdc_t *lcd, data_t height)
+{
+    lcdc_sprites_t *lines = lcd->sprites;
+    if (!lines->dirty && lines->height == height)
+        return;
+
+    memset(lines->count, 0, sizeof(lines->count));
+    for (data_t i = 0; i < NB_SPRITES; ++i)
+    {
+        const data_t *oam = lcd->oam + i * SPRITE_SIZE;
+        const data_t y = (data_t)(oam[0] - SPRITE_Y_OFFSET);
+        for (size_t ly = y; ly < (size_t) y + height && ly < LCD_HEIGHT; ++ly)
+        {
+            if (lines->count[ly] == MAX_SPRITES_ON_LINE)
+                continue;
+
+            // insertion by X; OAM order between equal X
+            data_t *sprites = lines->sprites[ly];
+            size_t k = lines->count[ly]++;
+            for (; k > 0 && lcd->oam[sprites[k - 1] * SPRITE_SIZE + 1] > oam[1]; --k)
+                sprites[k] = sprites[k - 1];
+            sprites[k] = i;
+        }
+    }
+
+    lines->height = height;
+    lines->dirty = 0;
+}
+
+/**
+ * @brief Draws the sprites of a line: for each pixel, the color of the
+ *        first opaque sprite (lowest X) and whether it is behind the
+ *        background, or LCDC_NO_SPRITE
+ *
+ * @param all output for all the sprites
+ * @param fg output for the sprites above the background only
+ * @param lcd LCD controler
+ * @param lcdc LCDC register
+ * @param ly line
+ * @return number of sprites on the line (all and fg being left untouched if none)
+ */
+static size_t lcdc_sprites_line(data_t all[LCD_WIDTH], data_t fg[LCD_WIDTH], lcdc_t *lcd, data_t lcdc, data_t ly)
+{
+    const data_t height = (lcdc & LCDC_REG_OBJ_SIZE_MASK) ? SPRITE_HEIGHT_BIG : SPRITE_HEIGHT;
+    lcdc_update_sprites(lcd, height);
+    const data_t *sprites = lcd->sprites->sprites[ly];
+    const size_t n = lcd->sprites->count[ly];
+    if (n == 0)
+        return 0;
+
+    memset(all, LCDC_NO_SPRITE, LCD_WIDTH);
+    memset(fg, LCDC_NO_SPRITE, LCD_WIDTH);
+
+    // from the last to the first, so that the first ones stay above
+    for (size_t s = n; s-- > 0;)
+    {
+        const data_t *oam = lcd->oam + sprites[s] * SPRITE_SIZE;
+        const data_t attr = oam[3];
+        // sprites partly left of the screen wrap and are not drawn
+        const data_t x = (data_t)(oam[1] - SPRITE_X_OFFSET);
+        if (x >= LCD_WIDTH)
+            continue;
+
+        data_t row = (data_t)(ly - (data_t)(oam[0] - SPRITE_Y_OFFSET));
+        if (attr & SPRITE_ATTR_Y_FLIP_MASK)
+            row = (data_t)(height - 1 - row);
+
+        const data_t *pixels = lcdc_tile_row(lcd, TILE_SRC_ADDR_LOW, oam[2], row,
+                                             (attr & SPRITE_ATTR_X_FLIP_MASK) != 0);
+
+        const palette_t palette = lcdc_reg_get(lcd, (attr & SPRITE_ATTR_PALETTE_MASK) ? REG_OBP1 : REG_OBP0);
+        const bit_t behind = (attr & SPRITE_ATTR_BEHIND_MASK) != 0;
+        const size_t end = x + 8 <= LCD_WIDTH ? 8 : (size_t)(LCD_WIDTH - x);
+        for (size_t i = 0; i < end; ++i)
+        {
+            const data_t p = pixels[i];
+            if (p != 0)
+            {
+                const data_t color = (data_t)(((palette >> (2 * p)) & 0x3) | (behind ? LCDC_SPRITE_BEHIND : 0));
+                all[x + i] = color;
+                if (!behind)
+                    fg[x + i] = color;
+            }
+        }
+    }
+
+    return n;
+}
+
+// ----------------------------------------------------------------------
+/**
+ * @brief Renders the background (and window) of a display line
+ *
+ * @param colors output colors
+ * @param opaque output color numbers before the palette (0 is transparent for the sprites behind)
+ * @param lcd LCD controler
+ * @param lcdc LCDC register
+ * @param ly line
+ */
+static void lcdc_render_background(data_t colors[LCD_WIDTH], data_t opaque[LCD_WIDTH + 8],
+                                   lcdc_t *lcd, data_t lcdc, data_t ly)
+{
+    const data_t scx = lcdc_reg_get(lcd, REG_SCX);
+    const data_t y = (data_t)(lcdc_reg_get(lcd, REG_SCY) + ly);
+
+    // the visible tiles only, the first one being possibly cut by SCX
+    data_t tiles[LCD_WIDTH + 8];
+    lcdc_tiles_line(tiles, lcd, lcdc, (lcdc & LCDC_REG_BG_AREA_MASK) != 0, scx >> 3, y, VISIBLE_LINE_SIZE + 1);
+    memcpy(opaque, tiles + (scx & 0x7), LCD_WIDTH);
+
+    const data_t wx_reg = lcdc_reg_get(lcd, REG_WX);
+    const data_t wx = (data_t)(wx_reg - WINDOW_OFFSET_X);
+
+    if (wx_reg >= WINDOW_OFFSET_X && wx < LCD_WIDTH && (lcdc & LCDC_REG_WIN_MASK)
+        && ly >= lcdc_reg_get(lcd, REG_WY))
+    {
+        // the window covers the line from wx on (opaque has room for its last tile)
+        lcdc_tiles_line(opaque + wx, lcd, lcdc, (lcdc & LCDC_REG_WIN_AREA_MASK) != 0, 0, lcd->window_y,
+                        (size_t)(LCD_WIDTH - wx + 7) / 8);
+        ++lcd->window_y;
+    }
+
+    image_pixels_map_colors(colors, opaque, LCD_WIDTH, lcdc_reg_get(lcd, REG_BGP));
+}
+
+/**
+ * @brief Renders a full display line into the frame (and the display)
+ *
+ * @param lcd LCD controler
+ * @param ly line to render
+ * @return error code
+ */
+static int lcdc_render_line(lcdc_t *lcd, data_t ly)
+{
+    const data_t lcdc = lcdc_reg_get(lcd, REG_LCDC);
+    data_t colors[LCD_WIDTH];
+    data_t opaque[LCD_WIDTH + 8];
+
+    lcdc_update_tiles(lcd);
+
+    if (lcdc & LCDC_REG_BG_MASK)
+    {
+        lcdc_render_background(colors, opaque, lcd, lcdc, ly);
+    }
+    else
+    {
+        // background (and window) off: blank
+        memset(colors, 0, LCD_WIDTH);
+        memset(opaque, 0, LCD_WIDTH);
+    }
+
+    data_t all[LCD_WIDTH];
+    data_t fg[LCD_WIDTH];
+    if ((lcdc & LCDC_REG_OBJ_MASK) && lcdc_sprites_line(all, fg, lcd, lcdc, ly) > 0)
+    {
+        for (size_t x = 0; x < LCD_WIDTH; ++x)
+        {
+            // the sprites above the background come first, then the others
+            // where the background is color 0
+            if (fg[x] != LCDC_NO_SPRITE)
+                colors[x] = fg[x] & 0x3;
+            else if (all[x] != LCDC_NO_SPRITE && opaque[x] == 0)
+                colors[x] = all[x] & 0x3;
+        }
+    }
+
+    memcpy(lcd->frame + (size_t) ly * LCD_WIDTH, colors, LCD_WIDTH);
+
+    for (size_t w = 0; w < LCD_WIDTH / IMAGE_LINE_WORD_BITS; ++w)
+    {
+        uint32_t msb, lsb;
+        image_pixels_to_word(colors + w * IMAGE_LINE_WORD_BITS, &msb, &lsb);
+        M_EXIT_IF_ERR(image_line_set_word(&lcd->display.content[ly], w, msb, lsb));
+    }
+
+    return ERR_NONE;
+}
+
+// ----------------------------------------------------------------------
+/**
+ * @brief Runs the LCD controler state machine at one of its event cycles
+ */
+static int lcdc_line_event(lcdc_t *lcd, uint64_t cycle)
+{
+    const uint64_t c = (cycle - lcd->on_cycle) % FRAME_TOTAL_CYCLES;
+    if (c == 0)
+        lcd->window_y = 0;
+
+    const data_t line = (data_t)(c / LINE_TOTAL_CYCLES);
+    const uint64_t pos = c % LINE_TOTAL_CYCLES;
+
+    if (line < LCD_HEIGHT)
+    {
+        switch (pos)
+        {
+        case LINE_MODE_2_START_CYCLE:
+            M_EXIT_IF_ERR(lcdc_reg_set(lcd, REG_LY, line));
+            M_EXIT_IF_ERR(lcdc_check_lyc(lcd));
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, 2));
+            lcd->next_cycle += LINE_MODE_2_CYCLES;
+            break;
+
+        case LINE_MODE_3_START_CYCLE:
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, 3));
+            M_EXIT_IF_ERR(lcdc_render_line(lcd, line));
+            lcd->next_cycle += LINE_MODE_3_CYCLES;
+            break;
+
+        case LINE_MODE_0_START_CYCLE:
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, 0));
+            lcd->next_cycle += LINE_MODE_0_CYCLES;
+            break;
+
+        default:
+            M_EXIT_ERR(ERR_BAD_PARAMETER, ", unexpected line cycle %" PRIu64, pos);
+        }
+    }
+    else
+    {
+        M_REQUIRE(pos == 0, ERR_BAD_PARAMETER, "unexpected VBlank cycle %" PRIu64, pos);
+
+        if (line == LCD_HEIGHT)
+        {
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, 1));
+            cpu_request_interrupt(lcd->cpu, VBLANK);
+        }
+        M_EXIT_IF_ERR(lcdc_reg_set(lcd, REG_LY, line));
+        M_EXIT_IF_ERR(lcdc_check_lyc(lcd));
+        lcd->next_cycle += LINE_TOTAL_CYCLES;
+    }
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int lcdc_init(gameboy_t *gb)
+{
+    M_REQUIRE_NON_NULL(gb);
+
+    lcdc_t *lcd = &gb->screen;
+    lcd->cpu = &gb->cpu;
+    lcd->vram = gb->memory->video_ram;
+    lcd->oam = gb->memory->graph_ram;
+    lcd->on = bit_get(lcdc_reg_get(lcd, REG_LCDC), 7);
+    lcd->next_cycle = UINT64_MAX;
+    lcd->on_cycle = lcd->on ? 0 : UINT64_MAX;
+    lcd->DMA_from = 0;
+    lcd->window_y = 0;
+
+    lcd->tiles = malloc(sizeof(lcdc_tiles_t));
+    M_EXIT_IF_NULL(lcd->tiles, sizeof(lcdc_tiles_t));
+    // video RAM may already have been written to (see bootrom_skip())
+    memset(lcd->tiles->dirty, 0xFF, sizeof(lcd->tiles->dirty));
+
+    lcd->sprites = malloc(sizeof(lcdc_sprites_t));
+    M_EXIT_IF_NULL(lcd->sprites, sizeof(lcdc_sprites_t));
+    lcd->sprites->dirty = 1;
+
+    lcd->own_frame = aligned_alloc(LCDC_FRAME_ALIGN, LCDC_FRAME_SIZE);
+    M_EXIT_IF_NULL(lcd->own_frame, LCDC_FRAME_SIZE);
+    memset(lcd->own_frame, 0, LCDC_FRAME_SIZE);
+    lcd->frame = lcd->own_frame;
+
+    return image_create(&lcd->display, LCD_WIDTH, LCD_HEIGHT);
+}
+
+void lcdc_free(lcdc_t *lcd)
+{
+    if (lcd != NULL)
+    {
+        image_free(&lcd->display);
+        free(lcd->tiles);
+        lcd->tiles = NULL;
+        free(lcd->sprites);
+        lcd->sprites = NULL;
+        free(lcd->own_frame);
+        lcd->own_frame = NULL;
+        lcd->frame = NULL;
+    }
+}
+
+int lcdc_plug(lcdc_t *lcd, bus_t bus)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE_NON_NULL(bus);
+
+    // the registers are part of the REGISTERS component, nothing to plug
+    return ERR_NONE;
+}
+
+int lcdc_cycle(lcdc_t *lcd, uint64_t cycle)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(cycle <= lcd->next_cycle, ERR_BAD_PARAMETER,
+              "cycle %" PRIu64 " is past the next LCDC event (%" PRIu64 ")", cycle, lcd->next_cycle);
+
+    if (cycle == lcd->next_cycle)
+        return lcdc_line_event(lcd, cycle);
+
+    if (lcd->next_cycle == UINT64_MAX && (lcdc_reg_get(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK))
+    {
+        // the screen has just been switched on
+        lcd->next_cycle = cycle;
+        lcd->on_cycle = cycle;
+        return lcdc_line_event(lcd, cycle);
+    }
+
+    return ERR_NONE;
+}
+
+int lcdc_set_frame(lcdc_t *lcd, data_t *frame)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE((uintptr_t) frame % LCDC_FRAME_ALIGN == 0, ERR_BAD_PARAMETER,
+              "frame buffer %p is not %d-byte aligned", (void *) frame, LCDC_FRAME_ALIGN);
+
+    if (frame == NULL)
+        frame = lcd->own_frame;
+    if (frame != lcd->frame)
+        memcpy(frame, lcd->frame, LCDC_FRAME_SIZE);
+    lcd->frame = frame;
+
+    return ERR_NONE;
+}
+
+int lcdc_dma(lcdc_t *lcd)
+{
+    M_REQUIRE_NON_NULL(lcd);
+
+    lcd->sprites->dirty = 1;
+    return bus_copy(*lcd->cpu->bus, GRAPH_RAM_START, lcd->DMA_from, DMA_CYCLES);
+}
+
+int lcdc_vram_write(lcdc_t *lcd, addr_t addr)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(addr >= TILE_SRC_ADDR_LOW && addr <= TILE_SRC_ADDR_END, ERR_BAD_PARAMETER,
+              "address 0x%04x is not in the tile data", addr);
+
+    const size_t index = (size_t)(addr - TILE_SRC_ADDR_LOW) / TILE_SIZE;
+    lcd->tiles->dirty[index / 64] |= (uint64_t)1 << (index % 64);
+
+    return ERR_NONE;
+}
+
+int lcdc_oam_write(lcdc_t *lcd, addr_t addr)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(addr >= GRAPH_RAM_START && addr <= GRAPH_RAM_END, ERR_BAD_PARAMETER,
+              "address 0x%04x is not in OAM", addr);
+
+    lcd->sprites->dirty = 1;
+
+    return ERR_NONE;
+}
+
+int lcdc_bus_listener(lcdc_t *lcd, addr_t addr)
+{
+    M_REQUIRE_NON_NULL(lcd);
+
+    switch (addr)
+    {
+    case REG_LCDC:
+    {
+        const bit_t on = bit_get(lcdc_reg_get(lcd, REG_LCDC), 7);
+        if (lcd->on && !on)
+        {
+            M_EXIT_IF_ERR(lcdc_set_mode(lcd, 0));
+            M_EXIT_IF_ERR(lcdc_reg_set(lcd, REG_LY, 0));
+            M_EXIT_IF_ERR(lcdc_check_lyc(lcd));
+            lcd->next_cycle = UINT64_MAX;
+        }
+        lcd->on = on;
+    }
+    break;
+
+    case REG_LYC:
+        M_EXIT_IF_ERR(lcdc_check_lyc(lcd));
+        break;
+
+    case REG_DMA:
+        lcd->DMA_from = (addr_t)(lcdc_reg_get(lcd, REG_DMA) << 8);
+        break;
+
+    default:
+        break;
+    }
+
+    return ERR_NONE;
+}
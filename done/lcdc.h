@@ -55,6 +55,14 @@ extern "C" {
 // This should be 17556
 #define FRAME_TOTAL_CYCLES ((LCD_HEIGHT + VBLANK_LINES) * LINE_TOTAL_CYCLES)
 
+// Frame buffer: one color (0 to 3, palettes applied) per byte, LCD_HEIGHT
+// lines of LCD_WIDTH pixels, aligned on a cache line
+#define LCDC_FRAME_SIZE  ((size_t) LCD_WIDTH * LCD_HEIGHT)
+#define LCDC_FRAME_ALIGN 64
+
+// OAM DMA: one byte per cycle, the CPU being locked out of the bus meanwhile
+#define DMA_CYCLES 160
+
 
 // LCDC register bits
 
@@ -84,7 +92,10 @@ extern "C" {
 #define TILE_SRC_ADDR_LOW  0x8000
 #define TILE_SRC_ADDR_HIGH 0x8800
 
+#define TILE_SRC_ADDR_END 0x97FF
+
 #define TILE_SIZE 16      // tile size (in bytes)
+#define NB_TILES  384     // tiles in video RAM
 
 #define TILE_LINE_SIZE    32
 #define VISIBLE_LINE_SIZE 20
@@ -94,18 +105,52 @@ extern "C" {
 
 #define WINDOW_OFFSET_X  7
 
+
+// Sprites
+
+#define NB_SPRITES          40
+#define MAX_SPRITES_ON_LINE 10
+
 // ======================================================================
+/**
+ * @brief Decoded tiles: one color number (0 to 3) per byte, leftmost
+ *        pixel first, ready to be copied into a line.
+ *        A tile is decoded again only after a CPU write to its bytes.
+ */
+typedef struct {
+    data_t pixels[NB_TILES][8][8];
+    data_t flipped[NB_TILES][8][8]; // horizontally flipped, for sprites
+    uint64_t dirty[NB_TILES / 64];  // one bit per tile, set by lcdc_vram_write()
+} lcdc_tiles_t;
+
+/**
+ * @brief Sprites of each display line: the first MAX_SPRITES_ON_LINE ones
+ *        in OAM order, sorted by X (then OAM index).
+ *        Built again only after a change to OAM or to the sprite height.
+ */
+typedef struct {
+    data_t count[LCD_HEIGHT];
+    data_t sprites[LCD_HEIGHT][MAX_SPRITES_ON_LINE]; // OAM indexes
+    data_t height; // sprite height the lines were built for
+    bit_t dirty;   // set by lcdc_oam_write() and lcdc_dma()
+} lcdc_sprites_t;
+
 /**
  * @brief lcdc type
  */
 typedef struct {
     cpu_t* cpu;
+    const data_t* vram; // read directly by the renderer
+    const data_t* oam;
+    lcdc_tiles_t* tiles;
+    lcdc_sprites_t* sprites;
     bit_t on;
     uint64_t next_cycle;
     uint64_t on_cycle;
-    addr_t   DMA_from;
-    addr_t   DMA_to;
-    image_t  display;
+    addr_t   DMA_from; // source of the last OAM DMA
+    data_t*  frame;    // where the lines are rendered (see lcdc_set_frame()), for frontends to read
+    data_t*  own_frame;
+    image_t  display;  // the same frame, as an image
     data_t   window_y;
 } lcdc_t;
 
@@ -145,6 +190,52 @@ int lcdc_plug(lcdc_t* lcd, bus_t bus);
 int lcdc_cycle(lcdc_t* lcd, uint64_t cycle);
 
 
+/**
+ * @brief Makes a LCD controler render into a frame buffer of the caller,
+ *        which gets a copy of the current frame
+ *
+ * @param lcd LCD controler
+ * @param frame LCDC_FRAME_SIZE bytes, LCDC_FRAME_ALIGN-byte aligned,
+ *        or NULL to go back to the controler's own buffer
+ * @return error code
+ */
+int lcdc_set_frame(lcdc_t* lcd, data_t* frame);
+
+
+/**
+ * @brief Runs an OAM DMA, all at once: copies its DMA_CYCLES bytes from
+ *        DMA_from to OAM
+ *
+ * @param lcd LCD controler
+ * @return error code
+ */
+int lcdc_dma(lcdc_t* lcd);
+
+
+/**
+ * @brief Marks the tile of a video RAM address to be decoded again
+ *        (to be called after every CPU write to the tile data,
+ *        from TILE_SRC_ADDR_LOW to TILE_SRC_ADDR_END)
+ *
+ * @param lcd LCD controler
+ * @param addr address written
+ * @return error code
+ */
+int lcdc_vram_write(lcdc_t* lcd, addr_t addr);
+
+
+/**
+ * @brief Marks the sprites of the lines to be selected again
+ *        (to be called after every CPU write to OAM,
+ *        from GRAPH_RAM_START to GRAPH_RAM_END)
+ *
+ * @param lcd LCD controler
+ * @param addr address written
+ * @return error code
+ */
+int lcdc_oam_write(lcdc_t* lcd, addr_t addr);
+
+
 /**
  * @brief LCD controler bus listening handler
  *
@@ -16,6 +16,7 @@ int mem_create(memory_t *mem, size_t size)
     M_REQUIRE(0 < size, ERR_BAD_PARAMETER, "\"input size (%lu) is incorrect \"", size);
 
     mem->size = 0;
+    mem->read_only = false;
     mem->memory = calloc(size, sizeof(data_t));
     M_EXIT_IF_NULL(mem->memory, size);
     mem->size = size;
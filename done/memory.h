@@ -31,6 +31,7 @@ typedef uint8_t data_t;
 typedef struct{
     size_t size; 
     data_t* memory; 
+    bool read_only; // the bus never maps it writable (it may be a read-only mapping)
 } memory_t;
 
 
@@ -0,0 +1,540 @@
+#pragma once
+
+/**
+ * @file opcode-table.h
+ * @brief Opcode tables for PPS-GBemul project, as X-macros
+ *
+ * Both the instruction_direct[]/instruction_prefixed[] arrays and the
+ * threaded interpreter (one handler per opcode) are generated from these.
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "opcode.h"
+
+// ======================================================================
+/**
+ * @brief Game Boy CPU PREFIXED instructions ordered by OpCode,
+ *        as X(opcode, OP_...) entries
+ */
+#define INSTR_PREFIXED_TABLE(X) \
+    X(0x00, OP_RLC_B) \
+    X(0x01, OP_RLC_C) \
+    X(0x02, OP_RLC_D) \
+    X(0x03, OP_RLC_E) \
+    X(0x04, OP_RLC_H) \
+    X(0x05, OP_RLC_L) \
+    X(0x06, OP_RLC_HLR) \
+    X(0x07, OP_RLC_A) \
+    X(0x08, OP_RRC_B) \
+    X(0x09, OP_RRC_C) \
+    X(0x0A, OP_RRC_D) \
+    X(0x0B, OP_RRC_E) \
+    X(0x0C, OP_RRC_H) \
+    X(0x0D, OP_RRC_L) \
+    X(0x0E, OP_RRC_HLR) \
+    X(0x0F, OP_RRC_A) \
+    X(0x10, OP_RL_B) \
+    X(0x11, OP_RL_C) \
+    X(0x12, OP_RL_D) \
+    X(0x13, OP_RL_E) \
+    X(0x14, OP_RL_H) \
+    X(0x15, OP_RL_L) \
+    X(0x16, OP_RL_HLR) \
+    X(0x17, OP_RL_A) \
+    X(0x18, OP_RR_B) \
+    X(0x19, OP_RR_C) \
+    X(0x1A, OP_RR_D) \
+    X(0x1B, OP_RR_E) \
+    X(0x1C, OP_RR_H) \
+    X(0x1D, OP_RR_L) \
+    X(0x1E, OP_RR_HLR) \
+    X(0x1F, OP_RR_A) \
+    X(0x20, OP_SLA_B) \
+    X(0x21, OP_SLA_C) \
+    X(0x22, OP_SLA_D) \
+    X(0x23, OP_SLA_E) \
+    X(0x24, OP_SLA_H) \
+    X(0x25, OP_SLA_L) \
+    X(0x26, OP_SLA_HLR) \
+    X(0x27, OP_SLA_A) \
+    X(0x28, OP_SRA_B) \
+    X(0x29, OP_SRA_C) \
+    X(0x2A, OP_SRA_D) \
+    X(0x2B, OP_SRA_E) \
+    X(0x2C, OP_SRA_H) \
+    X(0x2D, OP_SRA_L) \
+    X(0x2E, OP_SRA_HLR) \
+    X(0x2F, OP_SRA_A) \
+    X(0x30, OP_SWAP_B) \
+    X(0x31, OP_SWAP_C) \
+    X(0x32, OP_SWAP_D) \
+    X(0x33, OP_SWAP_E) \
+    X(0x34, OP_SWAP_H) \
+    X(0x35, OP_SWAP_L) \
+    X(0x36, OP_SWAP_HLR) \
+    X(0x37, OP_SWAP_A) \
+    X(0x38, OP_SRL_B) \
+    X(0x39, OP_SRL_C) \
+    X(0x3A, OP_SRL_D) \
+    X(0x3B, OP_SRL_E) \
+    X(0x3C, OP_SRL_H) \
+    X(0x3D, OP_SRL_L) \
+    X(0x3E, OP_SRL_HLR) \
+    X(0x3F, OP_SRL_A) \
+    X(0x40, OP_BIT_0_B) \
+    X(0x41, OP_BIT_0_C) \
+    X(0x42, OP_BIT_0_D) \
+    X(0x43, OP_BIT_0_E) \
+    X(0x44, OP_BIT_0_H) \
+    X(0x45, OP_BIT_0_L) \
+    X(0x46, OP_BIT_0_HLR) \
+    X(0x47, OP_BIT_0_A) \
+    X(0x48, OP_BIT_1_B) \
+    X(0x49, OP_BIT_1_C) \
+    X(0x4A, OP_BIT_1_D) \
+    X(0x4B, OP_BIT_1_E) \
+    X(0x4C, OP_BIT_1_H) \
+    X(0x4D, OP_BIT_1_L) \
+    X(0x4E, OP_BIT_1_HLR) \
+    X(0x4F, OP_BIT_1_A) \
+    X(0x50, OP_BIT_2_B) \
+    X(0x51, OP_BIT_2_C) \
+    X(0x52, OP_BIT_2_D) \
+    X(0x53, OP_BIT_2_E) \
+    X(0x54, OP_BIT_2_H) \
+    X(0x55, OP_BIT_2_L) \
+    X(0x56, OP_BIT_2_HLR) \
+    X(0x57, OP_BIT_2_A) \
+    X(0x58, OP_BIT_3_B) \
+    X(0x59, OP_BIT_3_C) \
+    X(0x5A, OP_BIT_3_D) \
+    X(0x5B, OP_BIT_3_E) \
+    X(0x5C, OP_BIT_3_H) \
+    X(0x5D, OP_BIT_3_L) \
+    X(0x5E, OP_BIT_3_HLR) \
+    X(0x5F, OP_BIT_3_A) \
+    X(0x60, OP_BIT_4_B) \
+    X(0x61, OP_BIT_4_C) \
+    X(0x62, OP_BIT_4_D) \
+    X(0x63, OP_BIT_4_E) \
+    X(0x64, OP_BIT_4_H) \
+    X(0x65, OP_BIT_4_L) \
+    X(0x66, OP_BIT_4_HLR) \
+    X(0x67, OP_BIT_4_A) \
+    X(0x68, OP_BIT_5_B) \
+    X(0x69, OP_BIT_5_C) \
+    X(0x6A, OP_BIT_5_D) \
+    X(0x6B, OP_BIT_5_E) \
+    X(0x6C, OP_BIT_5_H) \
+    X(0x6D, OP_BIT_5_L) \
+    X(0x6E, OP_BIT_5_HLR) \
+    X(0x6F, OP_BIT_5_A) \
+    X(0x70, OP_BIT_6_B) \
+    X(0x71, OP_BIT_6_C) \
+    X(0x72, OP_BIT_6_D) \
+    X(0x73, OP_BIT_6_E) \
+    X(0x74, OP_BIT_6_H) \
+    X(0x75, OP_BIT_6_L) \
+    X(0x76, OP_BIT_6_HLR) \
+    X(0x77, OP_BIT_6_A) \
+    X(0x78, OP_BIT_7_B) \
+    X(0x79, OP_BIT_7_C) \
+    X(0x7A, OP_BIT_7_D) \
+    X(0x7B, OP_BIT_7_E) \
+    X(0x7C, OP_BIT_7_H) \
+    X(0x7D, OP_BIT_7_L) \
+    X(0x7E, OP_BIT_7_HLR) \
+    X(0x7F, OP_BIT_7_A) \
+    X(0x80, OP_RES_0_B) \
+    X(0x81, OP_RES_0_C) \
+    X(0x82, OP_RES_0_D) \
+    X(0x83, OP_RES_0_E) \
+    X(0x84, OP_RES_0_H) \
+    X(0x85, OP_RES_0_L) \
+    X(0x86, OP_RES_0_HLR) \
+    X(0x87, OP_RES_0_A) \
+    X(0x88, OP_RES_1_B) \
+    X(0x89, OP_RES_1_C) \
+    X(0x8A, OP_RES_1_D) \
+    X(0x8B, OP_RES_1_E) \
+    X(0x8C, OP_RES_1_H) \
+    X(0x8D, OP_RES_1_L) \
+    X(0x8E, OP_RES_1_HLR) \
+    X(0x8F, OP_RES_1_A) \
+    X(0x90, OP_RES_2_B) \
+    X(0x91, OP_RES_2_C) \
+    X(0x92, OP_RES_2_D) \
+    X(0x93, OP_RES_2_E) \
+    X(0x94, OP_RES_2_H) \
+    X(0x95, OP_RES_2_L) \
+    X(0x96, OP_RES_2_HLR) \
+    X(0x97, OP_RES_2_A) \
+    X(0x98, OP_RES_3_B) \
+    X(0x99, OP_RES_3_C) \
+    X(0x9A, OP_RES_3_D) \
+    X(0x9B, OP_RES_3_E) \
+    X(0x9C, OP_RES_3_H) \
+    X(0x9D, OP_RES_3_L) \
+    X(0x9E, OP_RES_3_HLR) \
+    X(0x9F, OP_RES_3_A) \
+    X(0xA0, OP_RES_4_B) \
+    X(0xA1, OP_RES_4_C) \
+    X(0xA2, OP_RES_4_D) \
+    X(0xA3, OP_RES_4_E) \
+    X(0xA4, OP_RES_4_H) \
+    X(0xA5, OP_RES_4_L) \
+    X(0xA6, OP_RES_4_HLR) \
+    X(0xA7, OP_RES_4_A) \
+    X(0xA8, OP_RES_5_B) \
+    X(0xA9, OP_RES_5_C) \
+    X(0xAA, OP_RES_5_D) \
+    X(0xAB, OP_RES_5_E) \
+    X(0xAC, OP_RES_5_H) \
+    X(0xAD, OP_RES_5_L) \
+    X(0xAE, OP_RES_5_HLR) \
+    X(0xAF, OP_RES_5_A) \
+    X(0xB0, OP_RES_6_B) \
+    X(0xB1, OP_RES_6_C) \
+    X(0xB2, OP_RES_6_D) \
+    X(0xB3, OP_RES_6_E) \
+    X(0xB4, OP_RES_6_H) \
+    X(0xB5, OP_RES_6_L) \
+    X(0xB6, OP_RES_6_HLR) \
+    X(0xB7, OP_RES_6_A) \
+    X(0xB8, OP_RES_7_B) \
+    X(0xB9, OP_RES_7_C) \
+    X(0xBA, OP_RES_7_D) \
+    X(0xBB, OP_RES_7_E) \
+    X(0xBC, OP_RES_7_H) \
+    X(0xBD, OP_RES_7_L) \
+    X(0xBE, OP_RES_7_HLR) \
+    X(0xBF, OP_RES_7_A) \
+    X(0xC0, OP_SET_0_B) \
+    X(0xC1, OP_SET_0_C) \
+    X(0xC2, OP_SET_0_D) \
+    X(0xC3, OP_SET_0_E) \
+    X(0xC4, OP_SET_0_H) \
+    X(0xC5, OP_SET_0_L) \
+    X(0xC6, OP_SET_0_HLR) \
+    X(0xC7, OP_SET_0_A) \
+    X(0xC8, OP_SET_1_B) \
+    X(0xC9, OP_SET_1_C) \
+    X(0xCA, OP_SET_1_D) \
+    X(0xCB, OP_SET_1_E) \
+    X(0xCC, OP_SET_1_H) \
+    X(0xCD, OP_SET_1_L) \
+    X(0xCE, OP_SET_1_HLR) \
+    X(0xCF, OP_SET_1_A) \
+    X(0xD0, OP_SET_2_B) \
+    X(0xD1, OP_SET_2_C) \
+    X(0xD2, OP_SET_2_D) \
+    X(0xD3, OP_SET_2_E) \
+    X(0xD4, OP_SET_2_H) \
+    X(0xD5, OP_SET_2_L) \
+    X(0xD6, OP_SET_2_HLR) \
+    X(0xD7, OP_SET_2_A) \
+    X(0xD8, OP_SET_3_B) \
+    X(0xD9, OP_SET_3_C) \
+    X(0xDA, OP_SET_3_D) \
+    X(0xDB, OP_SET_3_E) \
+    X(0xDC, OP_SET_3_H) \
+    X(0xDD, OP_SET_3_L) \
+    X(0xDE, OP_SET_3_HLR) \
+    X(0xDF, OP_SET_3_A) \
+    X(0xE0, OP_SET_4_B) \
+    X(0xE1, OP_SET_4_C) \
+    X(0xE2, OP_SET_4_D) \
+    X(0xE3, OP_SET_4_E) \
+    X(0xE4, OP_SET_4_H) \
+    X(0xE5, OP_SET_4_L) \
+    X(0xE6, OP_SET_4_HLR) \
+    X(0xE7, OP_SET_4_A) \
+    X(0xE8, OP_SET_5_B) \
+    X(0xE9, OP_SET_5_C) \
+    X(0xEA, OP_SET_5_D) \
+    X(0xEB, OP_SET_5_E) \
+    X(0xEC, OP_SET_5_H) \
+    X(0xED, OP_SET_5_L) \
+    X(0xEE, OP_SET_5_HLR) \
+    X(0xEF, OP_SET_5_A) \
+    X(0xF0, OP_SET_6_B) \
+    X(0xF1, OP_SET_6_C) \
+    X(0xF2, OP_SET_6_D) \
+    X(0xF3, OP_SET_6_E) \
+    X(0xF4, OP_SET_6_H) \
+    X(0xF5, OP_SET_6_L) \
+    X(0xF6, OP_SET_6_HLR) \
+    X(0xF7, OP_SET_6_A) \
+    X(0xF8, OP_SET_7_B) \
+    X(0xF9, OP_SET_7_C) \
+    X(0xFA, OP_SET_7_D) \
+    X(0xFB, OP_SET_7_E) \
+    X(0xFC, OP_SET_7_H) \
+    X(0xFD, OP_SET_7_L) \
+    X(0xFE, OP_SET_7_HLR) \
+    X(0xFF, OP_SET_7_A)
+
+// ======================================================================
+/**
+ * @brief Game Boy CPU DIRECT instructions ordered by OpCode,
+ *        as X(opcode, OP_...) entries
+ */
+#define INSTR_DIRECT_TABLE(X) \
+    X(0x00, OP_NOP) \
+    X(0x01, OP_LD_BC_N16) \
+    X(0x02, OP_LD_BCR_A) \
+    X(0x03, OP_INC_BC) \
+    X(0x04, OP_INC_B) \
+    X(0x05, OP_DEC_B) \
+    X(0x06, OP_LD_B_N8) \
+    X(0x07, OP_RLCA) \
+    X(0x08, OP_LD_N16R_SP) \
+    X(0x09, OP_ADD_HL_BC) \
+    X(0x0A, OP_LD_A_BCR) \
+    X(0x0B, OP_DEC_BC) \
+    X(0x0C, OP_INC_C) \
+    X(0x0D, OP_DEC_C) \
+    X(0x0E, OP_LD_C_N8) \
+    X(0x0F, OP_RRCA) \
+    X(0x10, OP_STOP) \
+    X(0x11, OP_LD_DE_N16) \
+    X(0x12, OP_LD_DER_A) \
+    X(0x13, OP_INC_DE) \
+    X(0x14, OP_INC_D) \
+    X(0x15, OP_DEC_D) \
+    X(0x16, OP_LD_D_N8) \
+    X(0x17, OP_RLA) \
+    X(0x18, OP_JR_E8) \
+    X(0x19, OP_ADD_HL_DE) \
+    X(0x1A, OP_LD_A_DER) \
+    X(0x1B, OP_DEC_DE) \
+    X(0x1C, OP_INC_E) \
+    X(0x1D, OP_DEC_E) \
+    X(0x1E, OP_LD_E_N8) \
+    X(0x1F, OP_RRA) \
+    X(0x20, OP_JR_NZ_E8) \
+    X(0x21, OP_LD_HL_N16) \
+    X(0x22, OP_LD_HLRI_A) \
+    X(0x23, OP_INC_HL) \
+    X(0x24, OP_INC_H) \
+    X(0x25, OP_DEC_H) \
+    X(0x26, OP_LD_H_N8) \
+    X(0x27, OP_DAA) \
+    X(0x28, OP_JR_Z_E8) \
+    X(0x29, OP_ADD_HL_HL) \
+    X(0x2A, OP_LD_A_HLRI) \
+    X(0x2B, OP_DEC_HL) \
+    X(0x2C, OP_INC_L) \
+    X(0x2D, OP_DEC_L) \
+    X(0x2E, OP_LD_L_N8) \
+    X(0x2F, OP_CPL) \
+    X(0x30, OP_JR_NC_E8) \
+    X(0x31, OP_LD_SP_N16) \
+    X(0x32, OP_LD_HLRD_A) \
+    X(0x33, OP_INC_SP) \
+    X(0x34, OP_INC_HLR) \
+    X(0x35, OP_DEC_HLR) \
+    X(0x36, OP_LD_HLR_N8) \
+    X(0x37, OP_SCF) \
+    X(0x38, OP_JR_C_E8) \
+    X(0x39, OP_ADD_HL_SP) \
+    X(0x3A, OP_LD_A_HLRD) \
+    X(0x3B, OP_DEC_SP) \
+    X(0x3C, OP_INC_A) \
+    X(0x3D, OP_DEC_A) \
+    X(0x3E, OP_LD_A_N8) \
+    X(0x3F, OP_CCF) \
+    X(0x40, OP_LD_B_B) \
+    X(0x41, OP_LD_B_C) \
+    X(0x42, OP_LD_B_D) \
+    X(0x43, OP_LD_B_E) \
+    X(0x44, OP_LD_B_H) \
+    X(0x45, OP_LD_B_L) \
+    X(0x46, OP_LD_B_HLR) \
+    X(0x47, OP_LD_B_A) \
+    X(0x48, OP_LD_C_B) \
+    X(0x49, OP_LD_C_C) \
+    X(0x4A, OP_LD_C_D) \
+    X(0x4B, OP_LD_C_E) \
+    X(0x4C, OP_LD_C_H) \
+    X(0x4D, OP_LD_C_L) \
+    X(0x4E, OP_LD_C_HLR) \
+    X(0x4F, OP_LD_C_A) \
+    X(0x50, OP_LD_D_B) \
+    X(0x51, OP_LD_D_C) \
+    X(0x52, OP_LD_D_D) \
+    X(0x53, OP_LD_D_E) \
+    X(0x54, OP_LD_D_H) \
+    X(0x55, OP_LD_D_L) \
+    X(0x56, OP_LD_D_HLR) \
+    X(0x57, OP_LD_D_A) \
+    X(0x58, OP_LD_E_B) \
+    X(0x59, OP_LD_E_C) \
+    X(0x5A, OP_LD_E_D) \
+    X(0x5B, OP_LD_E_E) \
+    X(0x5C, OP_LD_E_H) \
+    X(0x5D, OP_LD_E_L) \
+    X(0x5E, OP_LD_E_HLR) \
+    X(0x5F, OP_LD_E_A) \
+    X(0x60, OP_LD_H_B) \
+    X(0x61, OP_LD_H_C) \
+    X(0x62, OP_LD_H_D) \
+    X(0x63, OP_LD_H_E) \
+    X(0x64, OP_LD_H_H) \
+    X(0x65, OP_LD_H_L) \
+    X(0x66, OP_LD_H_HLR) \
+    X(0x67, OP_LD_H_A) \
+    X(0x68, OP_LD_L_B) \
+    X(0x69, OP_LD_L_C) \
+    X(0x6A, OP_LD_L_D) \
+    X(0x6B, OP_LD_L_E) \
+    X(0x6C, OP_LD_L_H) \
+    X(0x6D, OP_LD_L_L) \
+    X(0x6E, OP_LD_L_HLR) \
+    X(0x6F, OP_LD_L_A) \
+    X(0x70, OP_LD_HLR_B) \
+    X(0x71, OP_LD_HLR_C) \
+    X(0x72, OP_LD_HLR_D) \
+    X(0x73, OP_LD_HLR_E) \
+    X(0x74, OP_LD_HLR_H) \
+    X(0x75, OP_LD_HLR_L) \
+    X(0x76, OP_HALT) \
+    X(0x77, OP_LD_HLR_A) \
+    X(0x78, OP_LD_A_B) \
+    X(0x79, OP_LD_A_C) \
+    X(0x7A, OP_LD_A_D) \
+    X(0x7B, OP_LD_A_E) \
+    X(0x7C, OP_LD_A_H) \
+    X(0x7D, OP_LD_A_L) \
+    X(0x7E, OP_LD_A_HLR) \
+    X(0x7F, OP_LD_A_A) \
+    X(0x80, OP_ADD_A_B) \
+    X(0x81, OP_ADD_A_C) \
+    X(0x82, OP_ADD_A_D) \
+    X(0x83, OP_ADD_A_E) \
+    X(0x84, OP_ADD_A_H) \
+    X(0x85, OP_ADD_A_L) \
+    X(0x86, OP_ADD_A_HLR) \
+    X(0x87, OP_ADD_A_A) \
+    X(0x88, OP_ADC_A_B) \
+    X(0x89, OP_ADC_A_C) \
+    X(0x8A, OP_ADC_A_D) \
+    X(0x8B, OP_ADC_A_E) \
+    X(0x8C, OP_ADC_A_H) \
+    X(0x8D, OP_ADC_A_L) \
+    X(0x8E, OP_ADC_A_HLR) \
+    X(0x8F, OP_ADC_A_A) \
+    X(0x90, OP_SUB_A_B) \
+    X(0x91, OP_SUB_A_C) \
+    X(0x92, OP_SUB_A_D) \
+    X(0x93, OP_SUB_A_E) \
+    X(0x94, OP_SUB_A_H) \
+    X(0x95, OP_SUB_A_L) \
+    X(0x96, OP_SUB_A_HLR) \
+    X(0x97, OP_SUB_A_A) \
+    X(0x98, OP_SBC_A_B) \
+    X(0x99, OP_SBC_A_C) \
+    X(0x9A, OP_SBC_A_D) \
+    X(0x9B, OP_SBC_A_E) \
+    X(0x9C, OP_SBC_A_H) \
+    X(0x9D, OP_SBC_A_L) \
+    X(0x9E, OP_SBC_A_HLR) \
+    X(0x9F, OP_SBC_A_A) \
+    X(0xA0, OP_AND_A_B) \
+    X(0xA1, OP_AND_A_C) \
+    X(0xA2, OP_AND_A_D) \
+    X(0xA3, OP_AND_A_E) \
+    X(0xA4, OP_AND_A_H) \
+    X(0xA5, OP_AND_A_L) \
+    X(0xA6, OP_AND_A_HLR) \
+    X(0xA7, OP_AND_A_A) \
+    X(0xA8, OP_XOR_A_B) \
+    X(0xA9, OP_XOR_A_C) \
+    X(0xAA, OP_XOR_A_D) \
+    X(0xAB, OP_XOR_A_E) \
+    X(0xAC, OP_XOR_A_H) \
+    X(0xAD, OP_XOR_A_L) \
+    X(0xAE, OP_XOR_A_HLR) \
+    X(0xAF, OP_XOR_A_A) \
+    X(0xB0, OP_OR_A_B) \
+    X(0xB1, OP_OR_A_C) \
+    X(0xB2, OP_OR_A_D) \
+    X(0xB3, OP_OR_A_E) \
+    X(0xB4, OP_OR_A_H) \
+    X(0xB5, OP_OR_A_L) \
+    X(0xB6, OP_OR_A_HLR) \
+    X(0xB7, OP_OR_A_A) \
+    X(0xB8, OP_CP_A_B) \
+    X(0xB9, OP_CP_A_C) \
+    X(0xBA, OP_CP_A_D) \
+    X(0xBB, OP_CP_A_E) \
+    X(0xBC, OP_CP_A_H) \
+    X(0xBD, OP_CP_A_L) \
+    X(0xBE, OP_CP_A_HLR) \
+    X(0xBF, OP_CP_A_A) \
+    X(0xC0, OP_RET_NZ) \
+    X(0xC1, OP_POP_BC) \
+    X(0xC2, OP_JP_NZ_N16) \
+    X(0xC3, OP_JP_N16) \
+    X(0xC4, OP_CALL_NZ_N16) \
+    X(0xC5, OP_PUSH_BC) \
+    X(0xC6, OP_ADD_A_N8) \
+    X(0xC7, OP_RST_0) \
+    X(0xC8, OP_RET_Z) \
+    X(0xC9, OP_RET) \
+    X(0xCA, OP_JP_Z_N16) \
+    X(0xCB, OP_UNKOWN) \
+    X(0xCC, OP_CALL_Z_N16) \
+    X(0xCD, OP_CALL_N16) \
+    X(0xCE, OP_ADC_A_N8) \
+    X(0xCF, OP_RST_1) \
+    X(0xD0, OP_RET_NC) \
+    X(0xD1, OP_POP_DE) \
+    X(0xD2, OP_JP_NC_N16) \
+    X(0xD3, OP_UNKOWN) \
+    X(0xD4, OP_CALL_NC_N16) \
+    X(0xD5, OP_PUSH_DE) \
+    X(0xD6, OP_SUB_A_N8) \
+    X(0xD7, OP_RST_2) \
+    X(0xD8, OP_RET_C) \
+    X(0xD9, OP_RETI) \
+    X(0xDA, OP_JP_C_N16) \
+    X(0xDB, OP_UNKOWN) \
+    X(0xDC, OP_CALL_C_N16) \
+    X(0xDD, OP_UNKOWN) \
+    X(0xDE, OP_SBC_A_N8) \
+    X(0xDF, OP_RST_3) \
+    X(0xE0, OP_LD_N8R_A) \
+    X(0xE1, OP_POP_HL) \
+    X(0xE2, OP_LD_CR_A) \
+    X(0xE3, OP_UNKOWN) \
+    X(0xE4, OP_UNKOWN) \
+    X(0xE5, OP_PUSH_HL) \
+    X(0xE6, OP_AND_A_N8) \
+    X(0xE7, OP_RST_4) \
+    X(0xE8, OP_ADD_SP_N) \
+    X(0xE9, OP_JP_HL) \
+    X(0xEA, OP_LD_N16R_A) \
+    X(0xEB, OP_UNKOWN) \
+    X(0xEC, OP_UNKOWN) \
+    X(0xED, OP_UNKOWN) \
+    X(0xEE, OP_XOR_A_N8) \
+    X(0xEF, OP_RST_5) \
+    X(0xF0, OP_LD_A_N8R) \
+    X(0xF1, OP_POP_AF) \
+    X(0xF2, OP_LD_A_CR) \
+    X(0xF3, OP_DI) \
+    X(0xF4, OP_UNKOWN) \
+    X(0xF5, OP_PUSH_AF) \
+    X(0xF6, OP_OR_A_N8) \
+    X(0xF7, OP_RST_6) \
+    X(0xF8, OP_LD_HL_SP_N8) \
+    X(0xF9, OP_LD_SP_HL) \
+    X(0xFA, OP_LD_A_N16R) \
+    X(0xFB, OP_EI) \
+    X(0xFC, OP_UNKOWN) \
+    X(0xFD, OP_UNKOWN) \
+    X(0xFE, OP_CP_A_N8) \
+    X(0xFF, OP_RST_7)
@@ -0,0 +1,186 @@
+/**
+ * @file rom-cache.c
+ * @brief Process-wide cache of memory-mapped ROM files
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "rom-cache.h"
+#include "error.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FNV1A_OFFSET 0xcbf29ce484222325u
+#define FNV1A_PRIME  0x100000001b3u
+
+/**
+ * @brief A mapped ROM: the file it was first mapped from, its content hash
+ *        and the number of cartridges using it
+ */
+typedef struct rom_entry {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    uint64_t hash;
+    data_t* data;
+    size_t size;
+    unsigned refs;
+    struct rom_entry* next;
+} rom_entry_t;
+
+static rom_entry_t* rom_cache = NULL;
+static pthread_mutex_t rom_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief FNV-1a hash of a ROM content
+ */
+static uint64_t rom_hash(const data_t* data, size_t size)
+{
+    uint64_t h = FNV1A_OFFSET;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ data[i]) * FNV1A_PRIME;
+    }
+    return h;
+}
+
+/**
+ * @brief Finds the entry of a file not modified since it was mapped
+ */
+static rom_entry_t* rom_cache_find_file(const char* path, const struct stat* st)
+{
+    for (rom_entry_t* e = rom_cache; e != NULL; e = e->next)
+    {
+        if (e->dev == st->st_dev && e->ino == st->st_ino && e->size == (size_t) st->st_size
+            && e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec
+            && strcmp(e->path, path) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the entry of a content
+ */
+static rom_entry_t* rom_cache_find_content(const data_t* data, size_t size, uint64_t hash)
+{
+    for (rom_entry_t* e = rom_cache; e != NULL; e = e->next)
+    {
+        if (e->hash == hash && e->size == size && memcmp(e->data, data, size) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Maps a file, or reuses the mapping of the same file or content
+ *        (the cache must be locked)
+ */
+static int rom_cache_get(const char* path, int fd, rom_entry_t** entry)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return ERR_IO;
+
+    *entry = rom_cache_find_file(path, &st);
+    if (*entry != NULL)
+        return ERR_NONE;
+
+    const size_t size = (size_t) st.st_size;
+    data_t* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return ERR_IO;
+
+    const uint64_t hash = rom_hash(data, size);
+    *entry = rom_cache_find_content(data, size, hash);
+    if (*entry != NULL)
+    {
+        // same game from another file: keep the pages already mapped
+        munmap(data, size);
+        return ERR_NONE;
+    }
+
+    rom_entry_t* e = calloc(1, sizeof(rom_entry_t));
+    if (e == NULL)
+    {
+        munmap(data, size);
+        return ERR_MEM;
+    }
+    strncpy(e->path, path, PATH_MAX - 1);
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtim;
+    e->hash = hash;
+    e->data = data;
+    e->size = size;
+    e->next = rom_cache;
+    rom_cache = e;
+    *entry = e;
+
+    return ERR_NONE;
+}
+
+int rom_cache_acquire(const char* filename, memory_t* mem)
+{
+    M_REQUIRE_NON_NULL(filename);
+    M_REQUIRE_NON_NULL(mem);
+
+    char path[PATH_MAX];
+    if (realpath(filename, path) == NULL)
+        return ERR_IO;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return ERR_IO;
+
+    rom_entry_t* e = NULL;
+    pthread_mutex_lock(&rom_cache_lock);
+    const int err = rom_cache_get(path, fd, &e);
+    if (err == ERR_NONE)
+    {
+        ++e->refs;
+        mem->memory = e->data;
+        mem->size = e->size;
+        mem->read_only = true;
+    }
+    pthread_mutex_unlock(&rom_cache_lock);
+    close(fd);
+
+    return err;
+}
+
+void rom_cache_release(memory_t* mem)
+{
+    if (mem == NULL || mem->memory == NULL || !mem->read_only)
+        return;
+
+    pthread_mutex_lock(&rom_cache_lock);
+    for (rom_entry_t** p = &rom_cache; *p != NULL; p = &(*p)->next)
+    {
+        rom_entry_t* e = *p;
+        if (e->data == mem->memory)
+        {
+            if (--e->refs == 0)
+            {
+                *p = e->next;
+                munmap(e->data, e->size);
+                free(e);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rom_cache_lock);
+
+    mem->memory = NULL;
+    mem->size = 0;
+    mem->read_only = false;
+}
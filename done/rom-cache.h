@@ -0,0 +1,39 @@
+#pragma once
+
+/**
+ * @file rom-cache.h
+ * @brief Process-wide cache of memory-mapped ROM files
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "memory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maps a ROM file read-only. Every cartridge of the process loaded
+ *        from the same path, or from a file with the same content, gets
+ *        the same mapping (and thus the same physical pages).
+ *
+ * @param filename ROM file to map
+ * @param mem memory to set to the content of the file, marked read_only
+ *        (writing there crashes, the bus refuses it)
+ * @return error code, ERR_IO if the file cannot be mapped
+ */
+int rom_cache_acquire(const char* filename, memory_t* mem);
+
+/**
+ * @brief Gives back a ROM got with rom_cache_acquire;
+ *        it is unmapped when its last user gives it back
+ *
+ * @param mem memory to release (emptied)
+ */
+void rom_cache_release(memory_t* mem);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,50 @@
+/**
+ * @file scheduler.c
+ * @brief Event scheduler for GameBoy Emulator
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include "scheduler.h"
+#include "error.h"
+
+int scheduler_init(scheduler_t *sched)
+{
+    M_REQUIRE_NON_NULL(sched);
+
+    for (int i = 0; i < SCHED_NB_EVENTS; ++i)
+    {
+        sched->deadline[i] = SCHED_NEVER;
+    }
+
+    return ERR_NONE;
+}
+
+int scheduler_post(scheduler_t *sched, sched_event_t event, uint64_t cycle)
+{
+    M_REQUIRE_NON_NULL(sched);
+    M_REQUIRE(event < SCHED_NB_EVENTS, ERR_BAD_PARAMETER, "unknown event source %d", event);
+
+    sched->deadline[event] = cycle;
+
+    return ERR_NONE;
+}
+
+uint64_t scheduler_next(const scheduler_t *sched)
+{
+    uint64_t next = SCHED_NEVER;
+
+    if (sched != NULL)
+    {
+        // il n'y a que SCHED_NB_EVENTS sources : un simple parcours
+        // coûte moins cher que d'entretenir un tas
+        for (int i = 0; i < SCHED_NB_EVENTS; ++i)
+        {
+            if (sched->deadline[i] < next)
+                next = sched->deadline[i];
+        }
+    }
+
+    return next;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * @file scheduler.h
+ * @brief Event scheduler for GameBoy Emulator
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deadline of an event which is not (yet) scheduled
+#define SCHED_NEVER UINT64_MAX
+
+/**
+ * @brief Event sources, in the order they must be handled
+ *        when several of them fall on the same cycle
+ */
+typedef enum {
+    SCHED_TIMER,
+    SCHED_LCDC,
+    SCHED_DMA,   // end of the OAM DMA
+    SCHED_CPU,
+    SCHED_NB_EVENTS
+} sched_event_t;
+
+/**
+ * @brief Scheduler type : the next cycle at which each source
+ *        has something to do
+ */
+typedef struct {
+    uint64_t deadline[SCHED_NB_EVENTS];
+} scheduler_t;
+
+/**
+ * @brief Initiates a scheduler, with no event posted
+ *
+ * @param sched scheduler to initiate
+ * @return error code
+ */
+int scheduler_init(scheduler_t* sched);
+
+/**
+ * @brief Posts (or moves) the next deadline of an event source
+ *
+ * @param sched scheduler
+ * @param event event source
+ * @param cycle cycle at which the source must be run (SCHED_NEVER to cancel)
+ * @return error code
+ */
+int scheduler_post(scheduler_t* sched, sched_event_t event, uint64_t cycle);
+
+/**
+ * @brief Gets the earliest posted deadline
+ *
+ * @param sched scheduler
+ * @return earliest deadline, SCHED_NEVER if nothing is posted
+ */
+uint64_t scheduler_next(const scheduler_t* sched);
+
+#ifdef __cplusplus
+}
+#endif
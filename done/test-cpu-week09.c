@@ -8,6 +8,7 @@
 
 #include "opcode.h" // opcode_check_integrity()
 #include "cpu.h"
+#include "cpu-alu.h" // cpu_flags_sync()
 #include "cpu-storage.h" // cpu_read_at_idx()
 #include "util.h"  // for SIZE_T_FMT
 #include "error.h"
@@ -69,6 +70,7 @@ int mem_dump_to_file(const char* filename, component_t* c)
 #define PRPAIR "0x%04" PRIX16
 void cpu_dump(FILE* file, cpu_t* cpu)
 {
+    cpu_flags_sync(cpu); // lazy flags mode
     fprintf(file, "REGS: " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG "\n",
             cpu->A, cpu->B, cpu->C, cpu->D, cpu->E, cpu->F, cpu->H, cpu->L);
     fprintf(file, "REGPAIRS: " PRPAIR ", " PRPAIR ", " PRPAIR ", " PRPAIR "\n",
@@ -7,6 +7,7 @@
  */
 
 #include "gameboy.h"
+#include "cpu-alu.h" // cpu_flags_sync()
 #include "util.h"  // for zero_init_var()
 #include "error.h"
 
@@ -22,8 +23,9 @@ static void error(const char* pgm, const char* msg)
 {
     fputs("ERROR: ", stderr);
     if (msg != NULL) fputs(msg, stderr);
-    fprintf(stderr, "\nusage:    %s input_file [iterations]\n", pgm);
+    fprintf(stderr, "\nusage:    %s input_file [iterations [--skip-boot]]\n", pgm);
     fprintf(stderr, "examples: %s rom.gb 1000\n", pgm);
+    fprintf(stderr, "          %s rom.gb 1000 --skip-boot\n", pgm);
     fprintf(stderr, "          %s game.gb\n", pgm);
 }
 
@@ -57,6 +59,7 @@ int mem_dump_to_file(const char* filename, component_t* c)
 #define PRPAIR "0x%04" PRIX16
 void cpu_dump(FILE* file, cpu_t* cpu)
 {
+    cpu_flags_sync(cpu); // lazy flags mode
     fprintf(file, "REGS: " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG ", " PRREG "\n",
             cpu->A, cpu->B, cpu->C, cpu->D, cpu->E, cpu->F, cpu->H, cpu->L);
     fprintf(file, "REGPAIRS: " PRPAIR ", " PRPAIR ", " PRPAIR ", " PRPAIR "\n",
@@ -93,9 +96,12 @@ int main(int argc, char* argv[])
 
     const char* const filename = argv[1];
 
+    // starts where the boot ROM ends
+    const int skip_boot = argc > 3 && strcmp(argv[3], "--skip-boot") == 0;
+
     gameboy_t gb;
     zero_init_var(gb);
-    int err = gameboy_create(&gb, filename);
+    int err = skip_boot ? gameboy_create_skip_boot(&gb, filename) : gameboy_create(&gb, filename);
     if (err != ERR_NONE) {
         gameboy_free(&gb);
         return err;
@@ -20,22 +20,36 @@ int timer_init(gbtimer_t *timer, cpu_t *cpu)
 
     timer->counter = 0;
     timer->cpu = cpu;
+    timer->TIMA = 0;
+    timer->TMA = 0;
+    timer->TAC = 0;
 
     return ERR_NONE;
 }
 
 /**
-* @brief Gets the bit at a given index
-*
-* @param value value to get the bit from
-* @param index index of the bit
-* @return returns the bit at a given index
-*/
-bit_t bit_get_16(uint16_t value, int index)
+ * @brief Reads a timer register. The timer is not the CPU:
+ *        it accesses the bus directly, without any I/O side effect
+ *
+ * @param timer timer
+ * @param addr register address
+ * @return register value
+ */
+static data_t timer_reg_get(const gbtimer_t *timer, addr_t addr)
 {
-    return (bit_t)((value & (0x01 << index)) >> index);
+    data_t value = 0;
+    bus_read(*timer->cpu->bus, addr, &value);
+    return value;
 }
 
+// TIMA est incrémenté sur le front descendant du bit du compteur choisi
+// par TAC, c.-à-d. chaque fois que le compteur passe un multiple de deux
+// fois ce bit
+static const uint16_t tac_periods[] = { 1u << 10, 1u << 4, 1u << 6, 1u << 8 };
+
+#define TAC_ENABLE_BIT 2
+#define tac_period(tac) tac_periods[(tac) & 0x3]
+
 /**
  * @brief Calculates the state of the timer
  *
@@ -46,18 +60,29 @@ bit_t timer_state(gbtimer_t *timer)
 {
     M_REQUIRE_NON_NULL(timer);
 
-    data_t tac = cpu_read_at_idx((const cpu_t *)timer->cpu, REG_TAC);
-    bit_t bit_0_tac = bit_get(tac, 0);
-    bit_t bit_1_tac = bit_get(tac, 1);
-    bit_t bit_2_tac = bit_get(tac, 2);
+    const uint16_t selected_bit = tac_period(timer->TAC) >> 1;
+    return bit_get(timer->TAC, TAC_ENABLE_BIT) && (timer->counter & selected_bit);
+}
 
-    bit_t bit_main_counter = 0;
-    if (bit_1_tac)
-        bit_main_counter = bit_0_tac ? bit_get_16(timer->counter, 7) : bit_get_16(timer->counter, 5);
-    else
-        bit_main_counter = bit_0_tac ? bit_get_16(timer->counter, 3) : bit_get_16(timer->counter, 9);
+/**
+ * @brief Adds some increments to TIMA, reloading it from TMA and
+ *        requesting the timer interrupt whenever it overflows
+ *
+ * @param timer timer
+ * @param n number of increments
+ */
+static void timer_tima_add(gbtimer_t *timer, uint64_t n)
+{
+    const unsigned to_overflow = 0x100u - timer->TIMA;
+    if (n < to_overflow)
+    {
+        timer->TIMA = (data_t)(timer->TIMA + n);
+        return;
+    }
 
-    return (bit_2_tac && bit_main_counter);
+    cpu_request_interrupt(timer->cpu, TIMER);
+    // après le premier débordement, TIMA boucle entre TMA et 0xFF
+    timer->TIMA = (data_t)(timer->TMA + (n - to_overflow) % (0x100u - timer->TMA));
 }
 
 /**
@@ -69,50 +94,93 @@ bit_t timer_state(gbtimer_t *timer)
 void timer_incr_if_state_change(gbtimer_t *timer, bit_t old_state)
 {
     if (old_state && !timer_state(timer))
-    {
-
-        data_t second_timer_value = cpu_read_at_idx((const cpu_t *)timer->cpu, REG_TIMA);
-        if (second_timer_value == 0xFF)
-        {
-
-            cpu_request_interrupt(timer->cpu, TIMER);
-            second_timer_value = cpu_read_at_idx((const cpu_t *)timer->cpu, REG_TMA);
-        }
-        else
-        {
-            second_timer_value++;
-        }
-        cpu_write_at_idx(timer->cpu, REG_TIMA, second_timer_value);
-    }
+        timer_tima_add(timer, 1);
 }
 
 int timer_cycle(gbtimer_t *timer)
+{
+    M_EXIT_IF_ERR(timer_advance(timer, 1));
+    return timer_bus_update(timer);
+}
+
+int timer_advance(gbtimer_t *timer, uint64_t n_cycles)
 {
     M_REQUIRE_NON_NULL(timer);
 
-    bit_t old_state = timer_state(timer);
-    timer->counter = (uint16_t)(timer->counter + ONE_CYCLE); 
-    M_EXIT_IF_ERR(cpu_write_at_idx(timer->cpu, REG_DIV, msb8(timer->counter)));
-    timer_incr_if_state_change(timer, old_state);
+    if (n_cycles == 0)
+        return ERR_NONE;
+
+    const uint64_t from = timer->counter;
+    const uint64_t to = from + n_cycles * ONE_CYCLE;
+    timer->counter = (uint16_t)to;
+
+    if (bit_get(timer->TAC, TAC_ENABLE_BIT))
+    {
+        // one increment per multiple of the period passed
+        const uint16_t period = tac_period(timer->TAC);
+        timer_tima_add(timer, to / period - from / period);
+    }
 
     return ERR_NONE;
 }
 
+int timer_bus_update(gbtimer_t *timer)
+{
+    M_REQUIRE_NON_NULL(timer);
+
+    M_EXIT_IF_ERR(bus_write(*timer->cpu->bus, REG_DIV, msb8(timer->counter)));
+    return bus_write(*timer->cpu->bus, REG_TIMA, timer->TIMA);
+}
+
 int timer_bus_listener(gbtimer_t *timer, addr_t addr)
 {
     M_REQUIRE_NON_NULL(timer);
 
-    if (addr == REG_DIV)
+    switch (addr)
     {
-        bit_t old_state = timer_state(timer);
+    case REG_DIV:
+    {
+        // any write resets the counter, which may make the selected bit fall
+        const bit_t old_state = timer_state(timer);
         timer->counter = 0u;
-        //M_EXIT_IF_ERR(cpu_write_at_idx(timer->cpu, REG_DIV, msb8(timer->counter)));
         timer_incr_if_state_change(timer, old_state);
+        M_EXIT_IF_ERR(timer_bus_update(timer));
     }
-    else if (addr == REG_TAC)
+    break;
+
+    case REG_TIMA:
+        timer->TIMA = timer_reg_get(timer, REG_TIMA);
+        break;
+
+    case REG_TMA:
+        timer->TMA = timer_reg_get(timer, REG_TMA);
+        break;
+
+    case REG_TAC:
     {
-        timer_incr_if_state_change(timer, timer_state(timer));
+        // stopping the timer or selecting another bit may be a falling edge too
+        const bit_t old_state = timer_state(timer);
+        timer->TAC = timer_reg_get(timer, REG_TAC);
+        timer_incr_if_state_change(timer, old_state);
+    }
+    break;
+
+    default:
+        break;
     }
 
     return ERR_NONE;
 }
+
+uint64_t timer_cycles_to_event(gbtimer_t *timer)
+{
+    if (timer == NULL || !bit_get(timer->TAC, TAC_ENABLE_BIT))
+        return UINT64_MAX;
+
+    // seul le débordement de TIMA (interruption) intéresse l'extérieur :
+    // entre deux, le CPU resynchronise le timer avant de le lire
+    const uint16_t period = tac_period(timer->TAC);
+    const uint64_t increments = 0x100u - timer->TIMA;
+
+    return ((uint64_t)(period - (timer->counter & (period - 1u))) + (increments - 1u) * period) / ONE_CYCLE;
+}
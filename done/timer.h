@@ -36,6 +36,10 @@ extern "C" {
 typedef struct {
     cpu_t* cpu;
     uint16_t counter;
+    // copies of the registers, kept up to date by timer_bus_listener()
+    data_t TIMA;
+    data_t TMA;
+    data_t TAC;
 } gbtimer_t;
 
 /**
@@ -49,7 +53,7 @@ int timer_init(gbtimer_t* timer, cpu_t* cpu);
 
 
 /**
- * @brief Run one Timer cycle
+ * @brief Run one Timer cycle (DIV and TIMA included)
  *
  * @param timer timer to cycle
  * @return error code
@@ -58,7 +62,33 @@ int timer_cycle(gbtimer_t* timer);
 
 
 /**
- * @brief Timer bus listening handler
+ * @brief Runs several Timer cycles at once
+ *
+ * The counter, TIMA and the timer interrupt end up as if timer_cycle()
+ * had been called n_cycles times (provided the CPU does not write to the
+ * timer registers in between), but the cost does not depend on n_cycles.
+ * DIV and TIMA are not written to the bus, see timer_bus_update().
+ *
+ * @param timer timer to advance
+ * @param n_cycles number of cycles to run
+ * @return error code
+ */
+int timer_advance(gbtimer_t* timer, uint64_t n_cycles);
+
+
+/**
+ * @brief Writes the current DIV and TIMA values to the bus
+ *        (to be called before the CPU reads them)
+ *
+ * @param timer timer
+ * @return error code
+ */
+int timer_bus_update(gbtimer_t* timer);
+
+
+/**
+ * @brief Timer bus listening handler, to be called on each CPU write
+ *        to a timer register
  *
  * @param timer timer
  * @param address trigger address
@@ -66,6 +96,17 @@ int timer_cycle(gbtimer_t* timer);
  */
 int timer_bus_listener(gbtimer_t* timer, addr_t addr);
 
+
+/**
+ * @brief Number of timer cycles until the one on which TIMA overflows,
+ *        i.e. requests the timer interrupt (TAC, TIMA and the counter
+ *        being left as they are)
+ *
+ * @param timer timer
+ * @return number of cycles (at least 1), UINT64_MAX if the timer is stopped
+ */
+uint64_t timer_cycles_to_event(gbtimer_t* timer);
+
 #ifdef __cplusplus
 }
 #endif
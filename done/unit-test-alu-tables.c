@@ -0,0 +1,120 @@
+/**
+ * @file unit-test-alu-tables.c
+ * @brief Unit test code for the ALU lookup tables
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <check.h>
+#include <inttypes.h>
+
+#include "tests.h"
+#include "alu.h"
+
+#include "alu.c" // NOTICE: include alu.c for testing against the static bit-by-bit functions
+
+#define ck_assert_same_output(a, b, ...) \
+    ck_assert_msg((a).value == (b).value && (a).flags == (b).flags, __VA_ARGS__)
+
+START_TEST(alu_tables_arith_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // the flags already there are kept, as by the bit-by-bit functions
+    const flags_t before[] = { 0x00, 0xF0 };
+
+    for (size_t i_ = 0; i_ < sizeof(before) / sizeof(before[0]); ++i_) {
+        for (unsigned c = 0; c < 2; ++c) {
+            for (unsigned x = 0; x <= 0xFF; ++x) {
+                for (unsigned y = 0; y <= 0xFF; ++y) {
+                    alu_output_t fast = {0xBEEF, before[i_]};
+                    alu_output_t ref = {0xBEEF, before[i_]};
+                    ck_assert_err_none(alu_add8(&fast, (uint8_t)x, (uint8_t)y, (bit_t)c));
+                    ck_assert_err_none(alu_add8_bitwise(&ref, (uint8_t)x, (uint8_t)y, (bit_t)c));
+                    ck_assert_same_output(fast, ref, "alu_add8(0x%02X, 0x%02X, %u)", x, y, c);
+
+                    fast = (alu_output_t){0xBEEF, before[i_]};
+                    ref = (alu_output_t){0xBEEF, before[i_]};
+                    ck_assert_err_none(alu_sub8(&fast, (uint8_t)x, (uint8_t)y, (bit_t)c));
+                    ck_assert_err_none(alu_sub8_bitwise(&ref, (uint8_t)x, (uint8_t)y, (bit_t)c));
+                    ck_assert_same_output(fast, ref, "alu_sub8(0x%02X, 0x%02X, %u)", x, y, c);
+                }
+            }
+        }
+    }
+
+    ck_assert_bad_param(alu_add8(NULL, 0, 0, 0));
+    ck_assert_bad_param(alu_sub8(NULL, 0, 0, 0));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(alu_tables_rot_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const flags_t flags[] = { 0x00, 0x10, 0xE0, 0xF0 };
+
+    for (size_t i_ = 0; i_ < sizeof(flags) / sizeof(flags[0]); ++i_) {
+        for (unsigned x = 0; x <= 0xFF; ++x) {
+            for (rot_dir_t dir = LEFT; dir <= RIGHT; ++dir) {
+                alu_output_t fast = {0xBEEF, flags[i_]};
+                alu_output_t ref = {0xBEEF, flags[i_]};
+                ck_assert_err_none(alu_shift(&fast, (uint8_t)x, dir));
+                ck_assert_err_none(alu_shift_bitwise(&ref, (uint8_t)x, dir));
+                ck_assert_same_output(fast, ref, "alu_shift(0x%02X, %d)", x, dir);
+
+                fast = (alu_output_t){0xBEEF, flags[i_]};
+                ref = (alu_output_t){0xBEEF, flags[i_]};
+                ck_assert_err_none(alu_rotate(&fast, (uint8_t)x, dir));
+                ck_assert_err_none(alu_rotate_bitwise(&ref, (uint8_t)x, dir));
+                ck_assert_same_output(fast, ref, "alu_rotate(0x%02X, %d)", x, dir);
+
+                fast = (alu_output_t){0xBEEF, 0};
+                ref = (alu_output_t){0xBEEF, 0};
+                ck_assert_err_none(alu_carry_rotate(&fast, (uint8_t)x, dir, flags[i_]));
+                ck_assert_err_none(alu_carry_rotate_bitwise(&ref, (uint8_t)x, dir, flags[i_]));
+                ck_assert_same_output(fast, ref, "alu_carry_rotate(0x%02X, %d, 0x%02X)", x, dir, flags[i_]);
+            }
+
+            alu_output_t fast = {0xBEEF, flags[i_]};
+            alu_output_t ref = {0xBEEF, flags[i_]};
+            ck_assert_err_none(alu_shiftR_A(&fast, (uint8_t)x));
+            ck_assert_err_none(alu_shiftR_A_bitwise(&ref, (uint8_t)x));
+            ck_assert_same_output(fast, ref, "alu_shiftR_A(0x%02X)", x);
+        }
+    }
+
+    alu_output_t result = {0, 0};
+    ck_assert_bad_param(alu_shift(&result, 0, 2));
+    ck_assert_bad_param(alu_rotate(&result, 0, 2));
+    ck_assert_bad_param(alu_carry_rotate(&result, 0, 2, 0));
+    ck_assert_bad_param(alu_shiftR_A(NULL, 0));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+// ======================================================================
+Suite* alu_tables_test_suite()
+{
+    Suite* s = suite_create("alu.c Lookup Tables Tests");
+
+    Add_Case(s, tc1, "Lookup Tables Tests");
+    tcase_add_test(tc1, alu_tables_arith_exec);
+    tcase_add_test(tc1, alu_tables_rot_exec);
+
+    return s;
+}
+
+TEST_SUITE(alu_tables_test_suite)
@@ -22,6 +22,10 @@
 #include "alu_ext.h"
 #include "bit.h"
 #include "error.h"
+#include "opcode.h"
+#include "cpu-alu.h"
+#include "cpu-exec.h" // cpu_dispatch_alu_ext()
+#include "util.h"     // zero_init_var()
 
 // ------------------------------------------------------------
 #define LOOP_ON(T) const size_t s_ = sizeof(T) / sizeof(*T);  \
@@ -255,6 +259,54 @@ START_TEST(alu_xor_exec)
 END_TEST
 
 
+START_TEST(alu_fast_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // table-driven versions must match the library ones on every input
+    for (unsigned f = 0; f <= 0xF0; f += 0x10) {
+        for (unsigned x = 0; x <= 0xFF; ++x) {
+            alu_output_t fast = {(uint16_t)x, (flags_t)f};
+            alu_output_t ref = {(uint16_t)x, (flags_t)f};
+            ck_assert_int_eq(alu_bcd_adjust_fast(&fast), ERR_NONE);
+            ck_assert_int_eq(alu_bcd_adjust(&ref), ERR_NONE);
+            ck_assert_msg(fast.value == ref.value && fast.flags == ref.flags,
+                          "alu_bcd_adjust_fast() failed on 0x%02X (flags = 0x%02X)", x, f);
+
+            fast = (alu_output_t){0xBEEF, (flags_t)f};
+            ref = (alu_output_t){0xBEEF, (flags_t)f};
+            ck_assert_int_eq(alu_swap4_fast(&fast, (uint8_t)x), ERR_NONE);
+            ck_assert_int_eq(alu_swap4(&ref, (uint8_t)x), ERR_NONE);
+            ck_assert_msg(fast.value == ref.value && fast.flags == ref.flags,
+                          "alu_swap4_fast() failed on 0x%02X (flags = 0x%02X)", x, f);
+
+            // ...and so must the instructions using them
+            const instruction_t* ops[] = { &instruction_direct[0x27], &instruction_prefixed[0x30 | (x & 0x7)] };
+            for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+                if (ops[i]->family == SWAP_HLR)
+                    continue; // needs a bus
+                cpu_t cpu, lib;
+                zero_init_var(cpu);
+                cpu.A = cpu.B = cpu.C = cpu.D = cpu.E = cpu.H = cpu.L = (uint8_t)x;
+                cpu.F = (flags_t)f;
+                lib = cpu;
+                ck_assert_int_eq(cpu_dispatch_alu(ops[i], &cpu), ERR_NONE);
+                ck_assert_int_eq(cpu_dispatch_alu_ext(ops[i], &lib), ERR_NONE);
+                ck_assert_msg(cpu.AF == lib.AF && cpu.BC == lib.BC && cpu.DE == lib.DE && cpu.HL == lib.HL,
+                              "opcode 0x%02X failed on 0x%02X (flags = 0x%02X)", ops[i]->opcode, x, f);
+            }
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
 Suite* bus_test_suite()
 {
 
@@ -279,6 +331,8 @@ Suite* bus_test_suite()
     tcase_add_test(tc1, alu_xor_err);
     tcase_add_test(tc1, alu_xor_exec);
 
+    tcase_add_test(tc1, alu_fast_exec);
+
     return s;
 }
 
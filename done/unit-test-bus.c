@@ -74,9 +74,9 @@ START_TEST(bus_plug_exec)
     ck_assert(c.end == c_size);
 
     for (size_t i = 0; i < c_size; ++i) {
-        ck_assert(bus[i] == c.mem->memory + i);
-        ck_assert(*bus[i] == 0);
-        *bus[i] = data;
+        ck_assert(bus_at(bus, (addr_t) i) == c.mem->memory + i);
+        ck_assert(*bus_at(bus, (addr_t) i) == 0);
+        *bus_at(bus, (addr_t) i) = data;
         ck_assert(c.mem->memory[i] == data);
     }
 
@@ -85,7 +85,7 @@ START_TEST(bus_plug_exec)
     ck_assert(c.end == 0);
 
     for (size_t i = 0; i < c_size; ++i) {
-        ck_assert(bus[i] == NULL);
+        ck_assert(bus_at(bus, (addr_t) i) == NULL);
     }
 
     component_free(&c);
@@ -138,7 +138,7 @@ START_TEST(bus_read_exec)
     ck_assert_int_eq(bus_plug(bus, &c, 0, (addr_t)c_size), ERR_NONE);
 
     for (size_t i = 0; i < c_size; ++i) {
-        *bus[i] = (data_t)i;
+        *bus_at(bus, (addr_t) i) = (data_t)i;
     }
 
     for (size_t addr = 0; addr < c_size; ++addr) {
@@ -191,7 +191,7 @@ START_TEST(bus_write_exec)
     ck_assert_int_eq(bus_plug(bus, &c, 0, (addr_t)c_size), ERR_NONE);
 
     for (size_t i = 0; i < c_size; ++i) {
-        *bus[i] = (data_t) i;
+        *bus_at(bus, (addr_t) i) = (data_t) i;
     }
 
     for (size_t addr = 0; addr < c_size; ++addr) {
@@ -210,6 +210,281 @@ START_TEST(bus_write_exec)
 END_TEST
 
 
+START_TEST(bus_page_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    component_t c2;
+    zero_init_var(c2);
+    data_t reg = 0x42;
+    ck_assert_int_eq(component_create(&c, 0x80), ERR_NONE);
+    ck_assert_int_eq(component_create(&c2, 0x80), ERR_NONE);
+
+    // two components sharing one page
+    ck_assert_int_eq(bus_plug(bus, &c, 0x100, 0x17F), ERR_NONE);
+    ck_assert_int_eq(bus_plug(bus, &c2, 0x180, 0x1FF), ERR_NONE);
+    ck_assert_ptr_nonnull(bus[1].slots);
+    ck_assert_ptr_eq(bus_at(bus, 0x17F), c.mem->memory + 0x7F);
+    ck_assert_ptr_eq(bus_at(bus, 0x180), c2.mem->memory);
+    ck_assert_int_eq(bus_plug(bus, &c2, 0x1F0, 0x1F1), ERR_ADDRESS);
+
+    ck_assert_int_eq(bus_plug_register(bus, 0x1FF, &reg), ERR_NONE);
+    ck_assert_ptr_eq(bus_at(bus, 0x1FF), &reg);
+
+    ck_assert_int_eq(bus_unplug(bus, &c2), ERR_NONE);
+    ck_assert_ptr_null(bus_at(bus, 0x180));
+    ck_assert_int_eq(bus_plug_register(bus, 0x1FF, NULL), ERR_NONE);
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
+
+    // an empty page holds nothing
+    ck_assert_ptr_null(bus[1].slots);
+    ck_assert_ptr_null(bus[1].base);
+
+    component_free(&c);
+    component_free(&c2);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+static int count_access(void* obj, addr_t address, data_t data)
+{
+    (void) address;
+    (void) data;
+    ++*(int*) obj;
+    return ERR_NONE;
+}
+
+START_TEST(bus_mmio_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    int hits = 0;
+
+    ck_assert_int_eq(bus_set_mmio(bus, 0x10, 0x0F, NULL, count_access, &hits), ERR_BAD_PARAMETER);
+
+    // a single register: the page gets split
+    ck_assert_int_eq(bus_set_mmio(bus, 0xFF05, 0xFF05, NULL, count_access, &hits), ERR_NONE);
+    ck_assert(bus[0xFF].mmio_split);
+    ck_assert_int_eq(bus_notify_write(bus, 0xFF05, 0), ERR_NONE);
+    ck_assert_int_eq(bus_notify_write(bus, 0xFF06, 0), ERR_NONE);
+    ck_assert_int_eq(bus_notify_read(bus, 0xFF05), ERR_NONE);
+    ck_assert_int_eq(hits, 1);
+
+    // whole pages: one set of handlers each
+    ck_assert_int_eq(bus_set_mmio(bus, 0x100, 0x2FF, count_access, NULL, &hits), ERR_NONE);
+    ck_assert(!bus[1].mmio_split);
+    ck_assert_ptr_nonnull(bus[2].mmio);
+    ck_assert_int_eq(bus_notify_read(bus, 0x100), ERR_NONE);
+    ck_assert_int_eq(bus_notify_read(bus, 0x2FF), ERR_NONE);
+    ck_assert_int_eq(bus_notify_write(bus, 0x2FF, 0), ERR_NONE);
+    ck_assert_int_eq(bus_notify_read(bus, 0x300), ERR_NONE);
+    ck_assert_int_eq(hits, 3);
+
+    // removal gives the memory back
+    ck_assert_int_eq(bus_set_mmio(bus, 0xFF05, 0xFF05, NULL, NULL, NULL), ERR_NONE);
+    ck_assert_ptr_null(bus[0xFF].mmio);
+    ck_assert_int_eq(bus_set_mmio(bus, 0x100, 0x2FF, NULL, NULL, NULL), ERR_NONE);
+    ck_assert_ptr_null(bus[1].mmio);
+    ck_assert_ptr_null(bus[2].mmio);
+    ck_assert_int_eq(bus_notify_write(bus, 0xFF05, 0), ERR_NONE);
+    ck_assert_int_eq(bus_notify_read(bus, 0x100), ERR_NONE);
+    ck_assert_int_eq(hits, 3);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(bus_access_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    data_t data = 0;
+    ck_assert_int_eq(component_create(&c, 0x200), ERR_NONE);
+    ck_assert_int_eq(bus_plug(bus, &c, 0x200, 0x3FF), ERR_NONE);
+    ck_assert_ptr_null(bus[2].slots);
+    ck_assert_ptr_eq(bus[3].base, c.mem->memory + BUS_PAGE_SIZE);
+
+    ck_assert_int_eq(bus_set_access(bus, 0x200, 0x2FE, BUS_PAGE_READ), ERR_ADDRESS);
+    ck_assert_int_eq(bus_set_access(bus, 0x200, 0x2FF, BUS_PAGE_READ), ERR_NONE);
+
+    // writes to read-only pages are lost
+    ck_assert_int_eq(bus_write(bus, 0x210, 0x12), ERR_NONE);
+    ck_assert_int_eq(bus_read(bus, 0x210, &data), ERR_NONE);
+    ck_assert_int_eq(data, 0);
+    ck_assert_int_eq(bus_write(bus, 0x310, 0x12), ERR_NONE);
+    ck_assert_int_eq(bus_read(bus, 0x310, &data), ERR_NONE);
+    ck_assert_int_eq(data, 0x12);
+
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
+    component_free(&c);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(bus_map_pages_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    data_t data = 0;
+    ck_assert_int_eq(component_create(&c, 0x400), ERR_NONE);
+    c.mem->memory[0x000] = 0x12;
+    c.mem->memory[0x300] = 0x34;
+    ck_assert_int_eq(bus_plug(bus, &c, 0x200, 0x3FF), ERR_NONE);
+    ck_assert_int_eq(bus_set_access(bus, 0x200, 0x3FF, BUS_PAGE_READ), ERR_NONE);
+
+    ck_assert_int_eq(bus_map_pages(bus, 0x200, 0x3FE, c.mem->memory), ERR_ADDRESS);
+    ck_assert_int_eq(bus_map_pages(bus, 0x200, 0x3FF, NULL), ERR_BAD_PARAMETER);
+
+    // another bank: same pages, same access, other memory
+    ck_assert_int_eq(bus_map_pages(bus, 0x200, 0x3FF, c.mem->memory + 0x200), ERR_NONE);
+    ck_assert_ptr_eq(bus[2].base, c.mem->memory + 0x200);
+    ck_assert_ptr_eq(bus[3].base, c.mem->memory + 0x300);
+    ck_assert_int_eq(bus_read(bus, 0x300, &data), ERR_NONE);
+    ck_assert_int_eq(data, 0x34);
+    ck_assert_int_eq(bus_write(bus, 0x300, 0x56), ERR_NONE);
+    ck_assert_int_eq(c.mem->memory[0x300], 0x34);
+
+    ck_assert_int_eq(bus_map_pages(bus, 0x200, 0x2FF, c.mem->memory), ERR_NONE);
+    ck_assert_int_eq(bus_read(bus, 0x200, &data), ERR_NONE);
+    ck_assert_int_eq(data, 0x12);
+
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
+    component_free(&c);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(bus_16_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    addr_t data16 = 0;
+    component_t c2 = {NULL, 0, 0};
+    data_t reg = 0xAB;
+    ck_assert_int_eq(component_create(&c, 0x200), ERR_NONE);
+    ck_assert_int_eq(component_create(&c2, 0x100), ERR_NONE);
+    ck_assert_int_eq(bus_plug(bus, &c, 0x7E00, 0x7FFF), ERR_NONE);
+    ck_assert_int_eq(bus_plug(bus, &c2, 0x8000, 0x80FF), ERR_NONE);
+    ck_assert_int_eq(bus_plug_register(bus, 0xFFFF, &reg), ERR_NONE);
+
+    // within a page, at an odd address
+    ck_assert_int_eq(bus_write16(bus, 0x7E01, 0x1234), ERR_NONE);
+    ck_assert_int_eq(c.mem->memory[0x001], 0x34);
+    ck_assert_int_eq(c.mem->memory[0x002], 0x12);
+    ck_assert_int_eq(bus_read16(bus, 0x7E01, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0x1234);
+
+    // across two components
+    ck_assert_int_eq(bus_write16(bus, 0x7FFF, 0x5678), ERR_NONE);
+    ck_assert_int_eq(c.mem->memory[0x1FF], 0x78);
+    ck_assert_int_eq(c2.mem->memory[0x000], 0x56);
+    ck_assert_int_eq(bus_read16(bus, 0x7FFF, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0x5678);
+
+    // a register alone in its page, then wrapping around to 0x0000 (unmapped)
+    ck_assert_int_eq(bus_read16(bus, 0xFFFE, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0xABFF);
+    ck_assert_int_eq(bus_read16(bus, 0xFFFF, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0xFFAB);
+
+    // read-only memory: not written, still read
+    ck_assert_int_eq(bus_set_access(bus, 0x7E00, 0x7FFF, BUS_PAGE_READ), ERR_NONE);
+    ck_assert_int_eq(bus_write16(bus, 0x7E01, 0x9ABC), ERR_NONE);
+    ck_assert_int_eq(bus_read16(bus, 0x7E01, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0x1234);
+    ck_assert_int_eq(bus_write16(bus, 0x7FFF, 0x9ABC), ERR_NONE);
+    ck_assert_int_eq(bus_read16(bus, 0x7FFF, &data16), ERR_NONE);
+    ck_assert_int_eq(data16, 0x9A78);
+
+    ck_assert_int_eq(bus_read16(bus, 0x7E01, NULL), ERR_BAD_PARAMETER);
+
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
+    ck_assert_int_eq(bus_unplug(bus, &c2), ERR_NONE);
+    ck_assert_int_eq(bus_plug_register(bus, 0xFFFF, NULL), ERR_NONE);
+    component_free(&c);
+    component_free(&c2);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(bus_copy_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    data_t data = 0;
+    data_t reg = 0x42;
+    ck_assert_int_eq(component_create(&c, 0x300), ERR_NONE);
+    for (size_t i = 0; i < 0x100; ++i)
+        c.mem->memory[i] = (data_t) i;
+    ck_assert_int_eq(bus_plug(bus, &c, 0xC000, 0xC2FF), ERR_NONE);
+
+    // page to page: a single copy
+    ck_assert_int_eq(bus_copy(bus, 0xC200, 0xC000, 160), ERR_NONE);
+    ck_assert_int_eq(c.mem->memory[0x200], 0x00);
+    ck_assert_int_eq(c.mem->memory[0x29F], 0x9F);
+
+    // from a split page: byte by byte, unmapped bytes read as 0xFF
+    ck_assert_int_eq(bus_plug_register(bus, 0x8001, &reg), ERR_NONE);
+    ck_assert_int_eq(bus_copy(bus, 0xC200, 0x8000, 3), ERR_NONE);
+    ck_assert_int_eq(c.mem->memory[0x200], 0xFF);
+    ck_assert_int_eq(c.mem->memory[0x201], 0x42);
+    ck_assert_int_eq(c.mem->memory[0x202], 0xFF);
+
+    // read-only destination: not written
+    ck_assert_int_eq(bus_set_access(bus, 0xC200, 0xC2FF, BUS_PAGE_READ), ERR_NONE);
+    ck_assert_int_eq(bus_copy(bus, 0xC200, 0xC000, 160), ERR_NONE);
+    ck_assert_int_eq(bus_read(bus, 0xC201, &data), ERR_NONE);
+    ck_assert_int_eq(data, 0x42);
+
+    ck_assert_int_eq(bus_copy(bus, 0xC200, 0xC000, BUS_PAGE_SIZE + 1), ERR_BAD_PARAMETER);
+
+    ck_assert_int_eq(bus_plug_register(bus, 0x8001, NULL), ERR_NONE);
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
+    component_free(&c);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
 Suite* bus_test_suite()
 {
 #pragma GCC diagnostic push
@@ -231,6 +506,13 @@ Suite* bus_test_suite()
     tcase_add_test(tc3, bus_write_err);
     tcase_add_test(tc3, bus_write_exec);
 
+    tcase_add_test(tc3, bus_page_exec);
+    tcase_add_test(tc3, bus_access_exec);
+    tcase_add_test(tc3, bus_map_pages_exec);
+    tcase_add_test(tc3, bus_16_exec);
+    tcase_add_test(tc3, bus_copy_exec);
+    tcase_add_test(tc3, bus_mmio_exec);
+
     return s;
 }
 
@@ -15,6 +15,7 @@
 
 #include <check.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "tests.h"
 #include "cartridge.h"
@@ -22,6 +23,26 @@
 #include "bus.h"
 
 #define FIBONACCI_ROM "tests/data/fibonacci.gb"
+#define MBC1_ROM "tests/data/blargg_roms/SuperMarioLand.gb"
+#define TEMP_ROM "/tmp/unit-test-cartridge-XXXXXX.gb"
+
+/**
+ * @brief Writes a 32 KiB MBC1 ROM (of the given type and RAM size code) to a
+ *        new temporary file, named in rom; sav gets the name of its save file
+ */
+static void write_temp_rom(char rom[sizeof(TEMP_ROM)], char sav[sizeof(TEMP_ROM) + 1], data_t type, data_t ram_code)
+{
+    static data_t content[BANK_ROM_SIZE];
+    strcpy(rom, TEMP_ROM);
+    const int fd = mkstemps(rom, 3);
+    ck_assert(fd >= 0);
+    strcpy(sav, rom);
+    strcpy(sav + strlen(sav) - 3, ".sav");
+    content[CARTRIDGE_TYPE_ADDR] = type;
+    content[CARTRIDGE_RAM_SIZE_ADDR] = ram_code;
+    ck_assert_int_eq(write(fd, content, sizeof(content)), sizeof(content));
+    close(fd);
+}
 
 START_TEST(cartridge_init_err)
 {
@@ -69,6 +90,36 @@ START_TEST(cartridge_init_exec)
 }
 END_TEST
 
+START_TEST(cartridge_init_from_file_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    uint16_t fb[FIB_BYTES_SIZE] = FIB_BYTES;
+    component_t c = {0};
+
+    // read into the caller's memory
+    ck_assert_err_none(component_create(&c, BANK_ROM_SIZE));
+    ck_assert_err_none(cartridge_init_from_file(&c, FIBONACCI_ROM));
+    ck_assert(!c.mem->read_only);
+    for (size_t i = 0; i < FIB_BYTES_SIZE; ++i) {
+        ck_assert_int_eq(c.mem->memory[i], fb[i]);
+    }
+    ck_assert_int_eq(cartridge_init_from_file(&c, "./file_that_doesnt_exist"), ERR_IO);
+    component_free(&c);
+
+    ck_assert_err_none(component_create(&c, BANK_ROM0_SIZE));
+    ck_assert_bad_param(cartridge_init_from_file(&c, FIBONACCI_ROM));
+    component_free(&c);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
 START_TEST(cartridge_free_exec)
 {
 // ------------------------------------------------------------
@@ -118,10 +169,20 @@ START_TEST(cartridge_plug_exec)
     cartridge_t ct = {0};
     bus_t bus = {0};
     ck_assert_err_none(cartridge_init(&ct, FIBONACCI_ROM));
-    ck_assert_ptr_null(bus[0]);
+    ck_assert_ptr_null(bus_at(bus, 0));
     ck_assert_err_none(cartridge_plug(&ct, bus));
-    ck_assert_ptr_nonnull(bus[0]);
-    ck_assert_ptr_eq(bus[0], &(ct.c.mem->memory[0]));
+    ck_assert_ptr_nonnull(bus_at(bus, 0));
+    ck_assert_ptr_eq(bus_at(bus, 0), &(ct.c.mem->memory[0]));
+
+    // the ROM is a read-only mapping: writes are lost, even when plugged as any component
+    ck_assert(ct.c.mem->read_only);
+    ck_assert_err_none(bus_write(bus, 0, 0x42));
+    ck_assert_err_none(bus_write16(bus, BANK_ROM1_START, 0x4242));
+    ck_assert_err_none(cartridge_unplug(&ct, bus));
+    ck_assert_err_none(bus_plug(bus, &ct.c, BANK_ROM0_START, BANK_ROM1_END));
+    ck_assert_err_none(bus_write(bus, 0, 0x42));
+    ck_assert_int_eq(ct.c.mem->memory[0], 0x31);
+    ck_assert_err_none(bus_unplug(bus, &ct.c));
 
     cartridge_free(&ct);
 #ifdef WITH_PRINT
@@ -132,6 +193,170 @@ START_TEST(cartridge_plug_exec)
 END_TEST
 
 
+START_TEST(cartridge_shared_rom_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    cartridge_t ct1 = {0};
+    cartridge_t ct2 = {0};
+    cartridge_t ct3 = {0};
+
+    // same file (under two names): one mapping
+    ck_assert_err_none(cartridge_init(&ct1, FIBONACCI_ROM));
+    ck_assert_err_none(cartridge_init(&ct2, "./" FIBONACCI_ROM));
+    ck_assert_ptr_eq(ct1.c.mem->memory, ct2.c.mem->memory);
+    ck_assert_ptr_ne(ct1.c.mem, ct2.c.mem);
+
+    ck_assert_err_none(cartridge_init(&ct3, MBC1_ROM));
+    ck_assert_ptr_ne(ct1.c.mem->memory, ct3.c.mem->memory);
+
+    // still mapped for the others
+    cartridge_free(&ct1);
+    ck_assert_ptr_null(ct1.c.mem);
+    ck_assert_int_eq(ct2.c.mem->memory[0], 0x31);
+
+    cartridge_free(&ct2);
+    cartridge_free(&ct3);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+
+START_TEST(cartridge_mbc_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    cartridge_t ct = {0};
+    bus_t bus = {0};
+    ck_assert_err_none(cartridge_init(&ct, MBC1_ROM));
+    ck_assert_int_eq(ct.mbc, MBC1);
+    ck_assert_int_eq(ct.nb_rom_banks, 4);
+    ck_assert_ptr_null(ct.ram.mem);
+
+    ck_assert_err_none(cartridge_plug(&ct, bus));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM1_START), &(ct.c.mem->memory[BANK_ROM1_SIZE]));
+
+    // bank select: the ROM1 pages now point to bank 3
+    ck_assert_err_none(bus_notify_write(bus, 0x2000, 3));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM1_START), &(ct.c.mem->memory[3 * BANK_ROM1_SIZE]));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM1_END), &(ct.c.mem->memory[4 * BANK_ROM1_SIZE - 1]));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM0_START), &(ct.c.mem->memory[0]));
+
+    // bank 0 selects bank 1, numbers wrap around the ROM size
+    ck_assert_err_none(bus_notify_write(bus, 0x3FFF, 0));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM1_START), &(ct.c.mem->memory[BANK_ROM1_SIZE]));
+    ck_assert_err_none(bus_notify_write(bus, 0x2000, 6));
+    ck_assert_ptr_eq(bus_at(bus, BANK_ROM1_START), &(ct.c.mem->memory[2 * BANK_ROM1_SIZE]));
+
+    ck_assert_err_none(cartridge_unplug(&ct, bus));
+    ck_assert_ptr_null(bus_at(bus, BANK_ROM1_START));
+    ck_assert_ptr_null(bus[0].mmio);
+    cartridge_free(&ct);
+
+    // external RAM (not battery-backed: no save file), enabled through the bank controller
+    char rom[sizeof(TEMP_ROM)];
+    char sav[sizeof(TEMP_ROM) + 1];
+    write_temp_rom(rom, sav, 0x02, 0x02);
+    data_t data = 0;
+    ck_assert_err_none(cartridge_init(&ct, rom));
+    ck_assert_ptr_nonnull(ct.ram.mem);
+    ck_assert(!ct.battery);
+    ck_assert_err_none(cartridge_plug(&ct, bus));
+    ck_assert_err_none(bus_write(bus, BANK_RAM_START, 0x42));
+    ck_assert_err_none(bus_read(bus, BANK_RAM_START, &data));
+    ck_assert_int_eq(data, 0xFF);
+
+    ck_assert_err_none(bus_notify_write(bus, 0x0000, 0x0A));
+    ck_assert_err_none(bus_write(bus, BANK_RAM_START, 0x42));
+    ck_assert_err_none(bus_read(bus, BANK_RAM_START, &data));
+    ck_assert_int_eq(data, 0x42);
+    ck_assert_int_eq(ct.ram.mem->memory[0], 0x42);
+
+    ck_assert_err_none(bus_notify_write(bus, 0x0000, 0x00));
+    ck_assert_err_none(bus_read(bus, BANK_RAM_START, &data));
+    ck_assert_int_eq(data, 0xFF);
+
+    ck_assert_err_none(cartridge_unplug(&ct, bus));
+    cartridge_free(&ct);
+    ck_assert_int_ne(access(sav, F_OK), 0);
+    unlink(sav);
+    unlink(rom);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+
+START_TEST(cartridge_save_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // a 32 KiB MBC1+RAM+BATTERY cartridge with 8 KiB of RAM
+    char rom[sizeof(TEMP_ROM)];
+    char sav[sizeof(TEMP_ROM) + 1];
+    write_temp_rom(rom, sav, 0x03, 0x02);
+
+    cartridge_t ct = {0};
+    bus_t bus = {0};
+    ck_assert_err_none(cartridge_init(&ct, rom));
+    ck_assert(ct.battery);
+    ck_assert_err_none(cartridge_plug(&ct, bus));
+
+    ck_assert_err_none(bus_notify_write(bus, 0x0000, 0x0A));
+    ck_assert(ct.ram_dirty);
+    ck_assert_err_none(bus_write(bus, BANK_RAM_START + 1, 0x5A));
+    ck_assert_err_none(cartridge_save_sync(&ct));
+    ck_assert(ct.ram_dirty);
+    ck_assert_err_none(bus_notify_write(bus, 0x0000, 0x00));
+    ck_assert_err_none(cartridge_save_sync(&ct));
+    ck_assert(!ct.ram_dirty);
+
+    ck_assert_err_none(cartridge_unplug(&ct, bus));
+    cartridge_free(&ct);
+
+    // in the save file, and back on the next run
+    FILE* f = fopen(sav, "rb");
+    ck_assert_ptr_nonnull(f);
+    data_t saved[BANK_RAM_SIZE + 1];
+    ck_assert_int_eq(fread(saved, 1, sizeof(saved), f), BANK_RAM_SIZE);
+    fclose(f);
+    ck_assert_int_eq(saved[1], 0x5A);
+
+    ck_assert_err_none(cartridge_init(&ct, rom));
+    ck_assert_int_eq(ct.ram.mem->memory[1], 0x5A);
+
+    // the save is locked: another cartridge of the game plays on a copy of it
+    cartridge_t ct2 = {0};
+    ck_assert_err_none(cartridge_init(&ct2, rom));
+    ck_assert(!ct2.battery);
+    ck_assert_ptr_ne(ct2.ram.mem->memory, ct.ram.mem->memory);
+    ck_assert_int_eq(ct2.ram.mem->memory[1], 0x5A);
+    ct2.ram.mem->memory[1] = 0x33;
+    ck_assert_int_eq(ct.ram.mem->memory[1], 0x5A);
+    cartridge_free(&ct2);
+    cartridge_free(&ct);
+
+    unlink(sav);
+    unlink(rom);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+
 Suite* cartridge_test_suite()
 {
 
@@ -146,9 +371,13 @@ Suite* cartridge_test_suite()
     Add_Case(s, tc1, "Cartridge Tests");
     tcase_add_test(tc1, cartridge_init_err);
     tcase_add_test(tc1, cartridge_init_exec);
+    tcase_add_test(tc1, cartridge_init_from_file_exec);
     tcase_add_test(tc1, cartridge_free_exec);
     tcase_add_test(tc1, cartridge_plug_err);
     tcase_add_test(tc1, cartridge_plug_exec);
+    tcase_add_test(tc1, cartridge_shared_rom_exec);
+    tcase_add_test(tc1, cartridge_mbc_exec);
+    tcase_add_test(tc1, cartridge_save_exec);
 
     return s;
 }
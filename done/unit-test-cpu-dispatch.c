@@ -29,6 +29,8 @@
 #include "unit-test-cpu-dispatch.h"
 
 #include "cpu.c" // NOTICE: include cpu.c for testing static functions
+#include "cpu-threaded.h"
+#include <string.h>
 
 // ------------------------------------------------------------
 
@@ -1365,6 +1367,81 @@ START_TEST(test_SCCF)
 }
 END_TEST
 
+//================================================================
+//                  THREADED INTERPRETER
+//================================================================
+
+// a CPU on a bus entirely made of one memory
+#define LOCKSTEP_CPU(cpu, bus, c) \
+    ck_assert_int_eq(cpu_init(&cpu), ERR_NONE); \
+    ck_assert_int_eq(cpu_plug(&cpu, &bus), ERR_NONE); \
+    COMPONENT_FULL_BUS(bus, &c)
+
+#define LOCKSTEP_RESET(cpu, c, code, f) \
+    do { \
+        memcpy(c.mem->memory, code, BUS_SIZE); \
+        cpu.AF = (uint16_t)(0x3C00 | (f)); \
+        cpu.BC = 0x1281; cpu.DE = 0xC0FF; cpu.HL = 0xC180; \
+        cpu.SP = 0xD000; cpu.PC = 0xC000; \
+        cpu.IME = 0; cpu.HALT = 0; cpu.idle_time = 0; \
+    } while (0)
+
+START_TEST(test_threaded_lockstep)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    cpu_t ref, thr;
+    zero_init_var(ref);
+    zero_init_var(thr);
+    bus_t ref_bus = {0}, thr_bus = {0};
+    component_t ref_c = {NULL, 0, 0}, thr_c = {NULL, 0, 0};
+    LOCKSTEP_CPU(ref, ref_bus, ref_c);
+    LOCKSTEP_CPU(thr, thr_bus, thr_c);
+
+    static data_t code[BUS_SIZE];
+    for (size_t i = 0; i < BUS_SIZE; ++i)
+        code[i] = (data_t)(i * 37 + 11);
+
+    const data_t flags[] = { 0x00, 0x10, 0x80, 0xF0 };
+    for (int prefixed = 0; prefixed <= 1; ++prefixed) {
+        for (int op = 0; op < 256; ++op) {
+            const instruction_t lu = prefixed ? instruction_prefixed[op] : instruction_direct[op];
+            if (lu.family == UNKN)
+                continue;
+
+            code[0xC000] = prefixed ? PREFIXED : (data_t)op;
+            code[0xC001] = prefixed ? (data_t)op : 0x42;
+            LOOP_ON(flags) {
+                LOCKSTEP_RESET(ref, ref_c, code, flags[i_]);
+                LOCKSTEP_RESET(thr, thr_c, code, flags[i_]);
+
+                ck_assert_int_eq(cpu_dispatch(&lu, &ref), ERR_NONE);
+                ck_assert_int_eq(cpu_threaded_exec(&thr), ERR_NONE);
+                cpu_flags_sync(&thr); // as cpu_dispatch() does
+
+                ck_assert_msg(ref.AF == thr.AF && ref.BC == thr.BC && ref.DE == thr.DE && ref.HL == thr.HL
+                              && ref.PC == thr.PC && ref.SP == thr.SP,
+                              "%s opcode 0x%02X, F=0x%02X: registers differ", prefixed ? "prefixed" : "direct", op, flags[i_]);
+                ck_assert_msg(ref.IME == thr.IME && ref.HALT == thr.HALT && ref.idle_time == thr.idle_time,
+                              "%s opcode 0x%02X, F=0x%02X: state differs", prefixed ? "prefixed" : "direct", op, flags[i_]);
+                ck_assert_msg(memcmp(ref_c.mem->memory, thr_c.mem->memory, BUS_SIZE) == 0,
+                              "%s opcode 0x%02X, F=0x%02X: memory differs", prefixed ? "prefixed" : "direct", op, flags[i_]);
+            }
+        }
+    }
+
+    cpu_free(&ref);
+    cpu_free(&thr);
+    component_free(&ref_c);
+    component_free(&thr_c);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
 //================================================================
 //                  END END END
 //================================================================
@@ -1435,6 +1512,9 @@ Suite* cpu_test_suite()
     tcase_add_test(tcalu99, test_DAA);
     tcase_add_test(tcalu99, test_SCCF);
 
+    Add_Case(s, tcthr, "Cpu Threaded Interpreter Tests");
+    tcase_add_test(tcthr, test_threaded_lockstep);
+
     return s;
 }
 TEST_SUITE(cpu_test_suite)
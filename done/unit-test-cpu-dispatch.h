@@ -13,7 +13,7 @@
     static_assert(sizeof(T1) / sizeof(*T1) == sizeof(T2) / sizeof(*T2), "Wrong Size in test tables")
 
 #define CPU_BUS_V_AT(cpu,idx) \
-    *((*(cpu).bus)[idx])
+    *bus_at(*(cpu).bus, (addr_t)(idx))
 
 #define COMPONENT_FULL_BUS(bus,c)\
     ck_assert_int_eq(component_create(c, BUS_SIZE), ERR_NONE); \
@@ -0,0 +1,327 @@
+/**
+ * @file unit-test-cpu-jit.c
+ * @brief Unit test code for the block translator: a CPU running the
+ *        translated code must stay in lockstep with the interpreter
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <check.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "util.h"
+#include "tests.h"
+#include "cpu.h"
+#include "cpu-alu.h"
+#include "cpu-jit.h"
+#include "opcode.h"
+
+#define RAM_END      0xFF7F // the CPU plugs its high RAM (and IE) above
+#define BRK_PAGE     0xD0   // writes there make the caller reschedule
+#define COUNTED_PAGE 0xD1   // reads there are counted
+#define NEVER        UINT64_MAX
+
+/**
+ * @brief A CPU alone on a bus full of RAM, run like gameboy_cpu_step() does
+ */
+typedef struct {
+    bus_t bus;
+    component_t ram;
+    cpu_t cpu;
+    uint64_t cycle; // of the next instruction, NEVER once halted
+    bit_t brk;
+    unsigned reads;
+} machine_t;
+
+static int machine_brk(void *obj, addr_t addr, data_t data)
+{
+    (void)addr;
+    (void)data;
+    ((machine_t *)obj)->brk = 1;
+    return ERR_NONE;
+}
+
+static int machine_count(void *obj, addr_t addr, data_t data)
+{
+    (void)addr;
+    (void)data;
+    ((machine_t *)obj)->reads++;
+    return ERR_NONE;
+}
+
+static void machine_init(machine_t *m, bit_t jit)
+{
+    zero_init_ptr(m);
+    ck_assert_err_none(component_create(&m->ram, RAM_END + 1));
+    ck_assert_err_none(bus_forced_plug(m->bus, &m->ram, 0, RAM_END, 0));
+    ck_assert_err_none(cpu_init(&m->cpu));
+    ck_assert_err_none(cpu_plug(&m->cpu, &m->bus));
+    ck_assert_err_none(bus_set_mmio(m->bus, BRK_PAGE << 8, (BRK_PAGE << 8) | 0xFF, NULL, machine_brk, m));
+    ck_assert_err_none(bus_set_mmio(m->bus, COUNTED_PAGE << 8, (COUNTED_PAGE << 8) | 0xFF, machine_count, NULL, m));
+    if (!jit)
+        cpu_jit_free(&m->cpu);
+}
+
+static void machine_free(machine_t *m)
+{
+    cpu_free(&m->cpu);
+    bus_unplug(m->bus, &m->ram);
+    component_free(&m->ram);
+}
+
+/**
+ * @brief Same memory and registers in both machines
+ */
+static void machine_copy(machine_t *to, const machine_t *from)
+{
+    memcpy(to->ram.mem->memory, from->ram.mem->memory, RAM_END + 1);
+    memcpy(to->cpu.high_ram.mem->memory, from->cpu.high_ram.mem->memory, HIGH_RAM_SIZE);
+    to->cpu.AF = from->cpu.AF;
+    to->cpu.BC = from->cpu.BC;
+    to->cpu.DE = from->cpu.DE;
+    to->cpu.HL = from->cpu.HL;
+    to->cpu.PC = from->cpu.PC;
+    to->cpu.SP = from->cpu.SP;
+    to->cpu.IME = from->cpu.IME;
+    to->cpu.IE = from->cpu.IE;
+    to->cpu.IF = from->cpu.IF;
+    to->cpu.bus_locked = from->cpu.bus_locked;
+    to->cycle = from->cycle;
+}
+
+/**
+ * @brief Runs the instructions starting before stop, or up to a write to BRK_PAGE
+ */
+static void machine_run(machine_t *m, uint64_t stop)
+{
+    cpu_t *cpu = &m->cpu;
+    uint64_t next = m->cycle;
+
+    m->brk = 0;
+    while (next < stop && !m->brk)
+    {
+        uint64_t cycle = next;
+        cpu->idle_time = 0;
+        ck_assert_err_none(cpu_jit_cycle(cpu, &cycle, stop, &m->brk));
+
+        next = cycle + cpu->idle_time + 1;
+        if (cpu->HALT && cpu->idle_time == 0 && !(cpu->IF & cpu->IE))
+            next = NEVER;
+    }
+    m->cycle = next;
+}
+
+static void machine_assert_eq(const machine_t *m, const machine_t *ref)
+{
+    ck_assert_uint_eq(m->cycle, ref->cycle);
+    ck_assert_uint_eq(m->cpu.PC, ref->cpu.PC);
+    ck_assert_uint_eq(m->cpu.AF, ref->cpu.AF);
+    ck_assert_uint_eq(m->cpu.BC, ref->cpu.BC);
+    ck_assert_uint_eq(m->cpu.DE, ref->cpu.DE);
+    ck_assert_uint_eq(m->cpu.HL, ref->cpu.HL);
+    ck_assert_uint_eq(m->cpu.SP, ref->cpu.SP);
+    ck_assert_uint_eq(m->cpu.IME, ref->cpu.IME);
+    ck_assert_uint_eq(m->cpu.IE, ref->cpu.IE);
+    ck_assert_uint_eq(m->cpu.IF, ref->cpu.IF);
+    ck_assert_uint_eq(m->cpu.HALT, ref->cpu.HALT);
+    ck_assert_uint_eq(m->brk, ref->brk);
+    ck_assert_uint_eq(m->reads, ref->reads);
+    ck_assert(memcmp(m->ram.mem->memory, ref->ram.mem->memory, RAM_END + 1) == 0);
+    ck_assert(memcmp(m->cpu.high_ram.mem->memory, ref->cpu.high_ram.mem->memory, HIGH_RAM_SIZE) == 0);
+}
+
+/**
+ * @brief Runs both machines by random slices, comparing them after each
+ */
+static void machine_lockstep(machine_t *m, machine_t *ref, int slices)
+{
+    for (int i = 0; i < slices && ref->cycle != NEVER; ++i)
+    {
+        const uint64_t stop = ref->cycle + 1 + (uint64_t)(rand() % 256);
+        machine_run(ref, stop);
+        machine_run(m, stop);
+        cpu_flags_sync(&ref->cpu); // as cpu_dispatch() does
+        cpu_flags_sync(&m->cpu);
+        machine_assert_eq(m, ref);
+    }
+}
+
+/**
+ * @brief Random registers and memory, without unknown opcodes
+ */
+static void machine_randomize(machine_t *m)
+{
+    data_t *ram = m->ram.mem->memory;
+    for (size_t i = 0; i <= RAM_END; ++i)
+    {
+        ram[i] = (data_t)rand();
+        if (instruction_direct[ram[i]].family == UNKN)
+            ram[i] = 0x00;
+    }
+    m->cpu.AF = (uint16_t)(rand() & 0xFFF0);
+    m->cpu.BC = (uint16_t)rand();
+    m->cpu.DE = (uint16_t)rand();
+    m->cpu.HL = (uint16_t)rand();
+    m->cpu.SP = (uint16_t)rand();
+}
+
+START_TEST(cpu_jit_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    uint64_t cycle = 0;
+    ck_assert_bad_param(cpu_jit_create(NULL));
+    ck_assert_bad_param(cpu_jit_cycle(NULL, &cycle, 1, NULL));
+
+    machine_t m;
+    machine_init(&m, 1);
+    ck_assert_bad_param(cpu_jit_cycle(&m.cpu, NULL, 1, NULL));
+    // harmless
+    cpu_jit_invalidate(NULL, 0);
+    cpu_jit_set_sync(NULL, NULL, NULL);
+    cpu_jit_free(NULL);
+    machine_free(&m);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(cpu_jit_families_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    machine_t m, ref;
+    srand(6);
+
+    // every instruction in a loop: op; JR start (conditional jumps and calls included)
+    for (int prefixed = 0; prefixed <= 1; ++prefixed)
+    {
+        for (int op = 0; op < 256; ++op)
+        {
+            const instruction_t *lu = prefixed ? &instruction_prefixed[op] : &instruction_direct[op];
+            if (lu->family == UNKN || lu->family == HALT || lu->family == STOP)
+                continue;
+
+            // new machines: the memory is written behind the CPUs' back
+            machine_init(&m, 1);
+            machine_init(&ref, 0);
+            machine_randomize(&ref);
+            data_t *ram = ref.ram.mem->memory;
+            const addr_t start = 0x4000;
+            size_t k = start;
+            if (prefixed)
+                ram[k++] = PREFIXED;
+            ram[k++] = (data_t)op;
+            k = start + lu->bytes;
+            ram[k++] = 0x18; // JR start
+            ram[k] = (data_t)(start - (k + 1));
+            // (HL) pointing to the data pages, half of the time
+            if (rand() & 1)
+                ref.cpu.HL = (uint16_t)(BRK_PAGE << 8 | (rand() & 0x1FF));
+            ref.cpu.PC = start;
+            machine_copy(&m, &ref);
+
+            machine_lockstep(&m, &ref, 64);
+            machine_free(&m);
+            machine_free(&ref);
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(cpu_jit_random_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    machine_t m, ref;
+    srand(2020);
+
+    // random code, jumping (and writing) anywhere
+    for (int i = 0; i < 64; ++i)
+    {
+        machine_init(&m, 1);
+        machine_init(&ref, 0);
+        machine_randomize(&ref);
+        ref.cpu.PC = (uint16_t)(rand() & 0x7FFF);
+        ref.cpu.IME = rand() & 1;
+        ref.cpu.IE = (uint8_t)rand();
+        ref.cpu.bus_locked = i % 8 == 0; // as during an OAM DMA
+        machine_copy(&m, &ref);
+
+        machine_lockstep(&m, &ref, 1000);
+        machine_free(&m);
+        machine_free(&ref);
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(cpu_jit_self_modifying_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    machine_t m, ref;
+    machine_init(&m, 1);
+    machine_init(&ref, 0);
+
+    // the loop increments its own LD A, n operand up to 0x40
+    static const data_t code[] = {
+        0x3E, 0x00,       // C000: LD A, 0
+        0x3C,             // C002: INC A
+        0xEA, 0x01, 0xC0, // C003: LD (C001), A
+        0xFE, 0x40,       // C006: CP 0x40
+        0x20, 0xF6,       // C008: JR NZ, C000
+        0x18, 0xFE        // C00A: JR C00A
+    };
+    memcpy(&ref.ram.mem->memory[0xC000], code, sizeof(code));
+    ref.cpu.PC = 0xC000;
+    machine_copy(&m, &ref);
+
+    machine_lockstep(&m, &ref, 200);
+    ck_assert_uint_eq(m.cpu.PC, 0xC00A);
+    ck_assert_uint_eq(m.cpu.A, 0x40);
+    ck_assert_uint_eq(m.ram.mem->memory[0xC001], 0x40);
+
+    machine_free(&m);
+    machine_free(&ref);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+// ======================================================================
+Suite* cpu_jit_test_suite()
+{
+    Suite* s = suite_create("cpu-jit.c Tests");
+
+    Add_Case(s, tc1, "Block Translator Tests");
+    tcase_add_test(tc1, cpu_jit_err);
+    tcase_add_test(tc1, cpu_jit_families_exec);
+    tcase_add_test(tc1, cpu_jit_random_exec);
+    tcase_add_test(tc1, cpu_jit_self_modifying_exec);
+
+    return s;
+}
+
+TEST_SUITE(cpu_jit_test_suite)
@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stddef.h>
 
 #include "tests.h"
 #include "alu.h"
@@ -29,6 +30,7 @@
 #include "cpu-registers.h"
 #include "cpu-storage.h"
 #include "cpu-alu.h"
+#include "gameboy.h" // GB_SIZE_BUDGET
 
 
 // ------------------------------------------------------------
@@ -39,7 +41,7 @@
     static_assert(sizeof(T1) / sizeof(*T1) == sizeof(T2) / sizeof(*T2), "Wrong Size in test tables")
 
 #define CPU_BUS_V_AT(cpu,idx) \
-        *((*(cpu).bus)[idx])
+        *bus_at(*(cpu).bus, (addr_t)(idx))
 
 #define add_bus(cpu,size)\
     bus_t bus = {0}; \
@@ -296,17 +298,30 @@ START_TEST(test_cpu_plug_exec)
 #ifdef WITH_PRINT
     printf("=== %s:\n", __func__);
 #endif
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wint-conversion"
     INIT;
     bus_t bus = {0};
     cpu_init(&cpu);
     cpu_plug(&cpu, &bus);
-    ck_assert_int_eq(cpu.bus, &bus);
-    bus[0] = 0xdd;
-    ck_assert_int_eq((*cpu.bus)[0], bus[0]);
-#pragma GCC diagnostic pop
+    ck_assert_ptr_eq(cpu.bus, &bus);
+    ck_assert_ptr_eq(bus_at(bus, REG_IE), &cpu.IE);
+    ck_assert_ptr_eq(bus_at(bus, REG_IF), &cpu.IF);
+    ck_assert_ptr_eq(bus_at(bus, HIGH_RAM_START), cpu.high_ram.mem->memory);
+    cpu_free(&cpu);
+    ck_assert_ptr_null(bus_at(bus, REG_IE));
+    ck_assert_ptr_null(bus_at(bus, HIGH_RAM_START));
+
+    // high RAM already on the bus: the cpu uses it
+    data_t high_ram[HIGH_RAM_SIZE] = {0};
+    memory_t mem = {HIGH_RAM_SIZE, high_ram};
+    component_t c = {&mem, 0, 0};
+    ck_assert_int_eq(bus_plug(bus, &c, HIGH_RAM_START, HIGH_RAM_END), ERR_NONE);
+    cpu_init(&cpu);
+    ck_assert_int_eq(cpu_plug(&cpu, &bus), ERR_NONE);
+    ck_assert_ptr_null(cpu.high_ram.mem);
+    ck_assert_ptr_eq(bus_at(bus, HIGH_RAM_START), high_ram);
     cpu_free(&cpu);
+    ck_assert_ptr_eq(bus_at(bus, HIGH_RAM_END), high_ram + HIGH_RAM_SIZE - 1);
+    ck_assert_int_eq(bus_unplug(bus, &c), ERR_NONE);
 #ifdef WITH_PRINT
     printf("=== END of %s\n", __func__);
 #endif
@@ -534,6 +549,300 @@ START_TEST(test_cpu_cycle_exec)
 END_TEST
 
 
+#ifndef CPU_THREADED // the threaded core does not use the decoding cache
+START_TEST(test_cpu_decode_cache_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = BUS_PAGE_SIZE;
+    add_bus(cpu, size);
+
+    CPU_BUS_V_AT(cpu, 0) = 0x3C; // INC A
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 1);
+    ck_assert_int_eq(cpu.PC, 1);
+
+    // the decoded instruction is reused...
+    CPU_BUS_V_AT(cpu, 0) = 0x3D; // DEC A
+    cpu.PC = 0;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 2);
+
+    // ...until the CPU writes over it
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, 1, 0x00), ERR_NONE);
+    cpu.PC = 0;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 1);
+
+    // ...or some other memory gets mapped there
+    component_t c2 = {NULL, 0, 0};
+    ck_assert_int_eq(component_create(&c2, size), ERR_NONE);
+    c2.mem->memory[0] = 0x3C; // INC A
+    ck_assert_int_eq(bus_forced_plug(bus, &c2, 0, (addr_t)(size - 1), 0), ERR_NONE);
+    cpu.PC = 0;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 2);
+
+    component_free(&c2);
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+#endif
+
+START_TEST(test_cpu_idle_loop_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = 0x10000;
+    add_bus(cpu, size);
+
+// runs the pending idle cycles, then one instruction
+#define run_instr(cpu) \
+    do { \
+        while ((cpu).idle_time != 0) ck_assert_int_eq(cpu_cycle(&(cpu)), ERR_NONE); \
+        ck_assert_int_eq(cpu_cycle(&(cpu)), ERR_NONE); \
+    } while (0)
+
+    // waits for LY == 0x90
+    const uint8_t poll_ly[] = {0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA}; // LD A,(FF44); CP 0x90; JR NZ,-6
+    for (size_t i = 0; i < sizeof(poll_ly); ++i)
+        CPU_BUS_V_AT(cpu, 0x100 + i) = poll_ly[i];
+    cpu.PC = 0x100;
+
+    // the first iteration only arms the detection
+    for (int i = 0; i < 3; ++i) {
+        run_instr(cpu);
+        ck_assert_int_eq(cpu.idle_loop.cycles, 0);
+    }
+    ck_assert_int_eq(cpu.PC, 0x100);
+
+    // the second one finds the CPU spinning: 3 + 2 + 3 cycles per iteration
+    run_instr(cpu);
+    run_instr(cpu);
+    ck_assert_int_eq(cpu.idle_loop.cycles, 0);
+    run_instr(cpu);
+    ck_assert_int_eq(cpu.idle_loop.cycles, 8);
+    ck_assert_int_eq(cpu.PC, 0x100);
+
+    // the loop exits once LY changes
+    CPU_BUS_V_AT(cpu, 0xFF44) = 0x90;
+    for (int i = 0; i < 3; ++i) {
+        run_instr(cpu);
+        ck_assert_int_eq(cpu.idle_loop.cycles, 0);
+    }
+    ck_assert_int_eq(cpu.PC, 0x106);
+
+    // DIV changes on its own
+    const uint8_t poll_div[] = {0xF0, 0x04, 0xFE, 0x90, 0x20, 0xFA}; // LD A,(FF04); CP 0x90; JR NZ,-6
+    for (size_t i = 0; i < sizeof(poll_div); ++i)
+        CPU_BUS_V_AT(cpu, 0x200 + i) = poll_div[i];
+    cpu.PC = 0x200;
+    for (int i = 0; i < 9; ++i) {
+        run_instr(cpu);
+        ck_assert_int_eq(cpu.idle_loop.cycles, 0);
+    }
+    ck_assert_int_eq(cpu.PC, 0x200);
+
+    // a loop with side effects is no polling loop, even when A and F do not change
+    const uint8_t count[] = {0x05, 0x20, 0xFD}; // DEC B; JR NZ,-3
+    for (size_t i = 0; i < sizeof(count); ++i)
+        CPU_BUS_V_AT(cpu, 0x300 + i) = count[i];
+    cpu.PC = 0x300;
+    cpu.B = 0x80;
+    for (int i = 0; i < 8; ++i) {
+        run_instr(cpu);
+        ck_assert_int_eq(cpu.idle_loop.cycles, 0);
+    }
+
+#undef run_instr
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(test_cpu_lazy_flags_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    cpu_t cpu;
+    zero_init_var(cpu);
+
+    // pending flags must be those the ALU would have combined into F
+    for (unsigned f = 0; f <= 0xF0; f += 0x10) {
+        for (unsigned x = 0; x <= 0xFF; ++x) {
+            for (unsigned y = 0; y <= 0xFF; ++y) {
+                for (bit_t c = 0; c <= 1; ++c) {
+                    const cpu_lazy_flags_t add = {LAZY_ADD8, (uint8_t)x, (uint8_t)y, c};
+                    const cpu_lazy_flags_t sub = {LAZY_SUB8, (uint8_t)x, (uint8_t)y, c};
+
+                    cpu.F = (flags_t)f;
+                    cpu.alu.flags = 0; // as cpu_dispatch() does
+                    ck_assert_err_none(alu_add8(&cpu.alu, (uint8_t)x, (uint8_t)y, c));
+                    ck_assert_err_none(cpu_combine_alu_flags(&cpu, ADD_FLAGS_SRC));
+                    ck_assert_int_eq(cpu_lazy_eval(&add, (flags_t)f), cpu.F);
+
+                    cpu.F = (flags_t)f;
+                    cpu.alu.flags = 0; // as cpu_dispatch() does
+                    ck_assert_err_none(alu_sub8(&cpu.alu, (uint8_t)x, (uint8_t)y, c));
+                    ck_assert_err_none(cpu_combine_alu_flags(&cpu, SUB_FLAGS_SRC));
+                    ck_assert_int_eq(cpu_lazy_eval(&sub, (flags_t)f), cpu.F);
+                }
+            }
+
+            const cpu_lazy_flags_t inc = {LAZY_INC8, (uint8_t)x, 1, get_C((flags_t)f) ? 1 : 0};
+            const cpu_lazy_flags_t dec = {LAZY_DEC8, (uint8_t)x, 1, get_C((flags_t)f) ? 1 : 0};
+
+            cpu.F = (flags_t)f;
+            cpu.alu.flags = 0;
+            ck_assert_err_none(alu_add8(&cpu.alu, (uint8_t)x, 1, 0));
+            ck_assert_err_none(cpu_combine_alu_flags(&cpu, INC_FLAGS_SRC));
+            ck_assert_int_eq(cpu_lazy_eval(&inc, (flags_t)f), cpu.F);
+
+            cpu.F = (flags_t)f;
+            cpu.alu.flags = 0;
+            ck_assert_err_none(alu_sub8(&cpu.alu, (uint8_t)x, 1, 0));
+            ck_assert_err_none(cpu_combine_alu_flags(&cpu, DEC_FLAGS_SRC));
+            ck_assert_int_eq(cpu_lazy_eval(&dec, (flags_t)f), cpu.F);
+        }
+    }
+
+    // nothing pending: F is kept
+    const cpu_lazy_flags_t none = {LAZY_NONE, 0, 0, 0};
+    ck_assert_int_eq(cpu_lazy_eval(&none, 0xB0), 0xB0);
+
+    // syncing writes F once
+    cpu.F = 0;
+    cpu.A = 0x42;
+    cpu.lazy = (cpu_lazy_flags_t){LAZY_SUB8, 0x42, 0x42, 0};
+    cpu_flags_sync(&cpu);
+    ck_assert_int_eq(cpu.lazy.kind, LAZY_NONE);
+    ck_assert_int_eq(cpu.F, FLAG_Z | FLAG_N);
+    ck_assert_int_eq(cpu_reg_pair_get(&cpu, REG_AF_CODE), 0x42C0);
+
+    // POP AF gives F, dropping what was pending
+    cpu.lazy = (cpu_lazy_flags_t){LAZY_ADD8, 0xFF, 0x01, 0};
+    cpu_reg_pair_set(&cpu, REG_AF_CODE, 0x1234);
+    ck_assert_int_eq(cpu.lazy.kind, LAZY_NONE);
+    ck_assert_int_eq(cpu_F_get(&cpu), 0x30);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(test_cpu_bus_lock_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = BUS_PAGE_SIZE;
+    add_bus(cpu, size);
+    CPU_BUS_V_AT(cpu, 0x10) = 0x12;
+    CPU_BUS_V_AT(cpu, 0x11) = 0x34;
+
+    // an OAM DMA holds the bus: only I/O registers and high RAM answer
+    cpu.bus_locked = 1;
+    ck_assert_int_eq(cpu_read_at_idx(&cpu, 0x10), 0xFF);
+    ck_assert_int_eq(cpu_read16_at_idx(&cpu, 0x10), 0xFFFF);
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, 0x10, 0x56), ERR_NONE);
+    ck_assert_int_eq(cpu_write16_at_idx(&cpu, 0xFFFE, 0x5678), ERR_NONE);
+    ck_assert_int_eq(cpu_read_at_idx(&cpu, 0xFFFE), 0x78);
+    ck_assert_int_eq(cpu.IE, 0x56);
+
+    // a locked CPU runs from high RAM
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, HIGH_RAM_START, 0x3C), ERR_NONE); // INC A
+    cpu.PC = HIGH_RAM_START;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 1);
+
+    cpu.bus_locked = 0;
+    ck_assert_int_eq(cpu_read16_at_idx(&cpu, 0x10), 0x3412);
+
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(test_cpu_shared_decode_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = BUS_PAGE_SIZE;
+    add_bus(cpu, size);
+    CPU_BUS_V_AT(cpu, 0) = 0x3C; // INC A
+    ck_assert_int_eq(bus_set_access(bus, 0, (addr_t)(size - 1), BUS_PAGE_READ), ERR_NONE);
+
+    // a second CPU running the same ROM
+    cpu_t cpu2;
+    zero_init_var(cpu2);
+    bus_t bus2 = {0};
+    component_t c2 = {c.mem, 0, 0};
+    ck_assert_int_eq(cpu_init(&cpu2), ERR_NONE);
+    ck_assert_int_eq(cpu_plug(&cpu2, &bus2), ERR_NONE);
+    ck_assert_int_eq(bus_forced_plug(bus2, &c2, 0, (addr_t)(size - 1), 0), ERR_NONE);
+    ck_assert_int_eq(bus_set_access(bus2, 0, (addr_t)(size - 1), BUS_PAGE_READ), ERR_NONE);
+
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu_cycle(&cpu2), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 1);
+    ck_assert_int_eq(cpu2.A, 1);
+#ifndef CPU_THREADED // the threaded core does not use the decoding cache
+    // the decoded page is shared
+    ck_assert_ptr_nonnull(cpu.decoded[0]);
+    ck_assert_ptr_eq(cpu.decoded[0], cpu2.decoded[0]);
+#endif
+
+    // still there for the first CPU, freed with it
+    ck_assert_int_eq(bus_unplug(bus2, &c2), ERR_NONE);
+    cpu_free(&cpu2);
+    cpu.PC = 0;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.A, 2);
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(test_cpu_instance_size)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // hot fields first, and no per-instance copy of what can be shared
+    ck_assert(sizeof(gameboy_t) <= GB_SIZE_BUDGET);
+    ck_assert_uint_eq(offsetof(gameboy_t, cpu), 0);
+    ck_assert(offsetof(gameboy_t, bus) < offsetof(gameboy_t, cartridge));
+    ck_assert(offsetof(gameboy_t, screen) < 4 * GB_CACHE_LINE);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
 Suite* cpu_test_suite()
 {
 
@@ -568,10 +877,22 @@ Suite* cpu_test_suite()
     tcase_add_test(tc4, test_cpu_bus_after_op_macro);
     tcase_add_test(tc4, test_cpu_sp_exec);
     tcase_add_test(tc4, test_cpu_sp_exec);
+    tcase_add_test(tc4, test_cpu_bus_lock_exec);
 
     Add_Case(s, tc5, "Cpu Cycle Tests");
     tcase_add_test(tc5, test_cpu_cycle_err);
     tcase_add_test(tc5, test_cpu_cycle_exec);
+#ifndef CPU_THREADED
+    tcase_add_test(tc5, test_cpu_decode_cache_exec);
+#endif
+    tcase_add_test(tc5, test_cpu_idle_loop_exec);
+
+    Add_Case(s, tc6, "Cpu Flags Tests");
+    tcase_add_test(tc6, test_cpu_lazy_flags_exec);
+
+    Add_Case(s, tc7, "Cpu Hosting Tests");
+    tcase_add_test(tc7, test_cpu_shared_decode_exec);
+    tcase_add_test(tc7, test_cpu_instance_size);
 
     return s;
 }
@@ -0,0 +1,216 @@
+/**
+ * @file unit-test-image.c
+ * @brief Unit test code for the pixel kernels of image.c
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <check.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "tests.h"
+#include "image.h"
+
+static const palette_t test_palettes[] = { DEFAULT_PALETTE, 0x1B, 0xFC, 0x00, 0xD2 };
+
+#define NB_TEST_PALETTES (sizeof(test_palettes) / sizeof(test_palettes[0]))
+
+// color of pixel i (leftmost first) of a tile row
+static uint8_t tile_pixel(uint8_t lsb, uint8_t msb, size_t i)
+{
+    return (uint8_t)((((msb >> (7 - i)) & 1) << 1) | ((lsb >> (7 - i)) & 1));
+}
+
+static uint8_t palette_color(palette_t map, uint8_t color)
+{
+    return (uint8_t)((map >> (2 * color)) & 0x3);
+}
+
+START_TEST(image_pixels_from_tile_rows_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    // every row, in batches of all sizes
+    static uint8_t rows[2 * 65536];
+    static uint8_t pixels[8 * 65536];
+    for (size_t r = 0; r < 65536; ++r)
+    {
+        rows[2 * r] = (uint8_t) r;
+        rows[2 * r + 1] = (uint8_t)(r >> 8);
+    }
+
+    for (size_t p = 0; p < NB_TEST_PALETTES; ++p)
+    {
+        image_pixels_from_tile_rows(pixels, rows, 65536, test_palettes[p]);
+        for (size_t r = 0; r < 65536; ++r)
+        {
+            for (size_t i = 0; i < 8; ++i)
+            {
+                ck_assert_int_eq(pixels[8 * r + i],
+                                 palette_color(test_palettes[p], tile_pixel(rows[2 * r], rows[2 * r + 1], i)));
+            }
+        }
+    }
+
+    // pixels holds the rows decoded with the last palette
+    for (size_t n = 0; n <= 9; ++n)
+    {
+        uint8_t out[8 * 10] = {0};
+        image_pixels_from_tile_rows(out, rows + 2 * 0x1234, n, test_palettes[NB_TEST_PALETTES - 1]);
+        ck_assert_int_eq(memcmp(out, pixels + 8 * 0x1234, 8 * n), 0);
+        for (size_t i = 8 * n; i < sizeof(out); ++i)
+        {
+            ck_assert_int_eq(out[i], 0);
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_pixels_word_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const uint32_t words[] = { 0x00000000, 0xFFFFFFFF, 0xdeadb055, 0x12345678, 0x80000001, 0xAAAAAAAA };
+
+    for (size_t m = 0; m < sizeof(words) / sizeof(words[0]); ++m)
+    {
+        for (size_t l = 0; l < sizeof(words) / sizeof(words[0]); ++l)
+        {
+            for (size_t p = 0; p < NB_TEST_PALETTES; ++p)
+            {
+                uint8_t pixels[IMAGE_LINE_WORD_BITS];
+                image_pixels_from_word(pixels, words[m], words[l], test_palettes[p]);
+                for (size_t i = 0; i < IMAGE_LINE_WORD_BITS; ++i)
+                {
+                    const uint8_t color = (uint8_t)((((words[m] >> i) & 1) << 1) | ((words[l] >> i) & 1));
+                    ck_assert_int_eq(pixels[i], palette_color(test_palettes[p], color));
+                }
+            }
+
+            uint8_t pixels[IMAGE_LINE_WORD_BITS];
+            image_pixels_from_word(pixels, words[m], words[l], DEFAULT_PALETTE);
+            uint32_t msb = 0, lsb = 0;
+            image_pixels_to_word(pixels, &msb, &lsb);
+            ck_assert_int_eq(msb, words[m]);
+            ck_assert_int_eq(lsb, words[l]);
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_pixels_map_colors_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    uint8_t input[100];
+    for (size_t i = 0; i < sizeof(input); ++i)
+    {
+        input[i] = (uint8_t)((i * 7 + i / 5) & 0x3);
+    }
+
+    for (size_t p = 0; p < NB_TEST_PALETTES; ++p)
+    {
+        // all the sizes around the vector ones
+        for (size_t size = 0; size <= sizeof(input); ++size)
+        {
+            uint8_t output[sizeof(input) + 1];
+            memset(output, 0xAA, sizeof(output));
+            image_pixels_map_colors(output, input, size, test_palettes[p]);
+            for (size_t i = 0; i < size; ++i)
+            {
+                ck_assert_int_eq(output[i], palette_color(test_palettes[p], input[i]));
+            }
+            ck_assert_int_eq(output[size], 0xAA);
+        }
+
+        // in place
+        uint8_t inplace[sizeof(input)];
+        memcpy(inplace, input, sizeof(input));
+        image_pixels_map_colors(inplace, inplace, sizeof(inplace), test_palettes[p]);
+        for (size_t i = 0; i < sizeof(input); ++i)
+        {
+            ck_assert_int_eq(inplace[i], palette_color(test_palettes[p], input[i]));
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(image_line_map_colors_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(image_line_map_colors(NULL, (image_line_t) {0}, 0x1B));
+
+    // a size which is not a multiple of the word size
+    const size_t size = 2 * IMAGE_LINE_WORD_BITS + 10;
+    image_line_t line = {0};
+    ck_assert_err_none(image_line_create(&line, size));
+    ck_assert_err_none(image_line_set_word(&line, 0, 0xdeadb055, 0x12345678));
+    ck_assert_err_none(image_line_set_word(&line, 1, 0x0F0F0F0F, 0x00FF00FF));
+    ck_assert_err_none(image_line_set_word(&line, 2, 0x000002AA, 0x00000155));
+
+    for (size_t p = 0; p < NB_TEST_PALETTES; ++p)
+    {
+        image_line_t mapped = {0};
+        ck_assert_err_none(image_line_map_colors(&mapped, line, test_palettes[p]));
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            const uint8_t color = (uint8_t)((bit_vector_get(line.msb, i) << 1) | bit_vector_get(line.lsb, i));
+            const uint8_t expected = palette_color(test_palettes[p], color);
+            ck_assert_int_eq(bit_vector_get(mapped.msb, i), expected >> 1);
+            ck_assert_int_eq(bit_vector_get(mapped.lsb, i), expected & 1);
+            ck_assert_int_eq(bit_vector_get(mapped.opacity, i), bit_vector_get(line.opacity, i));
+        }
+
+        // nothing past the end of the line
+        ck_assert_int_eq(mapped.msb->content[2] >> 10, 0);
+        ck_assert_int_eq(mapped.lsb->content[2] >> 10, 0);
+
+        image_line_free(&mapped);
+    }
+
+    image_line_free(&line);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+Suite* image_test_suite()
+{
+    Suite* s = suite_create("image.c Tests");
+
+    Add_Case(s, tc1, "Pixel Kernels Tests");
+    tcase_add_test(tc1, image_pixels_from_tile_rows_exec);
+    tcase_add_test(tc1, image_pixels_word_exec);
+    tcase_add_test(tc1, image_pixels_map_colors_exec);
+    tcase_add_test(tc1, image_line_map_colors_exec);
+
+    return s;
+}
+
+TEST_SUITE(image_test_suite)
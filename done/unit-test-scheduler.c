@@ -0,0 +1,102 @@
+/**
+ * @file unit-test-scheduler.c
+ * @brief Unit test code for the event scheduler
+ *
+ * @author C la vie
+ * @date 2020
+ */
+
+#include <check.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "tests.h"
+#include "scheduler.h"
+
+START_TEST(scheduler_init_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(scheduler_init(NULL));
+    ck_assert_bad_param(scheduler_post(NULL, SCHED_CPU, 0));
+
+    scheduler_t sched;
+    ck_assert_err_none(scheduler_init(&sched));
+    ck_assert_bad_param(scheduler_post(&sched, SCHED_NB_EVENTS, 0));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(scheduler_init_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    scheduler_t sched;
+    zero_init_var(sched);
+    ck_assert_err_none(scheduler_init(&sched));
+
+    for (int i = 0; i < SCHED_NB_EVENTS; ++i) {
+        ck_assert(sched.deadline[i] == SCHED_NEVER);
+    }
+    ck_assert(scheduler_next(&sched) == SCHED_NEVER);
+    ck_assert(scheduler_next(NULL) == SCHED_NEVER);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(scheduler_next_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    scheduler_t sched;
+    ck_assert_err_none(scheduler_init(&sched));
+
+    ck_assert_err_none(scheduler_post(&sched, SCHED_CPU, 42));
+    ck_assert(scheduler_next(&sched) == 42);
+
+    ck_assert_err_none(scheduler_post(&sched, SCHED_TIMER, 1024));
+    ck_assert(scheduler_next(&sched) == 42);
+
+    ck_assert_err_none(scheduler_post(&sched, SCHED_LCDC, 7));
+    ck_assert(scheduler_next(&sched) == 7);
+
+    // moving a deadline later
+    ck_assert_err_none(scheduler_post(&sched, SCHED_LCDC, 2048));
+    ck_assert(scheduler_next(&sched) == 42);
+
+    // cancelling
+    ck_assert_err_none(scheduler_post(&sched, SCHED_CPU, SCHED_NEVER));
+    ck_assert(scheduler_next(&sched) == 1024);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+// ======================================================================
+Suite* scheduler_test_suite()
+{
+    Suite* s = suite_create("scheduler.c Tests");
+
+    Add_Case(s, tc1, "Scheduler Tests");
+    tcase_add_test(tc1, scheduler_init_err);
+    tcase_add_test(tc1, scheduler_init_exec);
+    tcase_add_test(tc1, scheduler_next_exec);
+
+    return s;
+}
+
+TEST_SUITE(scheduler_test_suite)
@@ -30,7 +30,7 @@
 
 #define register(X) \
     data_t reg_ ## X ## _var = 0; \
-    bus[REG_ ## X] = &reg_ ## X ## _var
+    ck_assert_err_none(bus_plug_register(bus, REG_ ## X, &reg_ ## X ## _var))
 
 #define INIT_BUS \
     bus_t bus; \
@@ -108,17 +108,18 @@ START_TEST(timer_cycle_exec)
     ck_assert_err_none(timer_init(&timer, &cpu));
 
     INIT_BUS;
-    *bus[REG_TAC] = CYCLE_TAC_VALUE;
+    *bus_at(bus, REG_TAC) = CYCLE_TAC_VALUE;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
 
     for (size_t i = 0; i < CYCLE_COUNT_3FFF; ++i) { //do many cycles and check values
         timer_cycle(&timer);
     }
 
     ck_assert_int_eq(timer.counter, CYCLE_COUNT_3FFF_VALUE);
-    ck_assert_int_eq(*bus[REG_TAC], CYCLE_TAC_VALUE );
-    ck_assert_int_eq(*bus[REG_TIMA], CYCLE_TIMA_VALUE);
-    ck_assert_int_eq(*bus[REG_TMA], CYCLE_TMA_VALUE );
-    ck_assert_int_eq(*bus[REG_DIV], CYCLE_DIV_VALUE );
+    ck_assert_int_eq(*bus_at(bus, REG_TAC), CYCLE_TAC_VALUE );
+    ck_assert_int_eq(*bus_at(bus, REG_TIMA), CYCLE_TIMA_VALUE);
+    ck_assert_int_eq(*bus_at(bus, REG_TMA), CYCLE_TMA_VALUE );
+    ck_assert_int_eq(*bus_at(bus, REG_DIV), CYCLE_DIV_VALUE );
     ck_assert_int_eq(cpu.IF, 0);
 
     for (size_t i = 0; i < 3 * CYCLE_COUNT_3FFF + 4; ++i) { //cycle until interruption occurs
@@ -161,11 +162,150 @@ START_TEST(timer_listener_exec)
     timer.counter = 0xFF;
     ck_assert_err_none(timer_bus_listener(&timer, REG_DIV));
     ck_assert_int_eq(timer.counter, 0);
-    ck_assert_int_eq(*bus[REG_DIV], 0);
+    ck_assert_int_eq(*bus_at(bus, REG_DIV), 0);
+
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+
+    // resetting the counter while the selected bit is set makes it fall
+    *bus_at(bus, REG_TAC) = 0x5;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+    *bus_at(bus, REG_TIMA) = 0x10;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TIMA));
+    timer.counter = 0x0008;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_DIV));
+    ck_assert_int_eq(*bus_at(bus, REG_TIMA), 0x11);
+    timer.counter = 0x0004;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_DIV));
+    ck_assert_int_eq(*bus_at(bus, REG_TIMA), 0x11);
 
+    // so does stopping the timer
+    timer.counter = 0x0008;
+    *bus_at(bus, REG_TAC) = 0x1;
     ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+    ck_assert_int_eq(timer.TIMA, 0x12);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+START_TEST(timer_cycles_to_event_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(timer_init(&timer, &cpu));
+
+    INIT_BUS;
 
-    //TODO: check also timer_incr_if_state_change
+    // timer stopped
+    ck_assert(timer_cycles_to_event(&timer) == UINT64_MAX);
+
+    // bit 3 : TIMA moves every 4 cycles, overflows after 256 moves
+    *bus_at(bus, REG_TAC) = 0x5;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+    ck_assert(timer_cycles_to_event(&timer) == 4 * 256);
+    *bus_at(bus, REG_TIMA) = 0xFF;
+    ck_assert_err_none(timer_bus_listener(&timer, REG_TIMA));
+    ck_assert(timer_cycles_to_event(&timer) == 4);
+
+    // the predicted cycle is the one requesting the interrupt
+    const data_t tima[] = { 0xFF, 0xFE, 0xF0 };
+    for (int tac = 4; tac < 8; ++tac) {
+        for (size_t i = 0; i < sizeof(tima) / sizeof(tima[0]); ++i) {
+            timer.counter = 0x0124;
+            *bus_at(bus, REG_TAC) = (data_t) tac;
+            *bus_at(bus, REG_TMA) = 0x42;
+            *bus_at(bus, REG_TIMA) = tima[i];
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TMA));
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TIMA));
+            cpu.IF = 0;
+            const uint64_t n = timer_cycles_to_event(&timer);
+            for (uint64_t c = 1; c < n; ++c) {
+                timer_cycle(&timer);
+            }
+            ck_assert_int_eq(*bus_at(bus, REG_TIMA), 0xFF);
+            ck_assert_int_eq(cpu.IF, 0);
+            timer_cycle(&timer);
+            ck_assert_int_eq(*bus_at(bus, REG_TIMA), 0x42);
+            ck_assert(bit_get(cpu.IF, TIMER));
+        }
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+
+START_TEST(timer_advance_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(timer_init(&timer, &cpu));
+
+    INIT_BUS;
+
+    ck_assert_bad_param(timer_advance(NULL, 1));
+
+    // same result as a cycle by cycle model, whatever the number of cycles
+    const uint64_t lengths[] = { 0, 1, 3, 17, 64, 255, 256, 1000, 4096, 70000, 1u << 20 };
+    const int bits[] = { 9, 3, 5, 7 };
+    for (int tac = 0; tac < 8; ++tac) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l) {
+            const uint16_t counter = (uint16_t) (rand() & 0xFFFC);
+            const data_t tima = (data_t) rand();
+            const data_t tma = (data_t) (rand() % 3 == 0 ? 0xFF : rand());
+
+            timer.counter = counter;
+            *bus_at(bus, REG_TAC) = (data_t) tac;
+            *bus_at(bus, REG_TMA) = tma;
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TAC));
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TMA));
+            // after TAC, whose write may increment TIMA
+            *bus_at(bus, REG_TIMA) = tima;
+            ck_assert_err_none(timer_bus_listener(&timer, REG_TIMA));
+            cpu.IF = 0;
+
+            // reference: TIMA moves on each falling edge of the selected bit
+            uint16_t ref_counter = counter;
+            data_t ref_tima = tima;
+            bit_t ref_interrupt = 0;
+            for (uint64_t c = 0; c < lengths[l]; ++c) {
+                const bit_t old_bit = (ref_counter >> bits[tac & 0x3]) & 1;
+                ref_counter = (uint16_t) (ref_counter + 4);
+                if ((tac & 0x4) && old_bit && !((ref_counter >> bits[tac & 0x3]) & 1)) {
+                    if (ref_tima == 0xFF) {
+                        ref_tima = tma;
+                        ref_interrupt = 1;
+                    } else {
+                        ++ref_tima;
+                    }
+                }
+            }
+
+            ck_assert_err_none(timer_advance(&timer, lengths[l]));
+            ck_assert_int_eq(timer.counter, ref_counter);
+            ck_assert_int_eq(timer.TIMA, ref_tima);
+            ck_assert_int_eq(bit_get(cpu.IF, TIMER), ref_interrupt);
+
+            // the registers are only written when asked for
+            *bus_at(bus, REG_TIMA) = (data_t) ~ref_tima;
+            ck_assert_err_none(timer_bus_update(&timer));
+            ck_assert_int_eq(*bus_at(bus, REG_DIV), ref_counter >> 8);
+            ck_assert_int_eq(*bus_at(bus, REG_TIMA), ref_tima);
+        }
+    }
 
 #ifdef WITH_PRINT
     printf("=== END of %s\n", __func__);
@@ -195,6 +335,8 @@ Suite* timer_test_suite()
     tcase_add_test(tc1, timer_cycle_exec);
     tcase_add_test(tc1, timer_listener_err);
     tcase_add_test(tc1, timer_listener_exec);
+    tcase_add_test(tc1, timer_cycles_to_event_exec);
+    tcase_add_test(tc1, timer_advance_exec);
 
     return s;
 }